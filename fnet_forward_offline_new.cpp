@@ -1,4 +1,8 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 // #include "glog/logging.h"
 #include <cnrt.h>
 #include <fstream>
@@ -7,9 +11,32 @@
 #include <string>
 #include <vector>
 #include <cnml.h>
+#include "magicmind/third_party/json11/json11.h"
+#include "magicmind/common/layout.h"
+#include "magicmind/third_party/half/half.h"
 #include <assert.h>
+#include <string.h>
+#ifdef CHECK_GATHER_WITH_TORCH
 #include <torch/torch.h>
+#endif
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 using namespace std;
 
 // 定义结构体
@@ -25,35 +52,333 @@ void linspace(float start, float stop, int num, float * data){
   }
 }
 
+// 检查cnrt接口的返回值，失败时打印接口名和错误信息后抛出异常；
+// 不能放在assert()中调用，NDEBUG编译时assert()内的调用会被整体去掉
+void CheckCnrt(cnrtRet_t ret, const std::string &what) {
+  if (ret != CNRT_RET_SUCCESS) {
+    std::cout << " " << what << " failed: " << cnrtGetErrorStr(ret) << std::endl;
+    throw " cnrt call failed! ";
+  }
+}
+
+// 数据文件有两种格式，按扩展名区分：
+//   .txt  文本，每行一个float，兼容原来的数据，读写较慢
+//   其他  二进制，8字节魔数"FNETBIN1"、int64元素个数，之后是float32数据，读取时直接mmap
+// 已有的文本数据可以用 fnet_forward_offline_new convert a.txt [b.txt ...] 一次性转换为同名的.bin
+const char kBinMagic[8] = {'F', 'N', 'E', 'T', 'B', 'I', 'N', '1'};
+const int kBinHeaderSize = 16;
+
+bool IsTextData(const std::string &filename) {
+  return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".txt") == 0;
+}
+
+// 二进制数据还没有convert时（文件不存在而同名的.txt存在），退回读取文本数据并提示转换
+std::string ResolveDataPath(const std::string &filename) {
+  struct stat st;
+  if (IsTextData(filename) || stat(filename.c_str(), &st) == 0) {
+    return filename;
+  }
+  size_t dot = filename.rfind('.');
+  size_t slash = filename.rfind('/');
+  std::string stem = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) ? filename : filename.substr(0, dot);
+  std::string text = stem + ".txt";
+  if (stat(text.c_str(), &st) != 0) {
+    return filename;  // 都不存在，由MappedData报错
+  }
+  std::cout << " " << filename << " does not exist, read " << text << " instead. Run 'fnet_forward_offline_new convert "
+            << text << "' once to load it faster. " << std::endl;
+  return text;
+}
+
+// 只读映射二进制数据文件，析构时解除映射
+class MappedData {
+ public:
+  explicit MappedData(std::string filename) {
+    fd_ = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0 || st.st_size < kBinHeaderSize) {
+      std::cout << " Open binary data " << filename << " failed, text data can be converted with "
+                << "'fnet_forward_offline_new convert *.txt'. " << std::endl;
+      throw " can not open binary data file! ";
+    }
+    map_size_ = st.st_size;
+    map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (map_ == MAP_FAILED) {
+      map_ = nullptr;
+      throw " mmap binary data file failed! ";
+    }
+    madvise(map_, map_size_, MADV_SEQUENTIAL);
+    const char * p = reinterpret_cast<const char*>(map_);
+    memcpy(&size_, p + sizeof(kBinMagic), sizeof(size_));
+    if (memcmp(p, kBinMagic, sizeof(kBinMagic)) != 0 || size_ < 0 ||
+        (size_t)map_size_ != kBinHeaderSize + sizeof(float) * size_) {
+      std::cout << " " << filename << " is not a FNETBIN1 file or is truncated. " << std::endl;
+      throw " bad binary data file! ";
+    }
+  }
+
+  ~MappedData() {
+    if (map_) {
+      munmap(map_, map_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  const float * data() const { return reinterpret_cast<const float*>(reinterpret_cast<const char*>(map_) + kBinHeaderSize); }
+  int64_t size() const { return size_; }
+
+ private:
+  MappedData(const MappedData &) = delete;
+  MappedData &operator=(const MappedData &) = delete;
+
+  int fd_ = -1;
+  void * map_ = nullptr;
+  off_t map_size_ = 0;
+  int64_t size_ = 0;
+};
+
+// 一次读入整个文本文件再逐个解析，支持from_chars时用from_chars，否则用strtof
+std::vector<float> readText(std::string filename) {
+  FILE * fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    std::cout << " Open text data " << filename << " failed. " << std::endl;
+    throw " can not open text data file! ";
+  }
+  std::string text;
+  char chunk[1 << 16];
+  size_t n = 0;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    text.append(chunk, n);
+  }
+  fclose(fp);
+  std::vector<float> values;
+  values.reserve(text.size() / 8);
+  const char * p = text.c_str();
+  const char * end = p + text.size();
+  while (true) {
+    while (p < end && isspace(static_cast<unsigned char>(*p))) {
+      p++;
+    }
+    if (p == end) {
+      break;
+    }
+    float value = 0;
+#if defined(__cpp_lib_to_chars)
+    auto ret = std::from_chars(p, end, value);
+    if (ret.ec != std::errc()) {
+      break;
+    }
+    p = ret.ptr;
+#else
+    char * next = nullptr;
+    value = strtof(p, &next);
+    if (next == p) {
+      break;
+    }
+    p = next;
+#endif
+    values.push_back(value);
+  }
+  return values;
+}
+
 void readData(float* data, int length, std::string filename) {
-  std::ifstream file;
-  file.open(filename);
-  float temp = 0.0;
-  int j = 0;
-  while (file >> temp) {
-    data[j] = temp;
-    j++;
-  }
-  file.close();
-  assert(j == length);
-  std::cout << " Read data done! " << std::endl;
-  // CHECK_EQ(j, length)<< "plase check the input data dim";
+  if (IsTextData(filename)) {
+    std::vector<float> values = readText(filename);
+    if ((int64_t)values.size() != length) {
+      std::cout << " " << filename << " has " << values.size() << " floats, needs " << length << ". "
+                << std::endl;
+      throw " data file size does not match input! ";
+    }
+    memcpy(data, values.data(), sizeof(float) * length);
+  } else {
+    MappedData mapped(filename);
+    if (mapped.size() != length) {
+      std::cout << " " << filename << " has " << mapped.size() << " floats, needs " << length << ". "
+                << std::endl;
+      throw " data file size does not match input! ";
+    }
+    memcpy(data, mapped.data(), sizeof(float) * length);
+  }
 }
 
 void writeData(float * data, int length, std::string filename){
-  std::ofstream fout(filename, std::ios::out);
-  fout << std::flush;
-  for (int i = 0; i < length; i++) {
-    // std::cout<< i<<" "<<(reinterpret_cast<float*>(data))[i]<<std::endl;
-    fout << (reinterpret_cast<float*>(data))[i] << std::endl;
+  FILE * fp = fopen(filename.c_str(), "wb");
+  if (!fp) {
+    std::cout << " Open " << filename << " for writing failed. " << std::endl;
+    throw " can not open data file for writing! ";
+  }
+  if (IsTextData(filename)) {
+    // 攒满缓冲区再写，不再每个值flush一次
+    std::vector<char> buffer(1 << 20);
+    size_t used = 0;
+    for (int i = 0; i < length; i++) {
+      if (buffer.size() - used < 64) {
+        fwrite(buffer.data(), 1, used, fp);
+        used = 0;
+      }
+#if defined(__cpp_lib_to_chars)
+      char * p = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), data[i]).ptr;
+      used = p - buffer.data();
+#else
+      used += snprintf(buffer.data() + used, buffer.size() - used, "%.9g", data[i]);
+#endif
+      buffer[used++] = '\n';
+    }
+    fwrite(buffer.data(), 1, used, fp);
+  } else {
+    int64_t size = length;
+    fwrite(kBinMagic, 1, sizeof(kBinMagic), fp);
+    fwrite(&size, sizeof(size), 1, fp);
+    fwrite(data, sizeof(float), length, fp);
+  }
+  bool ok = !ferror(fp);
+  fclose(fp);
+  if (!ok) {
+    throw " write data file failed! ";
   }
-  fout << std::flush;
-  fout.close();
   std::cout << " Write data done! " << std::endl;
 }
 
-// 送进来的数据和索引全部是NCHW排布的
+// batch个[rows, cols]的type类型矩阵转置为float的[cols, rows]，常见类型在分块转置时顺带转换，
+// 不再先整体cnrtCastDataType到中间缓冲；其余类型仍先转换再转置
+void CastTranspose(const void * src, cnrtDataType_t type, float * dst, int64_t batch, int64_t rows, int64_t cols) {
+  switch (type) {
+    case CNRT_FLOAT32:
+      ChannelTranspose(static_cast<const float*>(src), dst, batch, rows, cols);
+      return;
+    case CNRT_FLOAT16:
+      ChannelTranspose(static_cast<const half_float::half*>(src), dst, batch, rows, cols);
+      return;
+    case CNRT_INT8:
+      ChannelTranspose(static_cast<const int8_t*>(src), dst, batch, rows, cols);
+      return;
+    case CNRT_UINT8:
+      ChannelTranspose(static_cast<const uint8_t*>(src), dst, batch, rows, cols);
+      return;
+    case CNRT_INT16:
+      ChannelTranspose(static_cast<const int16_t*>(src), dst, batch, rows, cols);
+      return;
+    case CNRT_INT32:
+      ChannelTranspose(static_cast<const int32_t*>(src), dst, batch, rows, cols);
+      return;
+    default:
+      break;
+  }
+  int64_t count = batch * rows * cols;
+  std::vector<float> casted(count);
+  cnrtCastDataType(const_cast<void*>(src), type, casted.data(), CNRT_FLOAT32, count, nullptr);
+  ChannelTranspose(casted.data(), dst, batch, rows, cols);
+}
+
+// 把文本数据转换为同名的.bin，返回失败的个数
+int convertData(int argc, char* argv[]) {
+  int failed = 0;
+  for (int i = 0; i < argc; i++) {
+    std::string src = argv[i];
+    if (!IsTextData(src)) {
+      std::cout << " Skip " << src << ", only .txt can be converted. " << std::endl;
+      failed++;
+      continue;
+    }
+    std::string dst = src.substr(0, src.size() - 4) + ".bin";
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<float> values = readText(src);
+    writeData(values.data(), values.size(), dst);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << " " << src << " -> " << dst << ": " << values.size() << " floats in " << duration.count() << "us. " << std::endl;
+  }
+  return failed;
+}
+
+// 送进来的数据和索引全部是NCHW排布的，沿dim维gather，输出为把第1维(C)移到最后的NHWC排布，
+// 形状与index相同。直接读取float索引，一次遍历写出NHWC结果，不依赖libtorch。
+// 按(N, 空间位置块)切分给多个线程，块内逐C读取连续的索引和数据，写入的块大小为kTile * C个float。
 float * gather_cpu(void * data, vector<int> &data_shape, void * index, vector<int> &index_shape, int dim, std::string fname, int num){
+  assert(data != nullptr && index != nullptr);
+  int ndim = data_shape.size();
+  if (ndim != 4 && ndim != 5) {
+    throw " data_shape.size() is not 4 or 5! ";
+  }
+  if ((int)index_shape.size() != ndim) {
+    throw " index_shape.size() is not equal to data_shape.size()! ";
+  }
+  if (dim < 0 || dim >= ndim) {
+    throw " gather dim is out of range! ";
+  }
+  // 按行优先计算data和index的步长
+  std::vector<int64_t> data_stride(ndim, 1), index_stride(ndim, 1);
+  for (int i = ndim - 2; i >= 0; i--) {
+    data_stride[i] = data_stride[i + 1] * data_shape[i + 1];
+    index_stride[i] = index_stride[i + 1] * index_shape[i + 1];
+  }
+  const int64_t N = index_shape[0];
+  const int64_t C = index_shape[1];
+  const int64_t spatial = index_stride[1];  // D * H * W
+  const int64_t gather_len = data_shape[dim];
+  const float * src = reinterpret_cast<const float*>(data);
+  const float * idx = reinterpret_cast<const float*>(index);
+  float * ans_NHWC = new float[N * C * spatial];
+  // 工作线程中不能抛出异常，越界时记下并结束本线程，汇合后统一抛出
+  std::atomic<bool> out_of_range(false);
+
+  const int64_t kTile = 256;
+  const int64_t tiles = (spatial + kTile - 1) / kTile;
+  auto run = [&](int64_t task_begin, int64_t task_end) {
+    std::vector<int64_t> base(kTile);
+    for (int64_t task = task_begin; task < task_end; task++) {
+      int64_t n = task / tiles;
+      int64_t p0 = (task % tiles) * kTile;
+      int64_t p1 = std::min(spatial, p0 + kTile);
+      // 空间位置在data中除dim维外的偏移，与C无关，块内只算一次
+      for (int64_t p = p0; p < p1; p++) {
+        int64_t off = (dim == 0 ? 0 : n * data_stride[0]);
+        int64_t rest = p;
+        for (int i = ndim - 1; i >= 2; i--) {
+          int64_t coord = rest % index_shape[i];
+          rest /= index_shape[i];
+          off += (i == dim ? 0 : coord * data_stride[i]);
+        }
+        base[p - p0] = off;
+      }
+      for (int64_t c = 0; c < C; c++) {
+        const float * idx_c = idx + n * index_stride[0] + c * index_stride[1];
+        int64_t c_off = (dim == 1 ? 0 : c * data_stride[1]);
+        float * out = ans_NHWC + (n * spatial + p0) * C + c;
+        for (int64_t p = p0; p < p1; p++, out += C) {
+          int64_t g = (int64_t)idx_c[p];  // 与torch的to(kInt64)一致，向零截断
+          if (g < 0 || g >= gather_len) {
+            out_of_range = true;
+            return;
+          }
+          *out = src[base[p - p0] + c_off + g * data_stride[dim]];
+        }
+      }
+    }
+  };
+  int64_t tasks = N * tiles;
+  int64_t threads = std::max<int64_t>(1, std::min<int64_t>(std::thread::hardware_concurrency(), tasks));
+  std::vector<std::thread> workers;
+  for (int64_t t = 1; t < threads; t++) {
+    workers.emplace_back(run, tasks * t / threads, tasks * (t + 1) / threads);
+  }
+  run(0, tasks / threads);
+  for (auto & w : workers) {
+    w.join();
+  }
+  if (out_of_range) {
+    delete[] ans_NHWC;
+    throw " gather index is out of range! ";
+  }
+  return ans_NHWC;
+}
+
+#ifdef CHECK_GATHER_WITH_TORCH
+// libtorch实现，仅用于校验gather_cpu
+float * gather_torch(void * data, vector<int> &data_shape, void * index, vector<int> &index_shape, int dim, std::string fname, int num){
   at::Tensor gather_data, gather_index;
   assert(data != nullptr && index != nullptr);
   if (data_shape.size() == 5) {
@@ -100,346 +425,786 @@ float * gather_cpu(void * data, vector<int> &data_shape, void * index, vector<in
   return ans_NHWC;
 }
 
-myData output_align(std::string fname, int outputNum, int64_t* outputSizeS, cnrtDataType_t* output_data_type, cnrtFunction_t function, myData computeData){
-  auto start = std::chrono::high_resolution_clock::now();
-  std::string output_path = "./output_new/";
-  for(int i = 0; i < outputNum; i++){
-   if(((fname == "cfnet1.cambricon" || fname == "cfnet2.cambricon") && (i == 1 || i == 3 || i == 5 || i == 7)) || (fname == "cfnet3.cambricon")){  // 只有用于gather的输出才需要保存回主机端，分别对应索引是1, 3, 5, 7
-      // Step 1: copy data from MLU to CPU
-      void ** outPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * outputNum));
-      void * temp_output_cpu_data = (void*)malloc(outputSizeS[i]);
-      cnrtMemcpy(temp_output_cpu_data, computeData.outputMluPtrS[i], outputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2HOST);
-      // Step 2: cast cpu_data type to CNRT_FLOAT32
-      int output_count = outputSizeS[i] / cnrtDataTypeSize(output_data_type[i]);
-      computeData.outputCpuPtrS[i] = reinterpret_cast<void*>(reinterpret_cast<float*>(malloc(sizeof(float) * output_count)));
-      if (output_data_type[i] != CNRT_FLOAT32) {
-        cnrtCastDataType(temp_output_cpu_data, output_data_type[i], computeData.outputCpuPtrS[i], CNRT_FLOAT32, output_count, nullptr);
-      } else {
-        memcpy(computeData.outputCpuPtrS[i], temp_output_cpu_data, outputSizeS[i]);
-      }
-      if (fname == "cfnet3.cambricon") {  // cfnet3唯一一个输出是4维
-        // Step 3: trans data order from NHWC to NCHW
-        outPtrS[i] = reinterpret_cast<void*>(reinterpret_cast<float*>(malloc(sizeof(float) * output_count)));
-        std::vector<int> shape_for_output_cast(4, 1);  // 1,3,5,7全部是维度为5的输出
-        int dimNum_for_output_cast = 4;
-        cnrtGetOutputDataShape((int**)&shape_for_output_cast, &dimNum_for_output_cast, i, function);
-        // std::cout << " " + fname + "_outputdata " << i << " NHWC shape is: " << shape_for_output_cast[0] << " " << 
-        //     shape_for_output_cast[1] << " " << shape_for_output_cast[2] << " " << shape_for_output_cast[3] << std::endl;
-        int dim_order_for_output_cast[4] = {0, 3, 1, 2};
-        int dim_shape_for_output_cast[4] = {shape_for_output_cast[0], shape_for_output_cast[1], shape_for_output_cast[2], shape_for_output_cast[3]};  // NHWC
-        cnrtRet_t ret = cnrtTransDataOrder(computeData.outputCpuPtrS[i], CNRT_FLOAT32, outPtrS[i], 4, dim_shape_for_output_cast, dim_order_for_output_cast);
-        // std::cout << " " << fname << " TransDataOrder End!" << std::endl;
-        // Step 4: save 4 datas to file
-        memcpy(computeData.outputCpuPtrS[i], outPtrS[i], sizeof(float) * output_count);
-        // writeData(reinterpret_cast<float*>(computeData.outputCpuPtrS[i]), output_count, output_path + fname + "_forward_output_" + std::to_string(i));
-      } else {
-        // Step 3: trans data order from NHWC to NCHW
-        outPtrS[i] = reinterpret_cast<void*>(reinterpret_cast<float*>(malloc(sizeof(float) * output_count)));
-        std::vector<int> shape_for_output_cast(5, 1);  // 1,3,5,7全部是维度为5的输出
-        int dimNum_for_output_cast = 5;
-        cnrtGetOutputDataShape((int**)&shape_for_output_cast, &dimNum_for_output_cast, i, function);
-        // std::cout << " " + fname + "_outputdata " << i << " NHWC shape is: " << shape_for_output_cast[0] << " " << 
-        //     shape_for_output_cast[1] << " " << shape_for_output_cast[2] << " " << shape_for_output_cast[3] << " " << shape_for_output_cast[4] << std::endl;
-        int dim_order_for_output_cast[4] = {3, 0, 1, 2};  // (1) 16 128 256 12 -> (1) 12 16 128 256 所以索引顺序为 3,0,1,2
-        int dim_shape_for_output_cast[4] = {shape_for_output_cast[1], shape_for_output_cast[2], shape_for_output_cast[3], shape_for_output_cast[4]};  // NHWC
-        auto start2 = std::chrono::high_resolution_clock::now();
-        cnrtRet_t ret = cnrtTransDataOrder(computeData.outputCpuPtrS[i], CNRT_FLOAT32, outPtrS[i], 4, dim_shape_for_output_cast, dim_order_for_output_cast);
-        auto end2 = std::chrono::high_resolution_clock::now();
-        auto duration2 = std::chrono::duration_cast<std::chrono::microseconds>(end2 - start2);
-        std::cout << " " << fname << " cnrtTransDataOrder time is: " << duration2.count() << "us. " << std::endl;
-        // std::cout << " " << fname << " TransDataOrder End!" << std::endl;
-        // Step 4: save 4 datas to file
-        memcpy(computeData.outputCpuPtrS[i], outPtrS[i], sizeof(float) * output_count);
-        // writeData(reinterpret_cast<float*>(computeData.outputCpuPtrS[i]), output_count, output_path + fname + "_forward_output_" + std::to_string(i));
-      }
-      free(outPtrS[i]);
-      free(temp_output_cpu_data);
-    }
-  }
-  auto end = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  std::cout << " " << fname << " output_align time is: " << duration.count() << "us. " << std::endl;
-
-  return computeData;
+
+// gather只搬运数据，与libtorch的结果应当逐元素相等
+const float kGatherTolerance = 1e-6f;
+
+// 比较gather_cpu与libtorch的结果，返回最大绝对误差，超过kGatherTolerance时抛出异常
+float check_gather(float * native, void * data, vector<int> &data_shape, void * index, vector<int> &index_shape, int dim, std::string fname, int num) {
+  float * expect = gather_torch(data, data_shape, index, index_shape, dim, fname, num);
+  int64_t count = 1;
+  for (auto d : index_shape) count *= d;
+  float max_diff = 0;
+  for (int64_t i = 0; i < count; i++) {
+    max_diff = std::max(max_diff, std::abs(native[i] - expect[i]));
+  }
+  delete[] expect;
+  std::cout << " " << fname << " gather" << num << " max diff with torch is: " << max_diff << std::endl;
+  if (!(max_diff <= kGatherTolerance)) {
+    throw " gather_cpu does not match torch! ";
+  }
+  return max_diff;
 }
+#endif
+
+// 子网之间的张量路由图，从json读入，例如fnet_route.json：
+//   {"subnets": [{"name": "cfnet1", "model": "cfnet1.cambricon",
+//                 "inputs": [{"index": 0, "from": "linspace", "start": 0, "stop": 255},
+//                            {"index": 3, "from": "file", "path": "./data_6_5/imgl_data.txt"}, ...],
+//                 "host_outputs": [1, 3, 5, 7],
+//                 "gathers": [{"data": 3, "index": 1, "dim": 4, "shape": [1, 12, 16, 128, 256]}, ...]},
+//                {"name": "cfnet2", "model": "cfnet2.cambricon",
+//                 "inputs": [{"index": 0, "from": "output", "subnet": "cfnet1", "output": 15},
+//                            {"index": 14, "from": "gather", "subnet": "cfnet1", "output": 0}, ...]}]}
+// 输入来源有四种：
+//   file     NCHW的数据，每帧转为NHWC并转换数据类型后拷到设备；二进制数据在绑定时映射一次，
+//            .bin不存在而同名.txt存在时退回每帧读入文本数据
+//   linspace [start, stop]的等差数列，常量，只在绑定时上传一次
+//   output   前面某个子网的设备端输出，数据类型和字节数一致时直接复用该内存，不再拷贝；
+//            否则元素个数一致时经主机转换数据类型
+//   gather   前面某个子网第output个gather的主机端结果（NHWC），转换数据类型后拷到设备
+// host_outputs为需要拷回主机并转换为float、NCHW的输出，gathers在这些输出上进行。
+// 子网按列出的顺序执行，只能引用排在前面的子网。
+struct InputRoute {
+  int index = -1;
+  std::string from;
+  std::string path;
+  float start = 0, stop = 0;
+  std::string subnet;
+  int output = -1;
+};
+
+struct GatherRoute {
+  int data = -1;
+  int index = -1;
+  int dim = 0;
+  std::vector<int> shape;
+};
 
-void** input_align(void** inputMluPtrS, std::string fname, void** this_input_mlu, void** this_input_mlu2, void** this_input_cpu, int inputNum, int64_t* inputSizeS, cnrtDataType_t* input_data_type, cnrtFunction_t function){
-  auto start = std::chrono::high_resolution_clock::now();
-  if(fname == "cfnet1.cambricon"){
-    void** inputCpuPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * inputNum));
-    void** tempPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * inputNum));
-    void* temp_input_cpu_data = nullptr;
-    for (int i = 0; i < inputNum; i++) {
-      int ip = inputSizeS[i] / cnrtDataTypeSize(input_data_type[i]); 
-      auto databuf = reinterpret_cast<float*>(malloc(sizeof(float) * ip)); 
-      switch(i) {
-        case 3: readData(databuf, ip, "./data_6_5/imgl_data.txt"); break;
-        case 4: readData(databuf, ip, "./data_6_5/imgR_data.txt"); break;
-        case 2: readData(databuf, ip, "./data_6_5/disp_sparse_data.txt"); break;
-        case 1: readData(databuf, ip, "./data_6_5/sparse_mask_data.txt"); break;
-        case 0: linspace(0.0, 255, 256, databuf); break;
-      }
-      inputCpuPtrS[i] = reinterpret_cast<void*>(databuf);  // NCHW
-    }
-    // 更换维度
-    for (int i = 0; i < inputNum; i++) {
-      int ip = inputSizeS[i] / cnrtDataTypeSize(input_data_type[i]);
-      tempPtrS[i] = reinterpret_cast<void*>(reinterpret_cast<float*>(malloc(sizeof(float) * ip)));
-      std::vector<int> shape(4, 1);
-      int dimNum = 4;
-      cnrtGetInputDataShape((int**)&shape, &dimNum, i, function); // NHWC
-      int dim_order[4] = {0, 2, 3, 1}; // 0 1 2 3-> NCHW  
-      int dim_shape[4] = {shape[0], shape[3], shape[1], shape[2]};  // NCHW-> NHWC
-      cnrtTransDataOrder(inputCpuPtrS[i], CNRT_FLOAT32, tempPtrS[i], 4, dim_shape, dim_order);
-      temp_input_cpu_data = (void*)malloc(inputSizeS[i]);
-      int input_count = inputSizeS[i] / cnrtDataTypeSize(input_data_type[i]);
-      if (input_data_type[i] != CNRT_FLOAT32) {
-        cnrtCastDataType(tempPtrS[i], CNRT_FLOAT32, temp_input_cpu_data, input_data_type[i], input_count, nullptr);
+struct SubnetRoute {
+  std::string name;
+  std::string model;
+  std::vector<InputRoute> inputs;
+  std::vector<int> host_outputs;
+  std::vector<GatherRoute> gathers;
+};
+
+std::vector<SubnetRoute> LoadRouteGraph(std::string filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw " can not open route graph file! ";
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  std::string err;
+  json11::Json root = json11::Json::parse(ss.str(), err);
+  if (!err.empty() || !root["subnets"].is_array()) {
+    std::cout << " Parse " << filename << " failed: " << err << std::endl;
+    throw " route graph is not valid json with subnets array! ";
+  }
+  std::vector<SubnetRoute> graph;
+  for (auto &e_ : root["subnets"].array_items()) {
+    SubnetRoute subnet;
+    subnet.name = e_["name"].string_value();
+    subnet.model = e_["model"].string_value();
+    for (auto &in : e_["inputs"].array_items()) {
+      InputRoute route;
+      route.index = in["index"].int_value();
+      route.from = in["from"].string_value();
+      route.path = in["path"].string_value();
+      route.start = in["start"].number_value();
+      route.stop = in["stop"].number_value();
+      route.subnet = in["subnet"].string_value();
+      route.output = in["output"].is_null() ? -1 : in["output"].int_value();
+      if (route.from != "file" && route.from != "linspace" && route.from != "output" && route.from != "gather") {
+        std::cout << " " << subnet.name << " input " << route.index << " has unknown source: " << route.from << std::endl;
+        throw " unknown input source in route graph! ";
+      }
+      subnet.inputs.push_back(route);
+    }
+    for (auto &out : e_["host_outputs"].array_items()) {
+      subnet.host_outputs.push_back(out.int_value());
+    }
+    for (auto &g : e_["gathers"].array_items()) {
+      GatherRoute gather;
+      gather.data = g["data"].int_value();
+      gather.index = g["index"].int_value();
+      gather.dim = g["dim"].int_value();
+      for (auto &d : g["shape"].array_items()) {
+        gather.shape.push_back(d.int_value());
+      }
+      subnet.gathers.push_back(gather);
+    }
+    if (subnet.name.empty() || subnet.model.empty()) {
+      throw " subnet in route graph needs name and model! ";
+    }
+    graph.push_back(subnet);
+  }
+  return graph;
+}
+
+// 子网络的持久会话：模型、函数、运行时上下文、队列和输入输出内存只在构造时创建一次，
+// Bind()按路由图确定每个输入的来源，之后每帧依次调用Upload()、Invoke()、Download()和Gather()，
+// 析构时统一释放。
+// 输入输出内存按slots份分配（流水线深度），不同槽位互不覆盖，可以被不同帧同时使用；
+// 复用上游输出的输入与上游使用同一槽位的内存，同一帧内上游槽位不会被覆盖
+class SubnetSession {
+ public:
+  SubnetSession(const SubnetRoute &route, int Dev_use, int slots = 1)
+      : route_(route), fname_(route.model), slots_(slots) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string name = (std::string)"subnet0";
+    cnrtRet_t ret = cnrtLoadModel(&model_, fname_.c_str());
+    CheckCnrt(ret, "cnrtLoadModel " + fname_);
+    cnrtCreateFunction(&function_);
+    ret = cnrtExtractFunction(&function_, model_, name.c_str());
+    CheckCnrt(ret, "cnrtExtractFunction " + name + " of " + fname_);
+    cnrtCreateRuntimeContext(&rt_ctx_, function_, NULL);
+    cnrtCreateQueue(&cnrt_queue_);
+    cnrtSetRuntimeContextDeviceId(rt_ctx_, Dev_use);
+    ret = cnrtInitRuntimeContext(rt_ctx_, NULL);
+    CheckCnrt(ret, "cnrtInitRuntimeContext of " + fname_);
+
+    // get network settings
+    cnrtGetInputDataSize(&inputSizeS_, &inputNum_, function_);
+    cnrtGetOutputDataSize(&outputSizeS_, &outputNum_, function_);
+    cnrtGetInputDataType(&input_data_type_, &inputNum_, function_);
+    cnrtGetOutputDataType(&output_data_type_, &outputNum_, function_);
+    cnrtCreateNotifier(&notifierBeginning_);
+    cnrtCreateNotifier(&notifierEnd_);
+
+    // 输出内存在这里分配，输入内存在Bind()中按来源决定是否分配；
+    // param_[s]前inputNum_个为输入，后outputNum_个为输出
+    param_.resize(slots_);
+    computeData_.resize(slots_);
+    gather_out_.assign(slots_, std::vector<float*>(route_.gathers.size(), nullptr));
+    for (int s = 0; s < slots_; s++) {
+      param_[s] = reinterpret_cast<void**>(calloc(inputNum_ + outputNum_, sizeof(void*)));
+      computeData_[s].outputMluPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * outputNum_));
+      computeData_[s].outputCpuPtrS = reinterpret_cast<void**>(calloc(outputNum_, sizeof(void*)));
+      for (int i = 0; i < outputNum_; i++) {
+        cnrtMalloc(&computeData_[s].outputMluPtrS[i], outputSizeS_[i]);
+        param_[s][inputNum_ + i] = computeData_[s].outputMluPtrS[i];
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    setup_us_ = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    std::cout << " " << fname_ << " setup time is: " << setup_us_ << "us. " << std::endl;
+  }
+
+  ~SubnetSession() {
+    for (int s = 0; s < slots_; s++) {
+      for (int i = 0; i < inputNum_; i++) {
+        if (i < (int)owned_.size() && owned_[i]) {
+          cnrtFree(param_[s][i]);
+        }
+      }
+      for (int i = 0; i < outputNum_; i++) {
+        cnrtFree(computeData_[s].outputMluPtrS[i]);
+        free(computeData_[s].outputCpuPtrS[i]);
+      }
+      for (auto e_ : gather_out_[s]) {
+        delete[] e_;
+      }
+      free(computeData_[s].outputMluPtrS);
+      free(computeData_[s].outputCpuPtrS);
+      free(param_[s]);
+    }
+    cnrtDestroyNotifier(&notifierBeginning_);
+    cnrtDestroyNotifier(&notifierEnd_);
+    cnrtDestroyRuntimeContext(rt_ctx_);
+    cnrtDestroyQueue(cnrt_queue_);
+    cnrtUnloadModel(model_);
+    cnrtDestroyFunction(function_);
+  }
+
+  // 按路由图绑定每个输入，producers为排在前面、已经绑定好的子网
+  void Bind(const std::map<std::string, SubnetSession*> &producers) {
+    routes_.assign(inputNum_, Binding());
+    owned_.assign(inputNum_, false);
+    for (auto &e_ : route_.inputs) {
+      if (e_.index < 0 || e_.index >= inputNum_ || routes_[e_.index].route) {
+        std::cout << " " << route_.name << " input " << e_.index << " is out of range or routed twice. " << std::endl;
+        throw " invalid input index in route graph! ";
+      }
+      Binding &b = routes_[e_.index];
+      b.route = &e_;
+      if (e_.from == "output" || e_.from == "gather") {
+        auto it = producers.find(e_.subnet);
+        if (it == producers.end()) {
+          std::cout << " " << route_.name << " input " << e_.index << " refers to unknown or later subnet "
+                    << e_.subnet << std::endl;
+          throw " unknown producer in route graph! ";
+        }
+        b.producer = it->second;
+        int limit = e_.from == "output" ? b.producer->outputNum_ : (int)b.producer->route_.gathers.size();
+        if (e_.output < 0 || e_.output >= limit) {
+          std::cout << " " << route_.name << " input " << e_.index << " refers to " << e_.subnet << " "
+                    << e_.from << " " << e_.output << " which does not exist. " << std::endl;
+          throw " invalid producer index in route graph! ";
+        }
+      }
+      if (e_.from == "output") {
+        b.mode = ResolveOutputMode(e_.index, *b.producer, e_.output);
+      }
+    }
+    int aliased = 0, converted = 0;
+    for (int i = 0; i < inputNum_; i++) {
+      Binding &b = routes_[i];
+      if (!b.route) {
+        std::cout << " " << route_.name << " input " << i << " has no source in route graph. " << std::endl;
+        throw " unrouted input in route graph! ";
+      }
+      if (b.mode == kAlias) {
+        // 直接使用上游同一槽位的输出内存
+        for (int s = 0; s < slots_; s++) {
+          param_[s][i] = b.producer->computeData_[s].outputMluPtrS[b.route->output];
+        }
+        aliased++;
+        continue;
+      }
+      owned_[i] = true;
+      for (int s = 0; s < slots_; s++) {
+        cnrtMalloc(&param_[s][i], inputSizeS_[i]);
+      }
+      if (b.mode == kConvert) {
+        converted++;
+      }
+      if (b.route->from == "file") {
+        // 二进制数据只在绑定时映射一次，之后每帧直接从映射的内存转置；文本数据每帧读入
+        b.path = ResolveDataPath(b.route->path);
+        if (!IsTextData(b.path)) {
+          int count = inputSizeS_[i] / cnrtDataTypeSize(input_data_type_[i]);
+          b.mapped = std::make_shared<MappedData>(b.path);
+          if (b.mapped->size() != count) {
+            std::cout << " " << b.path << " has " << b.mapped->size() << " floats, " << route_.name << " input " << i
+                      << " needs " << count << ". " << std::endl;
+            throw " binary data size does not match input! ";
+          }
+        }
+      } else if (b.route->from == "linspace") {
+        // 常量只上传一次
+        int count = inputSizeS_[i] / cnrtDataTypeSize(input_data_type_[i]);
+        std::vector<float> databuf(count);
+        linspace(b.route->start, b.route->stop, count, databuf.data());
+        for (int s = 0; s < slots_; s++) {
+          UploadFloat(i, s, databuf.data(), count);
+        }
+      }
+    }
+    std::cout << " " << route_.name << " inputs bound: " << aliased << " aliased, " << converted << " converted on host. " << std::endl;
+  }
+
+  // 主机到设备：每帧变化的输入（file、gather和不能复用的output）拷到slot槽位
+  void Upload(int slot) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < inputNum_; i++) {
+      const Binding &b = routes_[i];
+      int count = inputSizeS_[i] / cnrtDataTypeSize(input_data_type_[i]);
+      if (b.route->from == "file") {
+        // 文件数据是NCHW，设备上是NHWC；二进制文件直接从绑定时映射的内存转置，不再拷贝
+        std::vector<float> nchw, nhwc(count);
+        const float * src = nullptr;
+        if (b.mapped) {
+          src = b.mapped->data();
+        } else {
+          nchw.resize(count);
+          readData(nchw.data(), count, b.path);
+          src = nchw.data();
+        }
+        std::vector<int> shape = InputShape(i);  // NHWC
+        if (shape.size() != 4) {
+          throw " file input must be 4 dims! ";
+        }
+        // NCHW -> NHWC，分块转置
+        ChannelTranspose(src, nhwc.data(), shape[0], shape[3], (int64_t)shape[1] * shape[2]);
+        UploadFloat(i, slot, nhwc.data(), count);
+      } else if (b.route->from == "gather") {
+        UploadFloat(i, slot, b.producer->gather_out_[slot][b.route->output], count);
+      } else if (b.mode == kConvert) {
+        int output = b.route->output;
+        std::vector<char> src(b.producer->outputSizeS_[output]), dst(inputSizeS_[i]);
+        cnrtMemcpy(src.data(), b.producer->computeData_[slot].outputMluPtrS[output], src.size(),
+                   CNRT_MEM_TRANS_DIR_DEV2HOST);
+        cnrtCastDataType(src.data(), b.producer->output_data_type_[output], dst.data(), input_data_type_[i], count, nullptr);
+        cnrtMemcpy(param_[slot][i], dst.data(), dst.size(), CNRT_MEM_TRANS_DIR_HOST2DEV);
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << " " << fname_ << " input_align time is: " << duration.count() << "us. " << std::endl;
+  }
+
+  // 设备上推理slot槽位，只由设备阶段的线程调用
+  void Invoke(int slot) {
+    float event_time_use;
+    auto start = std::chrono::high_resolution_clock::now();
+    cnrtPlaceNotifier(notifierBeginning_, cnrt_queue_);
+    CNRT_CHECK(cnrtInvokeRuntimeContext(rt_ctx_, param_[slot], cnrt_queue_, nullptr));
+    cnrtPlaceNotifier(notifierEnd_, cnrt_queue_);
+    cnrtRet_t ret = cnrtSyncQueue(cnrt_queue_);
+    CheckCnrt(ret, "cnrtSyncQueue of " + fname_);
+    cnrtNotifierDuration(notifierBeginning_, notifierEnd_, &event_time_use);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << " " << fname_ << " forward time is: " << duration.count() << "us. " << std::endl;
+  }
+
+  // 设备到主机：host_outputs拷回主机，转换为float，并从NHWC转为NCHW
+  void Download(int slot) {
+    auto start = std::chrono::high_resolution_clock::now();
+    myData &computeData = computeData_[slot];
+    for (int i : route_.host_outputs) {
+      int count = outputSizeS_[i] / cnrtDataTypeSize(output_data_type_[i]);
+      std::vector<int> shape = OutputShape(i);
+      // NHWC -> NCHW即[N, HW, C]逐batch转置为[N, C, HW]；5维且N = 1时(1) D H W C -> (1) C D H W，同样处理
+      int64_t batch = 0, spatial = 1;
+      if (shape.size() == 4) {
+        batch = shape[0];
+      } else if (shape.size() == 5 && shape[0] == 1) {
+        batch = 1;
       } else {
-        temp_input_cpu_data = tempPtrS[i];
-      }
-      cnrtMemcpy(inputMluPtrS[i], temp_input_cpu_data, inputSizeS[i], CNRT_MEM_TRANS_DIR_HOST2DEV);
-      if (temp_input_cpu_data) {
-        free(temp_input_cpu_data);
-        temp_input_cpu_data = nullptr;
-      }
-    }
-    free(inputCpuPtrS);
-    free(tempPtrS);
-  } else if (fname == "cfnet2.cambricon") {
-    void* temp_input_cpu_data = nullptr;
-    for (int i = 0; i < 2; i++) {  // handle cpu data from gather
-	    int j = -1;
-	    if (i == 0) j = 14;  // TODO modify index
-	    else if (i == 1) j = 12;  // TODO modify index
-      temp_input_cpu_data = (void*)malloc(inputSizeS[j]);
-      int input_count = inputSizeS[j] / cnrtDataTypeSize(input_data_type[j]);
-      if (input_data_type[j] != CNRT_FLOAT32)
-        cnrtCastDataType(this_input_cpu[i], CNRT_FLOAT32, temp_input_cpu_data, input_data_type[j], input_count, nullptr);
-      else
-        temp_input_cpu_data = this_input_cpu[i];
-	    // this_input_cpu[i] = temp_input_cpu_data;  错误写法
-	    cnrtMemcpy(inputMluPtrS[j], temp_input_cpu_data, inputSizeS[j], CNRT_MEM_TRANS_DIR_HOST2DEV);
-    }
-    if (temp_input_cpu_data) {
-      free(temp_input_cpu_data);
-      temp_input_cpu_data = nullptr;
-    }
-    
-    for (int i = 0; i < inputNum; i++) {
-      switch(i) {
-        case 0: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[15], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 1: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[14], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 2:
-        {
-          int lin_ip = inputSizeS[i] / cnrtDataTypeSize(input_data_type[i]);
-          assert(lin_ip == 512);
-          auto databuf = reinterpret_cast<float*>(malloc(sizeof(float) * lin_ip));
-          linspace(0.0, 511, 512, databuf);
-          void * templin = reinterpret_cast<void*>(databuf);
-          void * temp_lin_cpu_data = (void*)malloc(inputSizeS[i]);
-          if (input_data_type[i] != CNRT_FLOAT32)
-            cnrtCastDataType(templin, CNRT_FLOAT32, temp_lin_cpu_data, input_data_type[i], lin_ip, nullptr);
-          else
-            temp_lin_cpu_data = templin;
-          free(templin);
-          cnrtMemcpy(inputMluPtrS[i], temp_lin_cpu_data, inputSizeS[i], CNRT_MEM_TRANS_DIR_HOST2DEV);
-          free(temp_lin_cpu_data);
+        std::cout << " " << fname_ << " output " << i << " has " << shape.size() << " dims. " << std::endl;
+        throw " host output must be 4 dims or 5 dims with N = 1! ";
+      }
+      for (size_t d = 1; d + 1 < shape.size(); d++) {
+        spatial *= shape[d];
+      }
+      std::vector<char> temp_output_cpu_data(outputSizeS_[i]);
+      cnrtMemcpy(temp_output_cpu_data.data(), computeData.outputMluPtrS[i], outputSizeS_[i], CNRT_MEM_TRANS_DIR_DEV2HOST);
+      if (computeData.outputCpuPtrS[i] == nullptr) {  // 会话中保留，后续帧复用
+        computeData.outputCpuPtrS[i] = malloc(sizeof(float) * count);
+      }
+      // 从拷回的内存直接转置，同时转为float
+      CastTranspose(temp_output_cpu_data.data(), output_data_type_[i], reinterpret_cast<float*>(computeData.outputCpuPtrS[i]),
+                    batch, spatial, (int64_t)shape.back());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << " " << fname_ << " output_align time is: " << duration.count() << "us. " << std::endl;
+  }
+
+  // 主机上的gather，结果保留在slot槽位直到该槽位下一帧的Gather()
+  void Gather(int slot) {
+    myData computeData = computeData_[slot];
+    for (size_t g = 0; g < route_.gathers.size(); g++) {
+      const GatherRoute &e_ = route_.gathers[g];
+      vector<int> shape = e_.shape;
+      delete[] gather_out_[slot][g];
+      // 入参的g + 1代表第几个gather用于命名，无实际含义
+      gather_out_[slot][g] = gather_cpu(computeData.outputCpuPtrS[e_.data], shape, computeData.outputCpuPtrS[e_.index],
+                                        shape, e_.dim, fname_, g + 1);
+#ifdef CHECK_GATHER_WITH_TORCH
+      check_gather(gather_out_[slot][g], computeData.outputCpuPtrS[e_.data], shape, computeData.outputCpuPtrS[e_.index],
+                   shape, e_.dim, fname_, g + 1);
+#endif
+    }
+  }
+
+  // 返回的输出内存归会话所有，同一槽位下一次Invoke/Download会覆盖
+  myData Output(int slot) const { return computeData_[slot]; }
+
+  const SubnetRoute &Route() const { return route_; }
+
+  int64_t SetupMicros() const { return setup_us_; }
+
+ private:
+  SubnetSession(const SubnetSession &) = delete;
+  SubnetSession &operator=(const SubnetSession &) = delete;
+
+  enum Mode { kUpload = 0, kAlias, kConvert };
+  struct Binding {
+    const InputRoute * route = nullptr;
+    SubnetSession * producer = nullptr;
+    Mode mode = kUpload;
+    // file输入实际读取的路径，以及二进制数据的映射
+    std::string path;
+    std::shared_ptr<MappedData> mapped;
+  };
+
+  static std::vector<int> Shape(int * dims, int dim_num) {
+    std::vector<int> shape(dims, dims + dim_num);
+    free(dims);
+    return shape;
+  }
+  std::vector<int> InputShape(int i) const {
+    int * dims = nullptr;
+    int dim_num = 0;
+    cnrtGetInputDataShape(&dims, &dim_num, i, function_);
+    return Shape(dims, dim_num);
+  }
+  std::vector<int> OutputShape(int i) const {
+    int * dims = nullptr;
+    int dim_num = 0;
+    cnrtGetOutputDataShape(&dims, &dim_num, i, function_);
+    return Shape(dims, dim_num);
+  }
+
+  // 数据类型和字节数一致时直接复用（形状不同也只是按同样的字节重新解释，拷贝一份结果相同），否则在主机上转换
+  Mode ResolveOutputMode(int input, const SubnetSession &producer, int output) const {
+    cnrtDataType_t in_type = input_data_type_[input], out_type = producer.output_data_type_[output];
+    if (in_type == out_type && inputSizeS_[input] == producer.outputSizeS_[output]) {
+      return kAlias;
+    }
+    if (inputSizeS_[input] / cnrtDataTypeSize(in_type) == producer.outputSizeS_[output] / cnrtDataTypeSize(out_type)) {
+      return kConvert;
+    }
+    std::cout << " " << route_.name << " input " << input << " and " << producer.route_.name << " output " << output
+              << " have different element count. " << std::endl;
+    throw " routed tensors do not match! ";
+  }
+
+  void UploadFloat(int i, int slot, float * data, int count) {
+    if (input_data_type_[i] != CNRT_FLOAT32) {
+      std::vector<char> temp_input_cpu_data(inputSizeS_[i]);
+      cnrtCastDataType(data, CNRT_FLOAT32, temp_input_cpu_data.data(), input_data_type_[i], count, nullptr);
+      cnrtMemcpy(param_[slot][i], temp_input_cpu_data.data(), inputSizeS_[i], CNRT_MEM_TRANS_DIR_HOST2DEV);
+    } else {
+      cnrtMemcpy(param_[slot][i], data, inputSizeS_[i], CNRT_MEM_TRANS_DIR_HOST2DEV);
+    }
+  }
+
+  SubnetRoute route_;
+  std::string fname_;
+  int slots_ = 1;
+  cnrtModel_t model_;
+  cnrtFunction_t function_;
+  cnrtRuntimeContext_t rt_ctx_;
+  cnrtQueue_t cnrt_queue_;
+  cnrtNotifier_t notifierBeginning_, notifierEnd_;
+  int inputNum_ = 0, outputNum_ = 0;
+  int64_t* inputSizeS_ = nullptr;
+  int64_t* outputSizeS_ = nullptr;
+  cnrtDataType_t* input_data_type_ = nullptr;
+  cnrtDataType_t* output_data_type_ = nullptr;
+  std::vector<void**> param_;
+  std::vector<Binding> routes_;
+  std::vector<bool> owned_;
+  std::vector<myData> computeData_;
+  std::vector<std::vector<float*>> gather_out_;
+  int64_t setup_us_ = 0;
+};
+
+// 帧流水线执行器：H2D、设备子网、D2H、主机gather四个阶段各有一个工作线程和一个任务队列。
+// 每帧是一串步骤，一个步骤完成后投递到下一个步骤所属阶段的队列，因此第N帧的gather可以和
+// 第N+1帧的cfnet1同时执行。
+// 同时在途的帧数不超过depth，帧使用的中间缓冲按 frame % depth 选择槽位（depth为2即双缓冲）。
+// 各阶段队列先进先出，帧按进入顺序完成，所以第N帧进入时第N-depth帧一定已经结束，槽位不会冲突；
+// 每个队列中的任务也不会超过depth个。
+class FramePipeline {
+ public:
+  enum Stage { kH2D = 0, kDevice, kD2H, kGather, kStageNum };
+  typedef std::function<void(int frame, int slot)> StepFunc;
+
+  // thread_init在每个阶段线程开始时调用，例如绑定设备
+  explicit FramePipeline(int depth, std::function<void()> thread_init = nullptr)
+      : depth_(depth > 0 ? depth : 1), thread_init_(thread_init) {}
+
+  void AddStep(Stage stage, std::string name, StepFunc func) {
+    steps_.push_back(Step{stage, name, func});
+  }
+
+  // 依次送入frames帧，阻塞到全部完成；任一步骤抛出异常时停止所有队列，线程结束后在这里重新抛出第一个异常
+  void Run(int frames) {
+    assert(!steps_.empty());
+    begin_ = Clock::now();
+    in_flight_ = 0;
+    done_ = 0;
+    error_ = nullptr;
+    frame_start_.assign(frames, begin_);
+    frame_us_.assign(frames, 0);
+    stats_.assign(steps_.size(), StepStat());
+    for (int s = 0; s < kStageNum; s++) {
+      queues_[s].stop = false;
+      workers_[s] = std::thread(&FramePipeline::Work, this, s);
+    }
+    for (int f = 0; f < frames; f++) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return in_flight_ < depth_ || error_; });
+        if (error_) {
           break;
         }
-        case 3: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[13], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 4: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[12], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 5: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[11], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 6: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[10], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 7: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[9], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 8: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[8], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 9: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[6], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 10: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[2], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 11: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[4], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 12: break;
-        case 13: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[0], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 14: break;
+        in_flight_++;
+        frame_start_[f] = Clock::now();
       }
+      Push(Task{f, 0, Clock::now()});
     }
-  } else {
-    void* temp_input_cpu_data = nullptr;
-    for (int i = 0; i < 2; i++) {  // handle cpu data from gather
-	    int j = -1;
-	    if (i == 0) j = 9;  // TODO modify index
-	    else if (i == 1) j = 7;  // TODO modify index
-      temp_input_cpu_data = (void*)malloc(inputSizeS[j]);
-      int input_count = inputSizeS[j] / cnrtDataTypeSize(input_data_type[j]);
-      if (input_data_type[j] != CNRT_FLOAT32)
-        cnrtCastDataType(this_input_cpu[i], CNRT_FLOAT32, temp_input_cpu_data, input_data_type[j], input_count, nullptr);
-      else
-        temp_input_cpu_data = this_input_cpu[i];
-	    // this_input_cpu[i] = temp_input_cpu_data;  错误写法
-	    cnrtMemcpy(inputMluPtrS[j], temp_input_cpu_data, inputSizeS[j], CNRT_MEM_TRANS_DIR_HOST2DEV);
-    }
-    if (temp_input_cpu_data) {
-      free(temp_input_cpu_data);
-      temp_input_cpu_data = nullptr;
-    }
-    
-    for (int i = 0; i < inputNum; i++) {
-      switch(i) {
-        // this_input_mlu2保存cfnet1的未使用输出
-        case 0: cnrtMemcpy(inputMluPtrS[i], this_input_mlu2[17], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 1: cnrtMemcpy(inputMluPtrS[i], this_input_mlu2[18], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 2: cnrtMemcpy(inputMluPtrS[i], this_input_mlu2[16], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 3: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[8], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 4: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[6], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 5: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[2], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 6: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[4], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 7: break;
-        case 8: cnrtMemcpy(inputMluPtrS[i], this_input_mlu[0], inputSizeS[i], CNRT_MEM_TRANS_DIR_DEV2DEV); break;
-        case 9: break;
-      }
-    }
-  }
-  auto end = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  std::cout << " " << fname << " input_align time is: " << duration.count() << "us. " << std::endl;
-
-  return inputMluPtrS;
-}
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_cv_.wait(lock, [this, frames] { return done_ == frames || error_; });
+    }
+    Stop();
+    for (int s = 0; s < kStageNum; s++) {
+      workers_[s].join();
+    }
+    wall_us_ = Micros(begin_, Clock::now());
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
 
-// void ** forward(std::string fname, int Dev_use, void ** this_input_mlu, void ** this_input_cpu){
-myData forward(std::string fname, int Dev_use, void ** this_input_mlu, void ** this_input_mlu2, void ** this_input_cpu){
-  // begin function
-  std::string name = (std::string)"subnet0";
-  cnrtModel_t model;
-  cnrtLoadModel(&model, fname.c_str());
-  cnrtFunction_t function;
-  cnrtRuntimeContext_t rt_ctx_;
-  cnrtCreateFunction(&function);
-  assert(cnrtExtractFunction(&function, model, name.c_str())==CNRT_RET_SUCCESS);
-  cnrtCreateRuntimeContext(&rt_ctx_, function, NULL);
-  cnrtQueue_t cnrt_queue;
-  cnrtCreateQueue(&cnrt_queue);
-  cnrtSetRuntimeContextDeviceId(rt_ctx_, Dev_use);
-  cnrtInitRuntimeContext(rt_ctx_, NULL);
-
-  // get network settings
-  int inputNum, outputNum;
-  int64_t* inputSizeS = nullptr;
-  int64_t* outputSizeS = nullptr;
-  cnrtGetInputDataSize(&inputSizeS, &inputNum, function);
-  cnrtGetOutputDataSize(&outputSizeS, &outputNum, function);
-  cnrtDataType_t* input_data_type = nullptr;
-  cnrtDataType_t* output_data_type = nullptr;
-  cnrtGetInputDataType(&input_data_type, &inputNum, function);
-  cnrtGetOutputDataType(&output_data_type, &outputNum, function);
-  cnrtNotifier_t notifierBeginning, notifierEnd;
-  cnrtCreateNotifier(&notifierBeginning);
-  cnrtCreateNotifier(&notifierEnd);
-  float event_time_use;
-
-  // get buffer
-  void** param = reinterpret_cast<void**>(malloc(sizeof(void*) * (inputNum + outputNum)));
-  void** inputMluPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * inputNum));
-  // void** outputMluPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * outputNum));
-  struct myData computeData{};  // 实例化结构体
-  computeData.outputMluPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * outputNum));
-  computeData.outputCpuPtrS = reinterpret_cast<void**>(malloc(sizeof(void*) * outputNum));
-  for (int i = 0; i < inputNum; i++) {
-    cnrtMalloc(&inputMluPtrS[i], inputSizeS[i]);
-    param[i] = inputMluPtrS[i];  // 赋相同地址
-  }
-  for (int i = 0; i < outputNum; i++) {
-    cnrtMalloc(&computeData.outputMluPtrS[i], outputSizeS[i]);
-    param[inputNum + i] = computeData.outputMluPtrS[i];
-  }
-  // param -> inputMluPtrS -> this_input_mlu
-  // get input data
-  // 此处尽管把真实地input data存到了inputMluPtrs中，但因为param[i]和inputMluPtrS[i]指向同一块内存区域，实际上param也可以访问到这些input data
-  inputMluPtrS = input_align(inputMluPtrS, fname, this_input_mlu, this_input_mlu2, this_input_cpu, inputNum, inputSizeS, input_data_type, function);
-
-  // run MLU
-  auto start = std::chrono::high_resolution_clock::now();
-  cnrtPlaceNotifier(notifierBeginning, cnrt_queue);
-  CNRT_CHECK(cnrtInvokeRuntimeContext(rt_ctx_, param, cnrt_queue, nullptr));
-  cnrtPlaceNotifier(notifierEnd, cnrt_queue);
-  assert(cnrtSyncQueue(cnrt_queue) == CNRT_RET_SUCCESS);
-  cnrtNotifierDuration(notifierBeginning, notifierEnd, &event_time_use);
-  auto end = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  std::cout << " " << fname << " forward time is: " << duration.count() << "us. " << std::endl;
-
-  for (int i = 0; i < inputNum; i++) {
-    cnrtFree(inputMluPtrS[i]);
-  }
-
-  computeData = output_align(fname, outputNum, outputSizeS, output_data_type, function, computeData);
-  
-  cnrtDestroyNotifier(&notifierBeginning);
-  cnrtDestroyNotifier(&notifierEnd);
-  cnrtDestroyRuntimeContext(rt_ctx_);
-  cnrtDestroyQueue(cnrt_queue);
-  cnrtUnloadModel(model);
-  cnrtDestroyFunction(function);
-  
-  return computeData;
+  // 每个步骤的平均执行和排队时间、每个阶段的忙碌比例，以及帧延迟和吞吐
+  void Report() const {
+    static const char * stage_names[kStageNum] = {"H2D", "Device", "D2H", "Gather"};
+    int frames = frame_us_.size();
+    std::cout << " Pipeline depth " << depth_ << ", " << frames << " frames in " << wall_us_ << "us, throughput "
+              << (wall_us_ ? frames * 1e6 / wall_us_ : 0.0) << " fps. " << std::endl;
+    for (size_t i = 0; i < steps_.size(); i++) {
+      const StepStat &st = stats_[i];
+      std::cout << "   [" << stage_names[steps_[i].stage] << "] " << steps_[i].name << ": mean " << st.busy_us / std::max(st.count, 1)
+                << "us, max " << st.max_us << "us, mean wait " << st.wait_us / std::max(st.count, 1) << "us. " << std::endl;
+    }
+    for (int s = 0; s < kStageNum; s++) {
+      int64_t busy = 0;
+      int count = 0;
+      for (size_t i = 0; i < steps_.size(); i++) {
+        if (steps_[i].stage == s) {
+          busy += stats_[i].busy_us;
+          count += stats_[i].count;
+        }
+      }
+      std::cout << "   Stage " << stage_names[s] << ": " << count << " tasks, busy " << busy << "us ("
+                << (wall_us_ ? 100.0 * busy / wall_us_ : 0.0) << "%), " << (wall_us_ ? count * 1e6 / wall_us_ : 0.0)
+                << " tasks/s. " << std::endl;
+    }
+    if (frames > 0) {
+      int64_t sum = 0, max = 0;
+      for (auto us : frame_us_) {
+        sum += us;
+        max = std::max(max, us);
+      }
+      std::cout << "   Frame latency: first " << frame_us_[0] << "us, mean " << sum / frames << "us, max " << max
+                << "us. " << std::endl;
+    }
+  }
+
+  int64_t WallMicros() const { return wall_us_; }
+
+ private:
+  typedef std::chrono::high_resolution_clock Clock;
+  struct Step {
+    Stage stage;
+    std::string name;
+    StepFunc func;
+  };
+  struct Task {
+    int frame;
+    size_t step;
+    Clock::time_point queued;
+  };
+  struct StageQueue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> tasks;
+    bool stop = false;
+  };
+  struct StepStat {
+    int count = 0;
+    int64_t busy_us = 0;
+    int64_t wait_us = 0;
+    int64_t max_us = 0;
+  };
+
+  static int64_t Micros(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  }
+
+  void Push(const Task &task) {
+    StageQueue &queue = queues_[steps_[task.step].stage];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      // 出错后不再接收新任务
+      if (queue.stop) {
+        return;
+      }
+      queue.tasks.push_back(task);
+    }
+    queue.cv.notify_one();
+  }
+
+  // 停止所有队列并丢弃未执行的任务，各阶段线程执行完手头的任务后退出
+  void Stop() {
+    for (int s = 0; s < kStageNum; s++) {
+      {
+        std::lock_guard<std::mutex> lock(queues_[s].mutex);
+        queues_[s].stop = true;
+        queues_[s].tasks.clear();
+      }
+      queues_[s].cv.notify_all();
+    }
+  }
+
+  // 记录第一个异常并唤醒Run
+  void Fail() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+    Stop();
+    done_cv_.notify_all();
+  }
+
+  void Work(int stage) {
+    if (thread_init_) {
+      try {
+        thread_init_();
+      } catch (...) {
+        Fail();
+        return;
+      }
+    }
+    StageQueue &queue = queues_[stage];
+    while (true) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.cv.wait(lock, [&queue] { return queue.stop || !queue.tasks.empty(); });
+        if (queue.tasks.empty()) {
+          return;
+        }
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      auto start = Clock::now();
+      try {
+        steps_[task.step].func(task.frame, task.frame % depth_);
+      } catch (...) {
+        Fail();
+        return;
+      }
+      auto end = Clock::now();
+      bool last = task.step + 1 == steps_.size();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StepStat &st = stats_[task.step];
+        st.count++;
+        st.busy_us += Micros(start, end);
+        st.wait_us += Micros(task.queued, start);
+        st.max_us = std::max(st.max_us, Micros(start, end));
+        if (last) {
+          frame_us_[task.frame] = Micros(frame_start_[task.frame], end);
+          in_flight_--;
+          done_++;
+        }
+      }
+      if (last) {
+        done_cv_.notify_all();
+      } else {
+        Push(Task{task.frame, task.step + 1, end});
+      }
+    }
+  }
+
+  int depth_ = 1;
+  std::function<void()> thread_init_;
+  std::vector<Step> steps_;
+  StageQueue queues_[kStageNum];
+  std::thread workers_[kStageNum];
+  std::mutex mutex_;
+  std::condition_variable done_cv_;
+  // 第一个失败步骤的异常，由mutex_保护
+  std::exception_ptr error_;
+  int in_flight_ = 0;
+  int done_ = 0;
+  Clock::time_point begin_;
+  std::vector<Clock::time_point> frame_start_;
+  std::vector<int64_t> frame_us_;
+  std::vector<StepStat> stats_;
+  int64_t wall_us_ = 0;
+};
+
+// 模拟设备：不访问MLU，各步骤按典型耗时sleep，用于在没有设备的机器上验证流水线的调度和统计
+void AddSimulatedSteps(FramePipeline & pipeline) {
+  struct SimStep {
+    FramePipeline::Stage stage;
+    const char * name;
+    int us;
+  };
+  static const SimStep sim_steps[] = {
+    {FramePipeline::kH2D, "cfnet1 input", 8000},   {FramePipeline::kDevice, "cfnet1 forward", 25000},
+    {FramePipeline::kD2H, "cfnet1 output", 12000}, {FramePipeline::kGather, "cfnet1 gather", 20000},
+    {FramePipeline::kH2D, "cfnet2 input", 6000},   {FramePipeline::kDevice, "cfnet2 forward", 30000},
+    {FramePipeline::kD2H, "cfnet2 output", 15000}, {FramePipeline::kGather, "cfnet2 gather", 25000},
+    {FramePipeline::kH2D, "cfnet3 input", 6000},   {FramePipeline::kDevice, "cfnet3 forward", 20000},
+    {FramePipeline::kD2H, "cfnet3 output", 5000},
+  };
+  for (const SimStep & e_ : sim_steps) {
+    int us = e_.us;
+    pipeline.AddStep(e_.stage, e_.name, [us](int, int) { std::this_thread::sleep_for(std::chrono::microseconds(us)); });
+  }
 }
+
+// 用法: fnet_forward_offline_new [帧数, 默认1] [流水线深度, 默认2] [sim或路由图json, 默认./fnet_route.json]
+//       fnet_forward_offline_new convert a.txt [b.txt ...]  把文本数据转换为二进制
+// 深度为1时与逐帧串行执行等价；第三个参数为sim时使用模拟设备。
+// 编译时需要加上 magicmind/third_party/json11/json11.cc
 int main(int argc, char* argv[]) {
+  int frames = argc > 1 ? atoi(argv[1]) : 1;
+  frames = frames > 0 ? frames : 1;
+  int depth = argc > 2 ? atoi(argv[2]) : 2;
+  depth = depth > 0 ? depth : 1;
+  if (argc > 1 && std::string(argv[1]) == "convert") {
+    return convertData(argc - 2, argv + 2) ? -1 : 0;
+  }
+  std::string route_file = argc > 3 ? argv[3] : "./fnet_route.json";
+
+  if (route_file == "sim") {
+    FramePipeline pipeline(depth);
+    AddSimulatedSteps(pipeline);
+    pipeline.Run(frames);
+    pipeline.Report();
+    return 0;
+  }
+  std::vector<SubnetRoute> graph = LoadRouteGraph(route_file);
+
   cnrtInit(0);
   // unsigned devNum;
   // cnrtGetDeviceCount(&devNum);
 
   cnrtDev_t dev;
   int Dev_use = 1;
-  cnrtGetDeviceHandle(&dev, Dev_use); 
+  cnrtGetDeviceHandle(&dev, Dev_use);
   cnrtSetCurrentDevice(dev);
 
-  auto start2 = std::chrono::high_resolution_clock::now();
-  std::string fname1 = (std::string)"cfnet1.cambricon";
-  struct myData computeData1{};  // 实例化结构体
-  computeData1 = forward(fname1, Dev_use, NULL, NULL, NULL);
-  // 因为forward返回的computeData.outputCpuPtrS[i]已经都转换成了NCHW的四维数据，所以对应shape也应变为NCHW排布的四维数据
-  vector<int> data_index_shape1 = {1, 12, 16, 128, 256};
-  vector<int> data_index_shape2 = {1, 160, 16, 128, 256};
-  // two gather
-  // 此时computeData.outputCpuPtrS[i]中已经都是转换回NCHW的4维数据，入参的1, 2, ...代表第几个gather用于命名，无实际含义
-  auto start = std::chrono::high_resolution_clock::now();
-  float* gather_output_forward1_1 = gather_cpu(computeData1.outputCpuPtrS[3], data_index_shape1, 
-                                                computeData1.outputCpuPtrS[1], data_index_shape1, 4, fname1, 1);
-  float* gather_output_forward1_2 = gather_cpu(computeData1.outputCpuPtrS[7], data_index_shape2, 
-                                                computeData1.outputCpuPtrS[5], data_index_shape2, 4, fname1, 2);
-  auto end = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  std::cout << " " << fname1 << " gather execution time is: " << duration.count() << "us. " << std::endl;                                              
-  void ** this_input_cpu = reinterpret_cast<void**>(malloc(sizeof(float*) * 2));
-  this_input_cpu[0] = gather_output_forward1_1;
-  this_input_cpu[1] = gather_output_forward1_2;
-
-  std::string fname2 = (std::string)"cfnet2.cambricon";
-  struct myData computeData2{};  // 实例化结构体
-  computeData2 = forward(fname2, Dev_use, computeData1.outputMluPtrS, NULL, this_input_cpu);
-  // 因为forward返回的computeData.outputCpuPtrS[i]已经都转换成了NCHW的四维数据，所以对应shape也应变为NCHW排布的四维数据
-  vector<int> data_index_shape3 = {1, 6, 12, 256, 512};
-  vector<int> data_index_shape4 = {1, 80, 12, 256, 512};
-  // two gather
-  // 此时computeData.outputCpuPtrS[i]中已经都是转换回NCHW的4维数据，入参的1, 2, ...代表第几个gather用于命名，无实际含义
-  start = std::chrono::high_resolution_clock::now();
-  float* gather_output_forward2_1 = gather_cpu(computeData2.outputCpuPtrS[3], data_index_shape3, 
-                                                computeData2.outputCpuPtrS[1], data_index_shape3, 4, fname2, 1);
-  float* gather_output_forward2_2 = gather_cpu(computeData2.outputCpuPtrS[7], data_index_shape4, 
-                                                computeData2.outputCpuPtrS[5], data_index_shape4, 4, fname2, 2);
-  end = std::chrono::high_resolution_clock::now();
-  duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  std::cout << " " << fname2 << " gather execution time is: " << duration.count() << "us. " << std::endl;                                               
-  this_input_cpu[0] = gather_output_forward2_1;
-  this_input_cpu[1] = gather_output_forward2_2;
-
-  std::string fname3 = (std::string)"cfnet3.cambricon";
-  struct myData computeData3{};  // 实例化结构体
-  computeData3 = forward(fname3, Dev_use, computeData2.outputMluPtrS, computeData1.outputMluPtrS, this_input_cpu);
-
-  auto end2 = std::chrono::high_resolution_clock::now();
-  auto duration2 = std::chrono::duration_cast<std::chrono::microseconds>(end2 - start2);
-  std::cout << " Total execution time is: " << duration2.count() << "us. " << std::endl;
-
-  exit(0);
+  // 模型加载、上下文和内存创建以及输入绑定只做一次，计入setup时间；每个子网按流水线深度分配槽位
+  auto setup_start = std::chrono::high_resolution_clock::now();
+  std::vector<std::unique_ptr<SubnetSession>> sessions;
+  std::map<std::string, SubnetSession*> producers;
+  for (auto &e_ : graph) {
+    sessions.emplace_back(new SubnetSession(e_, Dev_use, depth));
+    sessions.back()->Bind(producers);
+    producers[e_.name] = sessions.back().get();
+  }
+  auto setup_end = std::chrono::high_resolution_clock::now();
+  auto setup_us = std::chrono::duration_cast<std::chrono::microseconds>(setup_end - setup_start).count();
+
+  // 每个子网依次是输入、推理、输出，有gather的再加一步gather；各阶段线程都需要绑定设备
+  FramePipeline pipeline(depth, [dev] { cnrtSetCurrentDevice(dev); });
+  for (auto &e_ : sessions) {
+    SubnetSession * session = e_.get();
+    std::string name = session->Route().name;
+    pipeline.AddStep(FramePipeline::kH2D, name + " input", [session](int, int slot) { session->Upload(slot); });
+    pipeline.AddStep(FramePipeline::kDevice, name + " forward", [session](int, int slot) { session->Invoke(slot); });
+    pipeline.AddStep(FramePipeline::kD2H, name + " output", [session](int, int slot) { session->Download(slot); });
+    if (!session->Route().gathers.empty()) {
+      pipeline.AddStep(FramePipeline::kGather, name + " gather", [session](int, int slot) { session->Gather(slot); });
+    }
+  }
+  pipeline.Run(frames);
+
+  // setup只发生一次，其余为流水线各阶段和帧的统计
+  std::cout << " Setup time is: " << setup_us << "us (";
+  for (size_t i = 0; i < sessions.size(); i++) {
+    std::cout << (i ? ", " : "") << sessions[i]->Route().name << " " << sessions[i]->SetupMicros() << "us";
+  }
+  std::cout << "). " << std::endl;
+  pipeline.Report();
+  std::cout << " Total execution time is: " << setup_us + pipeline.WallMicros() << "us. " << std::endl;
+
+  return 0;
 }
   /*
   float* gather_output_1 = gather_cpu(outputCpuPtrS[3], shape_input, outputCpuPtrS[1],shape_index,2);
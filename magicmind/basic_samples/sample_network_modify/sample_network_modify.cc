@@ -42,21 +42,25 @@ SUniquePtr<magicmind::INetwork> ConstructOriginalNetwork(magicmind::DataType op_
   magicmind::IElementwiseNode *add =
       network->AddIElementwiseNode(input_0, input_1, magicmind::IElementwise::ADD);
   CHECK_VALID(add);
-  SLOG(INFO) << "Setting add's name as add, return " << add->SetNodeName("add");
+  // not inside SLOG, whose arguments are skipped below the log level
+  CHECK_STATUS(add->SetNodeName("add"));
+  SLOG(INFO) << "Set add's name as add.";
   // create mul node
   auto out1 = add->GetOutput(0);
   CHECK_VALID(input_2);
   magicmind::IElementwiseNode *mul =
       network->AddIElementwiseNode(out1, input_2, magicmind::IElementwise::MUL);
   CHECK_VALID(mul);
-  SLOG(INFO) << "Setting mul's name as mul, return " << mul->SetNodeName("mul");
+  CHECK_STATUS(mul->SetNodeName("mul"));
+  SLOG(INFO) << "Set mul's name as mul.";
   // create add node
   auto out2 = mul->GetOutput(0);
   CHECK_VALID(out2);
   magicmind::IElementwiseNode *add2 =
       network->AddIElementwiseNode(out2, input_3, magicmind::IElementwise::ADD);
   CHECK_VALID(add2);
-  SLOG(INFO) << "Setting add2's name as add2, return " << add2->SetNodeName("add2");
+  CHECK_STATUS(add2->SetNodeName("add2"));
+  SLOG(INFO) << "Set add2's name as add2.";
   // mark network output
   CHECK_STATUS(network->MarkOutput(add2->GetOutput(0)));
   return network;
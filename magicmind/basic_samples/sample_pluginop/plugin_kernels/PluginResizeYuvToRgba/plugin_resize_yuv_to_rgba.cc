@@ -243,90 +243,75 @@ Status PluginResizeYuvToRgbaKernel::SetLocalVar(INodeResource *context) {
 }
 
 size_t PluginResizeYuvToRgbaKernel::GetWorkspaceSize(magicmind::INodeResource *context) {
-  magicmind::Status status_input, status_output;
-  // Use kNumWidth/HeightLimit and input/output shape to get max-possible workspace_size:
-  // 1. convert filter and bias data - constant
-  int32_t convert_size = CEIL_ALIGN_SIZE(
-      (kNumFilterHeightIn * kNumFilterChIn * kNumFilterChOut + kNumFilterChOut), int16_t);
-
-  // 2. shape data - related to batch_num_
-  int32_t shape_size = CEIL_ALIGN_SIZE(batch_num_ * kNumShapeInfo, int32_t);
-
-  // 3. data ptr - related to batch_num_
-  //  - 1 mask ptr, 1 copy_filter ptr, 2 weight ptrs, hence 4 per batch in total.
-  int32_t ptr_size = CEIL_ALIGN_SIZE(4 * batch_num_, void *);
-
-  // 4. mask data - related to src_w
-  //  - use output_shapes and kNumShrink/ExpandLimit to find max-possible size.
-  int32_t mask_size = 0;
-  for (int bidx = 0; bidx < batch_num_; bidx++) {
-    // An accurate mult value is about 1.5 times of dst_w/src_w, here use 2 to ensure
-    // workspace is large enough.
-    int mult = kNumWidthExpandLimit * 2;
-    mask_size +=
-        2 * CEIL_ALIGN_SIZE(
-                mult * ((int32_t *)input_shapes_cpu_)[2 * bidx + 0] * kNumDefaultChannel, int16_t);
-  }
-
-  // 5. weight data - related to output_shapes_cpu_
-  // - assume output_roi_w/h == output_shape_w/h
-  int32_t weight_size = 0;
-  for (int32_t bidx = 0; bidx < batch_num_; bidx++) {
-    weight_size +=
-        CEIL_ALIGN_SIZE(((int32_t *)output_shapes_cpu_)[2 * bidx + 0] * output_channel_, int16_t);
-  }
-
-  // 6. copy filter - related to dst_w / src_w
-  int32_t copy_filter_size = 0;
-  for (int bidx = 0; bidx < batch_num_; bidx++) {
-    // When dst_w / src_w > 64, kernel will use memcpy instead of conv to do src expansion.
-    // As a result, maximal value of mult is 64;
-    copy_filter_size += CEIL_ALIGN_SIZE(kNumMultLimit * kNumLt * kNumLt, int8_t);
-  }
-
-  auxiliary_data_size_ =
-      convert_size + shape_size + ptr_size + mask_size + weight_size + convert_size;
-  size_t workspace_size = auxiliary_data_size_ + device_ptrs_size_;
-  return workspace_size;
+  // Auxiliary data is kept by interp_cache_, workspace only holds device ptrs of images.
+  return device_ptrs_size_;
 }
 
+PluginResizeYuvToRgbaKernel::PluginResizeYuvToRgbaKernel()
+    : interp_cache_(kNumInterpCacheSize, [](InterpDataEntry *entry) {
+        if (entry->mlu) {
+          cnrtFree(entry->mlu);
+          entry->mlu = nullptr;
+        }
+      }) {}
+
 Status PluginResizeYuvToRgbaKernel::Enqueue(INodeResource *context) {
   cnrtQueue_t queue;
   CHECK_STATUS_RET(context->GetQueue(&queue));
   CHECK_STATUS_RET(context->GetWorkspace(&workspace_in_mlu_));
   CHECK_STATUS_RET(context->GetTensorDataPtr("input_rois", &input_rois_cpu_));
   CHECK_STATUS_RET(context->GetTensorDataPtr("output_rois", &output_rois_cpu_));
-  auxiliary_data_size_ = getResizeConvertWorkspaceSize(
-      (int32_t *)input_shapes_cpu_, (int32_t *)input_rois_cpu_, (int32_t *)output_shapes_cpu_,
-      (int32_t *)output_rois_cpu_, batch_num_, pad_method_, output_channel_,
-      (magicmind::PixelFormat)output_format_);
-  size_t workspace_size = auxiliary_data_size_ + device_ptrs_size_;
   // Check input_rois/output_rois/input_shapes/output_shapes
   // SetLocalVar() will not be triggered as long as input/output_shapes does not change,
   // but values of input/output_rois_cpu_ can still effect the size/value of workspace.
   // As a result, the fool-proof checks of input/output_rois_cpu values are moved here.
-  // Moreover, fool-proof checks will traverse over all rois and shapes values,
-  // making it possible to determine whether auxiliary_data can be reused or not.
-  // Could add workspace reuse-logic to improve e2e performance.
   CHECK_STATUS_RET(paramCheck((int32_t *)input_shapes_cpu_, (int32_t *)input_rois_cpu_,
                               (int32_t *)output_shapes_cpu_, (int32_t *)output_rois_cpu_,
                               batch_num_, input_channel_, output_channel_));
 
-  if (CN_SUCCESS != cnMallocHost(&workspace_in_cpu_, auxiliary_data_size_ + device_ptrs_size_)) {
+  // Reuse auxiliary data of the same geometry, or build and upload it.
+  auto key = InterpDataCache::makeKey(
+      (int32_t *)input_shapes_cpu_, (int32_t *)input_rois_cpu_, (int32_t *)output_shapes_cpu_,
+      (int32_t *)output_rois_cpu_, batch_num_, pad_method_, (PixelFormat)input_format_,
+      (PixelFormat)output_format_);
+  InterpDataEntry *interp_data = interp_cache_.find(key);
+  if (!interp_data) {
+    InterpDataEntry entry;
+    entry.size = getResizeConvertWorkspaceSize(
+        (int32_t *)input_shapes_cpu_, (int32_t *)input_rois_cpu_, (int32_t *)output_shapes_cpu_,
+        (int32_t *)output_rois_cpu_, batch_num_, pad_method_, output_channel_,
+        (magicmind::PixelFormat)output_format_);
+    if (cnrtSuccess != cnrtMalloc(&entry.mlu, entry.size)) {
+      std::string temp = "[PluginResizeYuvToRgba] Malloc auxiliary device memory failed.";
+      Status status(error::Code::INVALID_ARGUMENT, temp);
+      return status;
+    }
+    std::vector<uint8_t> auxiliary_data_in_cpu(entry.size, 0);
+    Status status = prepareWorkspace(
+        (int32_t *)input_shapes_cpu_, (int32_t *)input_rois_cpu_, (int32_t *)output_shapes_cpu_,
+        (int32_t *)output_rois_cpu_, batch_num_, pad_method_, COLOR_SPACE_BT_601,
+        COLOR_SPACE_BT_601, (PixelFormat)input_format_, (PixelFormat)output_format_, entry.mlu,
+        auxiliary_data_in_cpu.data(), entry.convert_filter_mlu, entry.convert_bias_mlu,
+        entry.shape_mlu, entry.mask_mlu, entry.weight_mlu, entry.copy_filter_mlu);
+    if (status != Status::OK()) {
+      cnrtFree(entry.mlu);
+      return status;
+    }
+    CNRT_CHECK(cnrtMemcpy(entry.mlu, auxiliary_data_in_cpu.data(), entry.size,
+                          cnrtMemcpyHostToDev));
+    if (interp_cache_.full()) {
+      // kernels enqueued before may still read the entry to be evicted
+      CNRT_CHECK(cnrtQueueSync(queue));
+    }
+    interp_data = interp_cache_.insert(key, entry);
+  }
+
+  if (CN_SUCCESS != cnMallocHost(&workspace_in_cpu_, device_ptrs_size_)) {
     std::string temp = "[PluginResizeYuvToRgba] Malloc temp host memory failed.";
     Status status(error::Code::INVALID_ARGUMENT, temp);
     return status;
   }
-  auxiliary_data_in_cpu_ = workspace_in_cpu_;
-  device_ptrs_in_cpu_ = (void *)((uint8_t *)auxiliary_data_in_cpu_ + auxiliary_data_size_);
-  memset(auxiliary_data_in_cpu_, 0x00, auxiliary_data_size_);
-
-  CHECK_STATUS_RET(prepareWorkspace(
-      (int32_t *)input_shapes_cpu_, (int32_t *)input_rois_cpu_, (int32_t *)output_shapes_cpu_,
-      (int32_t *)output_rois_cpu_, batch_num_, pad_method_, COLOR_SPACE_BT_601, COLOR_SPACE_BT_601,
-      (PixelFormat)input_format_, (PixelFormat)output_format_, workspace_in_mlu_, workspace_in_cpu_,
-      yuv_filter_mlu_, yuv_bias_mlu_, shape_data_mlu_, interp_mask_mlu_, interp_weight_mlu_,
-      expand_filter_mlu_));
+  void *device_ptrs_in_cpu = workspace_in_cpu_;
 
   std::vector<void *> y_mlu_ptrs;
   CHECK_STATUS_RET(context->GetTensorDataPtr("y_tensors", &y_mlu_ptrs));
@@ -339,7 +324,7 @@ Status PluginResizeYuvToRgbaKernel::Enqueue(INodeResource *context) {
   std::vector<void *> rgba_mlu_ptrs;
   CHECK_STATUS_RET(context->GetTensorDataPtr("rgba_tensors", &rgba_mlu_ptrs));
 
-  void *device_ptrs_in_mlu = (void *)((uint8_t *)workspace_in_mlu_ + auxiliary_data_size_);
+  void *device_ptrs_in_mlu = workspace_in_mlu_;
   int64_t batch_offset = 0;
   for (int32_t tidx = 0; tidx < input_tensor_num_; tidx++) {
     int64_t batch_num = input_batch_num_vec_[tidx];
@@ -348,9 +333,9 @@ Status PluginResizeYuvToRgbaKernel::Enqueue(INodeResource *context) {
       int64_t addr_offset =
           ((int32_t *)input_shapes_cpu_)[2 * idx + 0] *
           ((int32_t *)input_shapes_cpu_)[2 * idx + 1] /* * input_channel(which is 1) */;
-      ((uint8_t **)device_ptrs_in_cpu_)[0 * batch_num_ + idx] =
+      ((uint8_t **)device_ptrs_in_cpu)[0 * batch_num_ + idx] =
           (uint8_t *)(y_mlu_ptrs[tidx]) + addr_offset * bidx;
-      ((uint8_t **)device_ptrs_in_cpu_)[1 * batch_num_ + idx] =
+      ((uint8_t **)device_ptrs_in_cpu)[1 * batch_num_ + idx] =
           (uint8_t *)(uv_mlu_ptrs[tidx]) + addr_offset * bidx / 2;
     }
     batch_offset += batch_num;
@@ -363,22 +348,23 @@ Status PluginResizeYuvToRgbaKernel::Enqueue(INodeResource *context) {
       int64_t idx = bidx + batch_offset;
       int64_t addr_offset = ((int32_t *)output_shapes_cpu_)[2 * idx + 0] *
                             ((int32_t *)output_shapes_cpu_)[2 * idx + 1] * output_channel_;
-      ((uint8_t **)device_ptrs_in_cpu_)[2 * batch_num_ + idx] =
+      ((uint8_t **)device_ptrs_in_cpu)[2 * batch_num_ + idx] =
           (uint8_t *)(rgba_mlu_ptrs[tidx]) + addr_offset * bidx;
     }
     batch_offset += batch_num;
   }
 
-  CNRT_CHECK(cnrtMemcpyAsync(workspace_in_mlu_, workspace_in_cpu_, workspace_size, queue,
+  CNRT_CHECK(cnrtMemcpyAsync(workspace_in_mlu_, workspace_in_cpu_, device_ptrs_size_, queue,
                              cnrtMemcpyHostToDev));
 
   void **input_y = (void **)device_ptrs_in_mlu;
   void **input_uv = (void **)((uint8_t **)device_ptrs_in_mlu + 1 * batch_num_);
   void **output_rgba = (void **)((uint8_t **)device_ptrs_in_mlu + 2 * batch_num_);
 
-  ResizeYuvToRgbaEnqueue(queue, output_rgba, input_y, input_uv, shape_data_mlu_, interp_mask_mlu_,
-                         interp_weight_mlu_, fill_color_mlu, yuv_filter_mlu_, yuv_bias_mlu_,
-                         expand_filter_mlu_, (int32_t *)output_rois_cpu_, batch_num_,
+  ResizeYuvToRgbaEnqueue(queue, output_rgba, input_y, input_uv, interp_data->shape_mlu,
+                         interp_data->mask_mlu, interp_data->weight_mlu, fill_color_mlu,
+                         interp_data->convert_filter_mlu, interp_data->convert_bias_mlu,
+                         interp_data->copy_filter_mlu, (int32_t *)output_rois_cpu_, batch_num_,
                          output_channel_);
   if (workspace_in_cpu_) {
     cnFreeHost(workspace_in_cpu_);
@@ -388,6 +374,10 @@ Status PluginResizeYuvToRgbaKernel::Enqueue(INodeResource *context) {
 }
 
 PluginResizeYuvToRgbaKernel::~PluginResizeYuvToRgbaKernel() {
+  if (InterpCacheHits() + InterpCacheMisses()) {
+    std::cout << "[PluginResizeYuvToRgba] Auxiliary data cache: " << InterpCacheHits()
+              << " hits, " << InterpCacheMisses() << " misses." << std::endl;
+  }
   if (input_shapes_cpu_) {
     free(input_shapes_cpu_);
     input_shapes_cpu_ = nullptr;
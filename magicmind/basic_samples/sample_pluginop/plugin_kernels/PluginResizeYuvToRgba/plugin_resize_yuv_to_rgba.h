@@ -8,6 +8,7 @@
 #include "mm_plugin.h"
 #include "common/macros.h"
 #include "plugin_resize_yuv_to_rgba_macro.h"
+#include "plugin_resize_yuv_to_rgba_helper.h"
 
 namespace magicmind {
 
@@ -133,7 +134,9 @@ class PluginResizeYuvToRgbaKernel : public IPluginKernel {
   size_t GetWorkspaceSize(INodeResource *context) override;
   Status Enqueue(INodeResource *context) override;
   ~PluginResizeYuvToRgbaKernel();
-  PluginResizeYuvToRgbaKernel() {}
+  PluginResizeYuvToRgbaKernel();
+  size_t InterpCacheHits() const { return interp_cache_.hits(); }
+  size_t InterpCacheMisses() const { return interp_cache_.misses(); }
 
  private:
   // const tensor names
@@ -148,31 +151,22 @@ class PluginResizeYuvToRgbaKernel : public IPluginKernel {
 
   // private workspace memory usage:
   //  - device ptrs:
-  //    - [1] shape_data ptr.
-  //    - [1] yuv_filter ptr.
-  //    - [1] yuv_bias ptr.
-  //    - [2 * batch_num] interp_mask ptrs(left and right).
-  //    - [batch_num] interp_weight ptrs.
-  //    - [batch_num] expand_filter ptrs.
+  //    - [batch_num] input_y ptrs.
+  //    - [batch_num] input_uv ptrs.
+  //    - [batch_num] output_rgba ptrs.
+  //
+  // auxiliary data lives in device memory of interp_cache_ entries, see InterpDataEntry:
   //  - shape_data: src_w sroi_x sroi_y sroi_w sroi_h dst_w droi_x droi_y droi_w droi_h.
   //  - yuv_filter: const data for yuv420sp to rgb conversion.
   //  - yuv_bias: const data for yuv420sp to rgb conversion.
   //  - interp_mask: a 0/1 mask to collect data that will be used for interp calc.
   //  - interp_weight: weight of interp calc.
   //  - expand_filter: const data for abcd to aaa..bbb..ccc..ddd.. conversion.
-  //
-  //  Use only one cnrtMemcpyAsync to reduce cost.
-  void *workspace_in_cpu_      = nullptr;
-  void *workspace_in_mlu_      = nullptr;
-  void *auxiliary_data_in_cpu_ = nullptr;
-  void *device_ptrs_in_cpu_    = nullptr;
-
-  void *shape_data_mlu_     = nullptr;
-  void **interp_mask_mlu_   = nullptr;
-  void **interp_weight_mlu_ = nullptr;
-  void *yuv_filter_mlu_     = nullptr;
-  void *yuv_bias_mlu_       = nullptr;
-  void **expand_filter_mlu_ = nullptr;
+  // It only depends on shapes, rois, pad method and formats, so it is built and uploaded once per
+  // geometry and reused by later Enqueue calls.
+  void *workspace_in_cpu_ = nullptr;
+  void *workspace_in_mlu_ = nullptr;
+  InterpDataCache interp_cache_;
 
   int64_t input_tensor_num_   = 0;
   int64_t output_tensor_num_  = 0;
@@ -182,12 +176,9 @@ class PluginResizeYuvToRgbaKernel : public IPluginKernel {
   int64_t output_format_      = 3;
   int32_t input_channel_      = 1;
   int32_t output_channel_     = 3;
-  size_t auxiliary_data_size_ = 0;
   size_t device_ptrs_size_    = 0;
 
   bool inited_ = false;
-  // cache auxiliary_data to improve e2e performance.
-  // bool use_cached_workspace_ = false;
 };
 
 class PluginResizeYuvToRgbaKernelFactory : public IPluginKernelFactory {
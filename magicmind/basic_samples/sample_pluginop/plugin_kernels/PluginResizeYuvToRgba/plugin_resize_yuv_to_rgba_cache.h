@@ -0,0 +1,136 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ *************************************************************************/
+#ifndef PLUGIN_RESIZE_YUV_TO_RGBA_CACHE_H_
+#define PLUGIN_RESIZE_YUV_TO_RGBA_CACHE_H_
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+#include "mm_plugin.h"
+
+/*
+ * Auxiliary data prepared by prepareWorkspace for one geometry, i.e., convert filter and bias,
+ * shape data, interp mask and weight and copy filter, with the device addresses the kernel takes.
+ * All pointers point into mlu, which is owned by the cache entry.
+ */
+struct InterpDataEntry {
+  void *mlu                = nullptr;
+  size_t size              = 0;
+  void *convert_filter_mlu = nullptr;
+  void *convert_bias_mlu   = nullptr;
+  void *shape_mlu          = nullptr;
+  void **mask_mlu          = nullptr;
+  void **weight_mlu        = nullptr;
+  void **copy_filter_mlu   = nullptr;
+};
+
+/*
+ * LRU cache of InterpDataEntry keyed by everything prepareWorkspace reads: src/dst shapes and
+ * rois, batch size, pad method and pixel formats. In video streams roi geometry rarely changes, so
+ * most Enqueue calls can skip building and uploading the tables.
+ *
+ * The cache does not touch device memory itself: release is called for every entry evicted or left
+ * at destruction, so it can be tested on host with a fake release. Header only, so host programs
+ * such as cpu_ResizeYuvToRgba use it without the plugin library.
+ */
+class InterpDataCache {
+ public:
+  typedef std::vector<int32_t> Key;
+  InterpDataCache(size_t capacity, std::function<void(InterpDataEntry *)> release);
+  ~InterpDataCache();
+  static Key makeKey(const int32_t *src_shapes,
+                     const int32_t *src_rois,
+                     const int32_t *dst_shapes,
+                     const int32_t *dst_rois,
+                     int32_t batch_size,
+                     int32_t pad_method,
+                     magicmind::PixelFormat src_pixfmt,
+                     magicmind::PixelFormat dst_pixfmt);
+  // Returns the entry of key and marks it most recently used, or nullptr.
+  InterpDataEntry *find(const Key &key);
+  // Whether insert will evict the least recently used entry.
+  bool full() const { return lru_.size() >= capacity_; }
+  InterpDataEntry *insert(const Key &key, const InterpDataEntry &entry);
+  size_t size() const { return lru_.size(); }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  InterpDataCache(const InterpDataCache &) = delete;
+  InterpDataCache &operator=(const InterpDataCache &) = delete;
+  typedef std::list<std::pair<Key, InterpDataEntry>> List;
+  size_t capacity_ = 1;
+  std::function<void(InterpDataEntry *)> release_;
+  List lru_;
+  std::map<Key, List::iterator> index_;
+  size_t hits_   = 0;
+  size_t misses_ = 0;
+};
+
+inline InterpDataCache::InterpDataCache(size_t capacity,
+                                        std::function<void(InterpDataEntry *)> release)
+    : capacity_(std::max<size_t>(1, capacity)), release_(release) {}
+
+inline InterpDataCache::~InterpDataCache() {
+  for (auto &e_ : lru_) {
+    if (release_) {
+      release_(&e_.second);
+    }
+  }
+}
+
+inline InterpDataCache::Key InterpDataCache::makeKey(const int32_t *src_shapes,
+                                                     const int32_t *src_rois,
+                                                     const int32_t *dst_shapes,
+                                                     const int32_t *dst_rois,
+                                                     int32_t batch_size,
+                                                     int32_t pad_method,
+                                                     magicmind::PixelFormat src_pixfmt,
+                                                     magicmind::PixelFormat dst_pixfmt) {
+  Key key = {batch_size, pad_method, (int32_t)src_pixfmt, (int32_t)dst_pixfmt};
+  key.reserve(key.size() + batch_size * 12);
+  key.insert(key.end(), src_shapes, src_shapes + batch_size * 2);
+  key.insert(key.end(), src_rois, src_rois + batch_size * 4);
+  key.insert(key.end(), dst_shapes, dst_shapes + batch_size * 2);
+  key.insert(key.end(), dst_rois, dst_rois + batch_size * 4);
+  return key;
+}
+
+inline InterpDataEntry *InterpDataCache::find(const Key &key) {
+  auto iter = index_.find(key);
+  if (iter == index_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  lru_.splice(lru_.begin(), lru_, iter->second);
+  return &iter->second->second;
+}
+
+inline InterpDataEntry *InterpDataCache::insert(const Key &key, const InterpDataEntry &entry) {
+  auto iter = index_.find(key);
+  if (iter != index_.end()) {
+    if (release_) {
+      release_(&iter->second->second);
+    }
+    iter->second->second = entry;
+    lru_.splice(lru_.begin(), lru_, iter->second);
+    return &iter->second->second;
+  }
+  if (full()) {
+    auto &last = lru_.back();
+    if (release_) {
+      release_(&last.second);
+    }
+    index_.erase(last.first);
+    lru_.pop_back();
+  }
+  lru_.emplace_front(key, entry);
+  index_[key] = lru_.begin();
+  return &lru_.front().second;
+}
+
+#endif  // PLUGIN_RESIZE_YUV_TO_RGBA_CACHE_H_
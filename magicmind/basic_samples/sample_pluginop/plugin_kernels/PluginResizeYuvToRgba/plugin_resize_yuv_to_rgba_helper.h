@@ -5,9 +5,11 @@
 #define PLUGIN_RESIZE_YUV_TO_RGBA_HELPER_H_
 #include <map>
 #include <string>
+#include <vector>
 #include "mm_plugin.h"
 #include "third_party/half/half.h"
 #include "plugin_resize_yuv_to_rgba_macro.h"
+#include "plugin_resize_yuv_to_rgba_cache.h"
 
 static std::map<int32_t, std::string> kNumToEngMap{
     {0, "th"}, {1, "st"}, {2, "nd"}, {3, "rd"}, {4, "th"},
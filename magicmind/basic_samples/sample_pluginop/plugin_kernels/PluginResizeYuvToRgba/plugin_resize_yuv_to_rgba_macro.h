@@ -37,6 +37,7 @@ static const int kNumWidthExpandLimit  = 600;
 static const int kNumHeightExpandLimit = 8192;
 static const int kNumWidthShrinkLimit  = 8192;
 static const int kNumHeightShrinkLimit = 8192;
+static const int kNumInterpCacheSize   = 8;
 
 // Macros for mlu kernels
 // ALIGN TO 1024 bit NUM
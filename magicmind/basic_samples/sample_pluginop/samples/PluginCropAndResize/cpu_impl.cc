@@ -2,8 +2,17 @@
  * Copyright (C) [2020-2023] by Cambricon, Inc.
  * Description: Host implement for resize
  *************************************************************************/
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "common/data.h"
 #include "common/macros.h"
+#include "common/threadpool.h"
+#include "common/timer.h"
+// Golden reference, kept as is for bit-exact check of the fast implement below.
 static void ResizeCpuCompute(unsigned char *dst,
                              unsigned char *src,
                              int s_row,
@@ -136,8 +145,202 @@ static void CropAndResizeCpuCompute(uint8_t *cpu_output_ptr,
   free(tmp_cpu_output);
 }
 
+namespace {
+/*
+ * Bilinear taps of one output row/col: source indices and distance to the first one, computed by
+ * exactly the same double math as ResizeCpuCompute, but once per ROI instead of once per pixel.
+ */
+struct Taps {
+  int i0;
+  int i1;
+  double d;
+};
+
+void ComputeTaps(int src, int dst, std::vector<Taps> *taps) {
+  double scale = (double)src / dst;
+  taps->resize(dst);
+  for (int i = 0; i < dst; i++) {
+    double map = (i + 0.5) * scale - 0.5;
+    int i0     = (int)map;
+    double d   = map - i0;
+    if (map < 0) {
+      map = 0;
+      i0  = (int)map;
+      d   = 0;
+    }
+    if (map >= src - 1) {
+      map = src - 2;
+      i0  = (int)map;
+      d   = 1;
+    }
+    (*taps)[i] = {i0, i0 + 1, d};
+  }
+}
+
+/*
+ * One RGBA pixel. Weights are products in the same order as the reference expression
+ * (1 - xd) * (1 - yd) * p00 + xd * (1 - yd) * p01 + (1 - xd) * yd * p10 + xd * yd * p11,
+ * and sums are done left to right in double, so results are bit-exact with it.
+ */
+inline void BilinearRGBA(uint8_t *dst,
+                         const uint8_t *p00,
+                         const uint8_t *p01,
+                         const uint8_t *p10,
+                         const uint8_t *p11,
+                         double w00,
+                         double w01,
+                         double w10,
+                         double w11) {
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  auto load = [&zero](const uint8_t *p, __m128d *lo, __m128d *hi) {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    __m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+    *lo       = _mm_cvtepi32_pd(x);
+    *hi       = _mm_cvtepi32_pd(_mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+  };
+  __m128d a_lo, a_hi, b_lo, b_hi, c_lo, c_hi, d_lo, d_hi;
+  load(p00, &a_lo, &a_hi);
+  load(p01, &b_lo, &b_hi);
+  load(p10, &c_lo, &c_hi);
+  load(p11, &d_lo, &d_hi);
+  __m128d v00 = _mm_set1_pd(w00), v01 = _mm_set1_pd(w01);
+  __m128d v10 = _mm_set1_pd(w10), v11 = _mm_set1_pd(w11);
+  __m128d lo  = _mm_add_pd(_mm_mul_pd(v00, a_lo), _mm_mul_pd(v01, b_lo));
+  __m128d hi  = _mm_add_pd(_mm_mul_pd(v00, a_hi), _mm_mul_pd(v01, b_hi));
+  lo          = _mm_add_pd(_mm_add_pd(lo, _mm_mul_pd(v10, c_lo)), _mm_mul_pd(v11, d_lo));
+  hi          = _mm_add_pd(_mm_add_pd(hi, _mm_mul_pd(v10, c_hi)), _mm_mul_pd(v11, d_hi));
+  // truncate as double to unsigned char conversion does, values are within [0, 255]
+  __m128i i32 = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+  __m128i i8  = _mm_packus_epi16(_mm_packs_epi32(i32, zero), zero);
+  int32_t out = _mm_cvtsi128_si32(i8);
+  memcpy(dst, &out, sizeof(out));
+#else
+  for (int k = 0; k < 4; k++) {
+    dst[k] = w00 * p00[k] + w01 * p01[k] + w10 * p10[k] + w11 * p11[k];
+  }
+#endif
+}
+
+/*
+ * Resize one ROI of an RGBA image with row stride src_stride into the top left d_row x d_col of
+ * dst with row stride dst_stride.
+ */
+void ResizeRoi(uint8_t *dst,
+               int dst_stride,
+               const uint8_t *src,
+               int src_stride,
+               int s_row,
+               int s_col,
+               int d_row,
+               int d_col) {
+  // tables are reused by every ROI this thread handles
+  thread_local std::vector<Taps> x_taps;
+  thread_local std::vector<Taps> y_taps;
+  thread_local std::vector<double> x_weights;
+  ComputeTaps(s_col, d_col, &x_taps);
+  ComputeTaps(s_row, d_row, &y_taps);
+  x_weights.resize(2 * d_col);
+  for (int j = 0; j < d_col; j++) {
+    x_weights[2 * j]     = 1 - x_taps[j].d;
+    x_weights[2 * j + 1] = x_taps[j].d;
+  }
+  for (int i = 0; i < d_row; i++) {
+    const Taps &y       = y_taps[i];
+    const uint8_t *row0 = src + y.i0 * src_stride;
+    const uint8_t *row1 = src + y.i1 * src_stride;
+    double wy0          = 1 - y.d;
+    double wy1          = y.d;
+    uint8_t *out        = dst + i * dst_stride;
+    for (int j = 0; j < d_col; j++) {
+      const Taps &x = x_taps[j];
+      double wx0    = x_weights[2 * j];
+      double wx1    = x_weights[2 * j + 1];
+      BilinearRGBA(out + j * 4, row0 + x.i0 * 4, row0 + x.i1 * 4, row1 + x.i0 * 4,
+                   row1 + x.i1 * 4, wx0 * wy0, wx1 * wy0, wx0 * wy1, wx1 * wy1);
+    }
+  }
+}
+
+void FillRGBA(uint8_t *dst, int count, const uint8_t *value) {
+  for (int i = 0; i < count; i++) {
+    memcpy(dst + i * 4, value, 4);
+  }
+}
+}  // namespace
+
+/*
+ * Same result as CropAndResizeCpuCompute, without copying ROIs or temporaries. ROIs are resized
+ * directly from input into output, on threads when threads > 1.
+ */
+static void FastCropAndResizeCpuCompute(uint8_t *cpu_output_ptr,
+                                        const uint8_t *cpu_input_ptr,
+                                        const int *cpu_crop_params_ptr,
+                                        const int *cpu_roi_nums_ptr,
+                                        const int *cpu_pad_values_ptr,
+                                        int s_row,
+                                        int s_col,
+                                        int d_row,
+                                        int d_col,
+                                        int batch_size,
+                                        int keep_aspect_ratio,
+                                        int threads) {
+  uint8_t pad[4];
+  for (int ch = 0; ch < 4; ch++) {
+    pad[ch] = (uint8_t)cpu_pad_values_ptr[ch];
+  }
+  auto roi_task = [=, &pad](int batch, int roi) {
+    const int *param = cpu_crop_params_ptr + 4 * roi;
+    int roi_x        = param[0];
+    int roi_y        = param[1];
+    int roi_w        = param[2];
+    int roi_h        = param[3];
+    int d_row_ar     = d_row;
+    int d_col_ar     = d_col;
+    if (keep_aspect_ratio) {
+      float src_ar = (float)(roi_w) / roi_h;
+      float dst_ar = (float)(d_col) / d_row;
+      if (src_ar > dst_ar) {
+        d_row_ar = d_col * roi_h / roi_w;
+      } else {
+        d_col_ar = d_row * roi_w / roi_h;
+      }
+    }
+    int src_stride     = s_col * 4;
+    int dst_stride     = d_col * 4;
+    const uint8_t *src = cpu_input_ptr + (int64_t)batch * s_row * src_stride +
+                         roi_y * src_stride + roi_x * 4;
+    uint8_t *dst = cpu_output_ptr + (int64_t)roi * d_row * dst_stride;
+    ResizeRoi(dst, dst_stride, src, src_stride, roi_h, roi_w, d_row_ar, d_col_ar);
+    // pad what the resized ROI leaves
+    for (int row = 0; row < d_row_ar; row++) {
+      FillRGBA(dst + row * dst_stride + d_col_ar * 4, d_col - d_col_ar, pad);
+    }
+    FillRGBA(dst + d_row_ar * dst_stride, (d_row - d_row_ar) * d_col, pad);
+  };
+  std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+  std::vector<std::future<void>> rets;
+  int roi_count = 0;
+  for (int i = 0; i < batch_size; i++) {
+    for (int j = 0; j < cpu_roi_nums_ptr[i]; j++, roi_count++) {
+      if (pool) {
+        rets.push_back(pool->AddTask(roi_task, i, roi_count));
+      } else {
+        roi_task(i, roi_count);
+      }
+    }
+  }
+  for (auto &r : rets) {
+    r.get();
+  }
+}
+
 // To gen input and comput output
-int main() {
+// Usage: cpu_CropAndResize [iterations] [threads], to benchmark fast implement against reference.
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? std::stoi(argv[1]) : 1;
+  int threads    = argc > 2 ? std::stoi(argv[2]) : std::max<int>(1, kThreadPoolDefaultNum);
   // params
   int batch_size = 4;
   int channel = 4;
@@ -172,9 +375,25 @@ int main() {
 
   unsigned int output_num = total_rois * channel * d_col * d_row;
   std::vector<uint8_t> output(output_num);
+  uint64_t start = EnvTime::NowMicros(CLOCK_MONOTONIC);
   CropAndResizeCpuCompute(output.data(), input.data(), crop_params.data(), roi_nums.data(),
                           pad_values.data(), s_row, s_col, d_row, d_col, batch_size,
                           keep_aspect_ratio);
+  double reference_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0;
+  std::vector<uint8_t> fast_output(output_num);
+  start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  for (int i = 0; i < iterations; i++) {
+    FastCropAndResizeCpuCompute(fast_output.data(), input.data(), crop_params.data(),
+                                roi_nums.data(), pad_values.data(), s_row, s_col, d_row, d_col,
+                                batch_size, keep_aspect_ratio, threads);
+  }
+  double fast_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0 / iterations;
+  SLOG(INFO) << "CropAndResize cpu: reference " << reference_ms << " ms, fast " << fast_ms
+             << " ms with " << threads << " threads (" << reference_ms / fast_ms << "x).";
+  if (memcmp(output.data(), fast_output.data(), output_num)) {
+    SLOG(ERROR) << "Fast CropAndResize cpu implement is not bit-exact with reference.";
+    return -1;
+  }
   // write out for future comparasion to dev
   CHECK_VALID(WriteDataToFile("./input", input.data(), input_num * sizeof(uint8_t)));
   CHECK_VALID(WriteDataToFile("./roi_nums", roi_nums.data(), roi_nums_num * sizeof(int)));
@@ -3,11 +3,20 @@
  *************************************************************************/
 #include <dlfcn.h>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <memory>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "common/data.h"
 #include "common/macros.h"
 #include "common/param.h"
+#include "common/threadpool.h"
+#include "common/timer.h"
 #include "basic_samples/sample_pluginop/plugin_kernels/PluginResizeYuvToRgba/plugin_resize_yuv_to_rgba_macro.h"
+#include "basic_samples/sample_pluginop/plugin_kernels/PluginResizeYuvToRgba/plugin_resize_yuv_to_rgba_cache.h"
 
 typedef enum {
   RGBA_TO_RGBA = 0,      // Convert color space from RGBA to RGBA, not implemented.
@@ -356,6 +365,278 @@ static void ResizeYuvToRgbaCpuCompute(uint8_t *dst,
   return;
 }
 
+namespace {
+/*
+ * Fixed point for the fused kernel:
+ *  - color conversion coefficients in Q13, so they fit int16 for madd,
+ *  - converted colors in Q4, clamped to [0, 255 << 4],
+ *  - horizontal weights in Q10, the horizontal result kept in Q7 (fits int16),
+ *  - vertical weights in Q8, rounded to nearest at the end.
+ * Results differ from the float reference by at most one level in practice.
+ */
+const int kCvtBits   = 13;
+const int kColorBits = 4;
+const int kXBits     = 10;
+const int kHBits     = 7;
+const int kYBits     = 8;
+const int kCoefY     = 9535;     // 1.164
+const int kCoefRV    = 13074;    // 1.596
+const int kCoefGU    = -3211;    // -0.392
+const int kCoefGV    = -6660;    // -0.813
+const int kCoefBU    = 16523;    // 2.017
+const int kBiasR     = -1826095; // -222.912
+const int kBiasG     = 1110966;  // 135.616
+const int kBiasB     = -2267546; // -276.8
+const int kBiasA     = 255 << kCvtBits;
+
+/*
+ * Per lane (c0, c1, c2, alpha) coefficients of Y, U, V and bias, with c0..c2 in the channel order
+ * of ResizeYuvToRgbaCpuCompute: RGB for color % 4 in {1, 2}, BGR otherwise.
+ */
+struct CvtCoefs {
+  int16_t y[4];
+  int16_t u[4];
+  int16_t v[4];
+  int32_t bias[4];
+};
+
+CvtCoefs GetCvtCoefs(PluginColorCvt_t color) {
+  bool rgb = (color % 4 == 1 || color % 4 == 2);
+  CvtCoefs c;
+  int16_t r_u = 0, g_u = kCoefGU, b_u = kCoefBU;
+  int16_t r_v = kCoefRV, g_v = kCoefGV, b_v = 0;
+  int16_t u[3] = {r_u, g_u, b_u};
+  int16_t v[3] = {r_v, g_v, b_v};
+  int32_t bias[3] = {kBiasR, kBiasG, kBiasB};
+  for (int k = 0; k < 3; k++) {
+    int from  = rgb ? k : 2 - k;
+    c.y[k]    = kCoefY;
+    c.u[k]    = u[from];
+    c.v[k]    = v[from];
+    c.bias[k] = bias[from];
+  }
+  c.y[3]    = 0;
+  c.u[3]    = 0;
+  c.v[3]    = 0;
+  c.bias[3] = kBiasA;
+  return c;
+}
+
+// Source column/row of one destination column/row, with the fixed point weight of the second.
+struct Tap {
+  int32_t p0;
+  int32_t p1;
+  int32_t w1;
+};
+
+/*
+ * Same position math as getSrcPosFromDst on a ROI starting at crop_pos (even), returned as
+ * absolute source positions.
+ */
+void ComputeTaps(int d_len, float scale, int32_t limit, int32_t roi_pos, int32_t crop_pos,
+                 int bits, std::vector<Tap> *taps) {
+  taps->resize(d_len);
+  for (int i = 0; i < d_len; i++) {
+    int32_t p0 = 0;
+    float d    = 0;
+    getSrcPosFromDst(&p0, &d, i, scale, limit, roi_pos % 2);
+    int32_t p1 = std::min(limit + (roi_pos % 2), p0 + 1);
+    (*taps)[i] = {crop_pos + p0, crop_pos + p1, (int32_t)std::lround(d * (1 << bits))};
+  }
+}
+
+inline int32_t ClampColor(int32_t t) {
+  t = (t + (1 << (kCvtBits - kColorBits - 1))) >> (kCvtBits - kColorBits);
+  return std::min(std::max(t, 0), 255 << kColorBits);
+}
+
+/*
+ * Fused YUV sampling, color conversion and bilinear interpolation of one destination pixel.
+ * out gets lanes (c0, c1, c2, alpha).
+ */
+struct Sampler {
+  const uint8_t *y0;
+  const uint8_t *y1;
+  const uint8_t *uv0;
+  const uint8_t *uv1;
+  int u_off;
+  int v_off;
+  CvtCoefs coefs;
+
+  inline void Pixel(const Tap &x, int32_t wy1, uint8_t out[4]) const {
+    int32_t x0 = x.p0, x1 = x.p1;
+    int32_t c0 = x0 & ~1, c1 = x1 & ~1;
+#if defined(__SSE2__)
+    // lanes of Y, U interleaved for madd, and V, 0
+    const __m128i cyu  = _mm_setr_epi16(coefs.y[0], coefs.u[0], coefs.y[1], coefs.u[1],
+                                        coefs.y[2], coefs.u[2], coefs.y[3], coefs.u[3]);
+    const __m128i cv   = _mm_setr_epi16(coefs.v[0], 0, coefs.v[1], 0, coefs.v[2], 0, coefs.v[3], 0);
+    const __m128i bias = _mm_loadu_si128(reinterpret_cast<const __m128i *>(coefs.bias));
+    const __m128i rnd  = _mm_set1_epi32(1 << (kCvtBits - kColorBits - 1));
+    const __m128i maxc = _mm_set1_epi16(255 << kColorBits);
+    auto cvt = [&](uint8_t yv, uint8_t uv, uint8_t vv) {
+      __m128i yu = _mm_set1_epi32(int32_t(yv) | (int32_t(uv) << 16));
+      __m128i v0 = _mm_set1_epi32(int32_t(vv));
+      __m128i t  = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yu, cyu), _mm_madd_epi16(v0, cv)),
+                                 _mm_add_epi32(bias, rnd));
+      t          = _mm_srai_epi32(t, kCvtBits - kColorBits);
+      __m128i p  = _mm_packs_epi32(t, t);
+      return _mm_min_epi16(_mm_max_epi16(p, _mm_setzero_si128()), maxc);
+    };
+    __m128i p00 = cvt(y0[x0], uv0[c0 + u_off], uv0[c0 + v_off]);
+    __m128i p01 = cvt(y0[x1], uv0[c1 + u_off], uv0[c1 + v_off]);
+    __m128i p10 = cvt(y1[x0], uv1[c0 + u_off], uv1[c0 + v_off]);
+    __m128i p11 = cvt(y1[x1], uv1[c1 + u_off], uv1[c1 + v_off]);
+    int32_t wx1 = x.w1, wx0 = (1 << kXBits) - x.w1;
+    __m128i wx  = _mm_set1_epi32(wx0 | (wx1 << 16));
+    __m128i h0  = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(p00, p01), wx), kXBits + kColorBits - kHBits);
+    __m128i h1  = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(p10, p11), wx), kXBits + kColorBits - kHBits);
+    int32_t wy0 = (1 << kYBits) - wy1;
+    __m128i wy  = _mm_set1_epi32(wy0 | (wy1 << 16));
+    __m128i hh  = _mm_unpacklo_epi16(_mm_packs_epi32(h0, h0), _mm_packs_epi32(h1, h1));
+    __m128i v   = _mm_add_epi32(_mm_madd_epi16(hh, wy), _mm_set1_epi32(1 << (kHBits + kYBits - 1)));
+    v           = _mm_srai_epi32(v, kHBits + kYBits);
+    __m128i b   = _mm_packus_epi16(_mm_packs_epi32(v, v), _mm_setzero_si128());
+    int32_t packed = _mm_cvtsi128_si32(b);
+    memcpy(out, &packed, 4);
+#else
+    int32_t wx1 = x.w1, wx0 = (1 << kXBits) - x.w1;
+    int32_t wy0 = (1 << kYBits) - wy1;
+    const uint8_t *ys[4]  = {y0 + x0, y0 + x1, y1 + x0, y1 + x1};
+    const uint8_t *uvs[4] = {uv0 + c0, uv0 + c1, uv1 + c0, uv1 + c1};
+    for (int k = 0; k < 4; k++) {
+      int32_t p[4];
+      for (int n = 0; n < 4; n++) {
+        p[n] = ClampColor(coefs.y[k] * *ys[n] + coefs.u[k] * uvs[n][u_off] +
+                          coefs.v[k] * uvs[n][v_off] + coefs.bias[k]);
+      }
+      int32_t h0 = (p[0] * wx0 + p[1] * wx1) >> (kXBits + kColorBits - kHBits);
+      int32_t h1 = (p[2] * wx0 + p[3] * wx1) >> (kXBits + kColorBits - kHBits);
+      int32_t v  = (h0 * wy0 + h1 * wy1 + (1 << (kHBits + kYBits - 1))) >> (kHBits + kYBits);
+      out[k]     = (uint8_t)std::min(std::max(v, 0), 255);
+    }
+#endif
+  }
+};
+
+void FillPixels(uint8_t *dst, int count, const uint8_t *fill_color, int d_chn) {
+  for (int i = 0; i < count; i++) {
+    memcpy(dst + i * d_chn, fill_color, d_chn);
+  }
+}
+
+// One frame of FusedResizeYuvToRgbaCpuCompute.
+void FusedResizeYuvToRgbaFrame(uint8_t *dst,
+                               const uint8_t *srcY,
+                               const uint8_t *srcUV,
+                               const int *roi,
+                               const uint8_t *fill_color,
+                               int s_col,
+                               int d_row_final,
+                               int d_col_final,
+                               int d_chn,
+                               int padMethod,
+                               PluginColorCvt_t color) {
+  int roi_x = roi[0];
+  int roi_y = roi[1];
+  int roi_w = roi[2];
+  int roi_h = roi[3];
+  int crop_x = 0, crop_y = 0, crop_w = 0, crop_h = 0;
+  mapRoICoords(&crop_x, &crop_w, roi_x, roi_w);
+  mapRoICoords(&crop_y, &crop_h, roi_y, roi_h);
+  // resized size and where it is placed, as the reference
+  int d_row = d_row_final, d_col = d_col_final;
+  int off_row = 0, off_col = 0;
+  if (padMethod > 0) {
+    float src_aspect_ratio = (float)roi_w / roi_h;
+    float dst_aspect_ratio = (float)d_col_final / d_row_final;
+    if (src_aspect_ratio >= dst_aspect_ratio) {
+      d_row   = std::round((float)d_col_final / roi_w * roi_h);
+      off_row = padMethod == 1 ? (d_row_final - d_row) / 2 : 0;
+    } else {
+      d_col   = std::round((float)d_row_final / roi_h * roi_w);
+      off_col = padMethod == 1 ? (d_col_final - d_col) / 2 : 0;
+    }
+  }
+  thread_local std::vector<Tap> x_taps;
+  thread_local std::vector<Tap> y_taps;
+  ComputeTaps(d_col, (float)roi_w / d_col, roi_w - 1, roi_x, crop_x, kXBits, &x_taps);
+  ComputeTaps(d_row, (float)roi_h / d_row, roi_h - 1, roi_y, crop_y, kYBits, &y_taps);
+
+  Sampler sampler;
+  sampler.u_off = (color % 2) ? 0 : 1;
+  sampler.v_off = 1 - sampler.u_off;
+  sampler.coefs = GetCvtCoefs(color);
+  // ARGB/ABGR put alpha first
+  bool alpha_first = d_chn == 4 && color > 4 && color < 9;
+  int row_bytes    = d_col_final * d_chn;
+  FillPixels(dst, off_row * d_col_final, fill_color, d_chn);
+  for (int i = 0; i < d_row; i++) {
+    const Tap &y   = y_taps[i];
+    sampler.y0     = srcY + y.p0 * s_col;
+    sampler.y1     = srcY + y.p1 * s_col;
+    sampler.uv0    = srcUV + (y.p0 / 2) * s_col;
+    sampler.uv1    = srcUV + (y.p1 / 2) * s_col;
+    uint8_t *out   = dst + (off_row + i) * row_bytes;
+    FillPixels(out, off_col, fill_color, d_chn);
+    uint8_t *pixel = out + off_col * d_chn;
+    for (int j = 0; j < d_col; j++, pixel += d_chn) {
+      uint8_t rgba[4];
+      sampler.Pixel(x_taps[j], y.w1, rgba);
+      if (alpha_first) {
+        pixel[0] = rgba[3];
+        memcpy(pixel + 1, rgba, 3);
+      } else {
+        memcpy(pixel, rgba, d_chn);
+      }
+    }
+    FillPixels(pixel, d_col_final - off_col - d_col, fill_color, d_chn);
+  }
+  FillPixels(dst + (off_row + d_row) * row_bytes, (d_row_final - off_row - d_row) * d_col_final,
+             fill_color, d_chn);
+}
+}  // namespace
+
+/*
+ * Single pass version of ResizeYuvToRgbaCpuCompute: every destination pixel samples its Y/UV
+ * neighbours, converts and interpolates them in fixed point, without crop copies or float images.
+ * Frames are contiguous in srcY (s_row x s_col), srcUV (s_row / 2 x s_col) and dst, and run on pool
+ * if it is given.
+ */
+static void FusedResizeYuvToRgbaCpuCompute(uint8_t *dst,
+                                           const uint8_t *srcY,
+                                           const uint8_t *srcUV,
+                                           const int *roiRect,
+                                           const uint8_t *fill_color,
+                                           int s_col,
+                                           int s_row,
+                                           int d_row_final,
+                                           int d_col_final,
+                                           int d_chn,
+                                           int batch_num,
+                                           int padMethod,
+                                           PluginColorCvt_t color,
+                                           ThreadPool *pool) {
+  std::vector<std::future<void>> rets;
+  for (int batchId = 0; batchId < batch_num; batchId++) {
+    auto frame = [=]() {
+      FusedResizeYuvToRgbaFrame(dst + (int64_t)batchId * d_row_final * d_col_final * d_chn,
+                                srcY + (int64_t)batchId * s_row * s_col,
+                                srcUV + (int64_t)batchId * (s_row / 2) * s_col,
+                                roiRect + batchId * 4, fill_color, s_col, d_row_final, d_col_final,
+                                d_chn, padMethod, color);
+    };
+    if (pool) {
+      rets.push_back(pool->AddTask(frame));
+    } else {
+      frame();
+    }
+  }
+  for (auto &r : rets) {
+    r.get();
+  }
+}
+
 class YUV2RGBHostArg : public ArgListBase {
   DECLARE_ARG(input_format, (int))
       ->SetDescription("Input format: 1:YUVV420SP_NV12, 2:YUV420SP_NV21")
@@ -373,9 +654,70 @@ class YUV2RGBHostArg : public ArgListBase {
       ->SetAlternative({"0", "1", "2"});
   DECLARE_ARG(rois, (std::vector<int>))
       ->SetDescription("Rois {x,y,w,h}, x+w <= uv[w], y+h <= uv[h] * 2");
+  DECLARE_ARG(threads, (int))
+      ->SetDescription("Threads across frames for the fused kernel, 0 means the calling thread.")
+      ->SetDefault({"0"});
+  DECLARE_ARG(iterations, (int))
+      ->SetDescription("Iterations to time the reference and the fused kernel.")
+      ->SetDefault({"1"});
 };
 
+/*
+ * Host check of the plugin's auxiliary data cache: misses, hits, and eviction of the least recently
+ * used entry. Entries carry tags instead of device memory, release records what would be freed.
+ */
+static bool CheckInterpDataCache() {
+  int tags[3] = {0, 1, 2};
+  std::vector<void *> released;
+  bool ok    = true;
+  auto check = [&ok](bool cond, const char *what) {
+    if (!cond) {
+      SLOG(ERROR) << "InterpDataCache check failed: " << what;
+      ok = false;
+    }
+  };
+  auto entry = [&tags](int idx) {
+    InterpDataEntry e;
+    e.mlu = &tags[idx];
+    return e;
+  };
+  // keys of one frame resized to different widths
+  auto key = [](int32_t d_col) {
+    int32_t src_shapes[2] = {64, 32};
+    int32_t src_rois[4]   = {0, 0, 32, 64};
+    int32_t dst_shapes[2] = {64, d_col};
+    int32_t dst_rois[4]   = {0, 0, d_col, 64};
+    return InterpDataCache::makeKey(src_shapes, src_rois, dst_shapes, dst_rois, 1, 0,
+                                    magicmind::PIX_FMT_NV12, magicmind::PIX_FMT_RGBA);
+  };
+  {
+    InterpDataCache cache(2, [&released](InterpDataEntry *e) { released.push_back(e->mlu); });
+    check(!cache.find(key(32)), "empty cache hits");
+    cache.insert(key(32), entry(0));
+    auto found = cache.find(key(32));
+    check(found && found->mlu == &tags[0], "inserted entry misses");
+    check(!cache.full(), "full with one of two entries");
+    cache.insert(key(48), entry(1));
+    check(cache.full(), "not full with two of two entries");
+    // key(32) becomes most recently used, so key(48) is evicted next
+    check(cache.find(key(32)) != nullptr, "first entry misses");
+    cache.insert(key(64), entry(2));
+    check(released.size() == 1 && released[0] == &tags[1],
+          "least recently used entry is not the one evicted");
+    check(!cache.find(key(48)), "evicted entry hits");
+    check(cache.find(key(32)) && cache.find(key(64)), "kept entries miss");
+    check(cache.hits() == 4 && cache.misses() == 2, "wrong hit/miss counts");
+    check(cache.size() == 2, "wrong size");
+  }
+  check(released.size() == 3, "entries left at destruction are not released");
+  return ok;
+}
+
 int main(int argc, char *argv[]) {
+  if (!CheckInterpDataCache()) {
+    return -1;
+  }
+  SLOG(INFO) << "InterpDataCache check passed.";
   auto args = ArrangeArgs(argc, argv);
   YUV2RGBHostArg arg_reader;
   arg_reader.ReadIn(args);
@@ -436,21 +778,59 @@ int main(int argc, char *argv[]) {
   }
   CHECK_VALID(WriteDataToFile("./in_roi", roi_data.data(), roi_data.size() * sizeof(int)));
   int out_offset = d_col * d_row * fill_color.size();
-  int cal_batch = 0;
-  for (size_t tidx = 0; tidx < uv_shapes.size() /* input_num */; ++tidx) {
-    int batch_num = uv_shapes[tidx][0];
-    int y_offset = y_shapes[tidx][1] * y_shapes[tidx][2];
-    int uv_offset = uv_shapes[tidx][1] * uv_shapes[tidx][2];
-    // Compute for each single batch
-    for (int batch = 0; batch < batch_num; ++batch) {
-      ResizeYuvToRgbaCpuCompute(
-          output_data.data() + cal_batch * out_offset, y_data[tidx].data() + y_offset * batch,
-          uv_data[tidx].data() + uv_offset * batch, roi_data.data() + cal_batch * 4,
-          fill_color.data(), y_shapes[tidx][2], y_shapes[tidx][1], d_row, d_col, fill_color.size(),
-          1, pad_method, color);
-      cal_batch++;
+  int iterations = std::max(1, Value(arg_reader.iterations()));
+  uint64_t start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  for (int iter = 0; iter < iterations; ++iter) {
+    int cal_batch = 0;
+    for (size_t tidx = 0; tidx < uv_shapes.size() /* input_num */; ++tidx) {
+      int batch_num = uv_shapes[tidx][0];
+      int y_offset = y_shapes[tidx][1] * y_shapes[tidx][2];
+      int uv_offset = uv_shapes[tidx][1] * uv_shapes[tidx][2];
+      // Compute for each single batch
+      for (int batch = 0; batch < batch_num; ++batch) {
+        ResizeYuvToRgbaCpuCompute(
+            output_data.data() + cal_batch * out_offset, y_data[tidx].data() + y_offset * batch,
+            uv_data[tidx].data() + uv_offset * batch, roi_data.data() + cal_batch * 4,
+            fill_color.data(), y_shapes[tidx][2], y_shapes[tidx][1], d_row, d_col,
+            fill_color.size(), 1, pad_method, color);
+        cal_batch++;
+      }
+    }
+  }
+  double reference_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0 / iterations;
+  // fused kernel, checked against the reference
+  int threads = Value(arg_reader.threads());
+  std::unique_ptr<ThreadPool> pool(threads > 0 ? new ThreadPool(threads) : nullptr);
+  std::vector<uint8_t> fused_data(output_data.size());
+  start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  for (int iter = 0; iter < iterations; ++iter) {
+    int cal_batch = 0;
+    for (size_t tidx = 0; tidx < uv_shapes.size(); ++tidx) {
+      int batch_num = uv_shapes[tidx][0];
+      FusedResizeYuvToRgbaCpuCompute(fused_data.data() + cal_batch * out_offset,
+                                     y_data[tidx].data(), uv_data[tidx].data(),
+                                     roi_data.data() + cal_batch * 4, fill_color.data(),
+                                     y_shapes[tidx][2], y_shapes[tidx][1], d_row, d_col,
+                                     fill_color.size(), batch_num, pad_method, color, pool.get());
+      cal_batch += batch_num;
     }
   }
+  double fused_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0 / iterations;
+  int max_diff = 0;
+  size_t diff_count = 0;
+  for (size_t i = 0; i < output_data.size(); ++i) {
+    int diff = std::abs(int(output_data[i]) - int(fused_data[i]));
+    max_diff = std::max(max_diff, diff);
+    diff_count += diff > 0;
+  }
+  SLOG(INFO) << "ResizeYuvToRgba cpu: reference " << reference_ms << " ms, fused " << fused_ms
+             << " ms with " << threads << " threads (" << reference_ms / fused_ms
+             << "x), max diff " << max_diff << ", " << diff_count << "/" << output_data.size()
+             << " values differ.";
+  if (max_diff > 1) {
+    SLOG(ERROR) << "Fused ResizeYuvToRgba cpu kernel differs from reference by more than 1.";
+    return -1;
+  }
   CHECK_VALID(
       WriteDataToFile("./baseline", output_data.data(), output_data.size() * sizeof(uint8_t)));
   return 0;
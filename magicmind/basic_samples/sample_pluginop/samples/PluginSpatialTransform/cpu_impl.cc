@@ -2,12 +2,21 @@
  * Copyright (C) [2020-2023] by Cambricon, Inc.
  * Description:
  *************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "mm_common.h"
 #include "mm_status.h"
 #include "common/logger.h"
 #include "common/macros.h"
 #include "common/data.h"
 #include "common/param.h"
+#include "common/threadpool.h"
+#include "common/timer.h"
 #include "third_party/half/half.h"
 static float SpatialTransformCpuForward(float *pic, float x, float y, int H, int W) {
   float res = (float)0.;
@@ -100,6 +109,270 @@ static void CpuPluginSpatialTransform(float *dst,
   }
 }
 
+namespace {
+/*
+ * Source pixel offsets (in pixels of one plane) and bilinear weights of one destination pixel, in
+ * the order SpatialTransformCpuForward adds them. Taps outside the picture get weight 0 and a valid
+ * offset, so channels can be gathered without branches.
+ */
+struct SpatialTap {
+  int32_t off[4];
+  float w[4];
+};
+
+/*
+ * Same coordinate and weight math as CpuPluginSpatialTransform and SpatialTransformCpuForward for
+ * destination pixel (_h, _w), h_ being the normalized row, so results stay bit exact.
+ */
+inline SpatialTap ComputeTap(const float *mat, float h_, int _w, int dst_w, int src_h, int src_w) {
+  float w_        = ((float)_w / (float)dst_w) * 2 - 1;
+  float reflect_h = w_ * mat[0] + h_ * mat[1] + mat[2];
+  float reflect_w = w_ * mat[3] + h_ * mat[4] + mat[5];
+  float x         = ((reflect_h + 1) / 2) * src_h;
+  float y         = ((reflect_w + 1) / 2) * src_w;
+  int m0          = std::floor(x);
+  int n0          = std::floor(y);
+  // weights along each axis are shared by two taps
+  float wx[2], wy[2];
+  bool in_x[2], in_y[2];
+  for (int j = 0; j < 2; ++j) {
+    int m   = m0 + j;
+    int n   = n0 + j;
+    in_x[j] = m >= 0 && m < src_h;
+    in_y[j] = n >= 0 && n < src_w;
+    wx[j]   = std::max((float)0, 1 - std::abs(x - m));
+    wy[j]   = std::max((float)0, 1 - std::abs(y - n));
+  }
+  SpatialTap tap;
+  for (int t = 0; t < 4; ++t) {
+    bool in    = in_x[t % 2] && in_y[t / 2];
+    tap.w[t]   = in ? wx[t % 2] * wy[t / 2] : 0;
+    tap.off[t] = in ? (m0 + t % 2) * src_w + n0 + t / 2 : 0;
+  }
+  return tap;
+}
+
+// dst/src point to channel 0 of the row/picture, channels are c_stride apart in src and dst.
+inline void GatherPixel(float *dst,
+                        const float *src,
+                        const SpatialTap &tap,
+                        int c,
+                        int pixel_stride,
+                        int64_t c_stride_src,
+                        int64_t c_stride_dst) {
+  const float *p0 = src + (int64_t)tap.off[0] * pixel_stride;
+  const float *p1 = src + (int64_t)tap.off[1] * pixel_stride;
+  const float *p2 = src + (int64_t)tap.off[2] * pixel_stride;
+  const float *p3 = src + (int64_t)tap.off[3] * pixel_stride;
+  for (int k = 0; k < c; ++k) {
+    int64_t s = k * c_stride_src;
+    dst[k * c_stride_dst] =
+        tap.w[0] * p0[s] + tap.w[1] * p1[s] + tap.w[2] * p2[s] + tap.w[3] * p3[s];
+  }
+}
+
+#if defined(__SSE2__)
+/*
+ * Row _h of a single channel picture, 4 destination pixels at a time: ComputeTap in SSE2 lanes
+ * (same operations in the same order, so still bit exact), then 4 loads per tap. Returns the
+ * number of pixels done, the rest are left to the scalar path.
+ */
+int SpatialTransformRowSSE2(float *out,
+                            const float *pic,
+                            const float *mat,
+                            float h_,
+                            int dst_w,
+                            int src_h,
+                            int src_w) {
+  const __m128 one  = _mm_set1_ps(1.f);
+  const __m128 two  = _mm_set1_ps(2.f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.f);
+  const __m128 fdw  = _mm_set1_ps((float)dst_w);
+  const __m128 fsh  = _mm_set1_ps((float)src_h);
+  const __m128 fsw  = _mm_set1_ps((float)src_w);
+  // h_ * mat[1] and h_ * mat[4] are the same for the whole row
+  const __m128 hm1  = _mm_set1_ps(h_ * mat[1]);
+  const __m128 hm4  = _mm_set1_ps(h_ * mat[4]);
+  const __m128 m0   = _mm_set1_ps(mat[0]);
+  const __m128 m2   = _mm_set1_ps(mat[2]);
+  const __m128 m3   = _mm_set1_ps(mat[3]);
+  const __m128 m5   = _mm_set1_ps(mat[5]);
+  const __m128i ione = _mm_set1_epi32(1);
+  const __m128i neg  = _mm_set1_epi32(-1);
+  const __m128i ih   = _mm_set1_epi32(src_h);
+  const __m128i iw   = _mm_set1_epi32(src_w);
+  auto floor_ps      = [](__m128 v, __m128i *i) {
+    // truncate, then step down where truncation rounded up
+    __m128i t = _mm_cvttps_epi32(v);
+    *i        = _mm_add_epi32(t, _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(t))));
+    return _mm_cvtepi32_ps(*i);
+  };
+  auto in_range = [&](__m128i v, __m128i limit) {
+    return _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(v, neg), _mm_cmplt_epi32(v, limit)));
+  };
+  auto weight = [&](__m128 v, __m128 f) {
+    return _mm_max_ps(zero, _mm_sub_ps(one, _mm_andnot_ps(sign, _mm_sub_ps(v, f))));
+  };
+  int _w = 0;
+  for (; _w + 4 <= dst_w; _w += 4) {
+    __m128 w_ = _mm_cvtepi32_ps(_mm_setr_epi32(_w, _w + 1, _w + 2, _w + 3));
+    w_        = _mm_sub_ps(_mm_mul_ps(_mm_div_ps(w_, fdw), two), one);
+    __m128 rh = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w_, m0), hm1), m2);
+    __m128 rw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w_, m3), hm4), m5);
+    __m128 x  = _mm_mul_ps(_mm_div_ps(_mm_add_ps(rh, one), two), fsh);
+    __m128 y  = _mm_mul_ps(_mm_div_ps(_mm_add_ps(rw, one), two), fsw);
+    __m128i mi0, ni0;
+    __m128 mf0  = floor_ps(x, &mi0);
+    __m128 nf0  = floor_ps(y, &ni0);
+    __m128i mi1 = _mm_add_epi32(mi0, ione);
+    __m128i ni1 = _mm_add_epi32(ni0, ione);
+    __m128 wx0  = _mm_and_ps(weight(x, mf0), in_range(mi0, ih));
+    __m128 wx1  = _mm_and_ps(weight(x, _mm_cvtepi32_ps(mi1)), in_range(mi1, ih));
+    __m128 wy0  = _mm_and_ps(weight(y, nf0), in_range(ni0, iw));
+    __m128 wy1  = _mm_and_ps(weight(y, _mm_cvtepi32_ps(ni1)), in_range(ni1, iw));
+    // taps outside the picture have weight 0 now, clamp them to a readable pixel
+    alignas(16) int32_t m[4], n[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(m), mi0);
+    _mm_store_si128(reinterpret_cast<__m128i *>(n), ni0);
+    alignas(16) float p[4][4];
+    for (int l = 0; l < 4; ++l) {
+      const float *row0 = pic + (int64_t)std::min(std::max(m[l], 0), src_h - 1) * src_w;
+      const float *row1 = pic + (int64_t)std::min(std::max(m[l] + 1, 0), src_h - 1) * src_w;
+      int c0            = std::min(std::max(n[l], 0), src_w - 1);
+      int c1            = std::min(std::max(n[l] + 1, 0), src_w - 1);
+      p[0][l]           = row0[c0];
+      p[1][l]           = row1[c0];
+      p[2][l]           = row0[c1];
+      p[3][l]           = row1[c1];
+    }
+    __m128 res = _mm_mul_ps(_mm_mul_ps(wx0, wy0), _mm_load_ps(p[0]));
+    res        = _mm_add_ps(res, _mm_mul_ps(_mm_mul_ps(wx1, wy0), _mm_load_ps(p[1])));
+    res        = _mm_add_ps(res, _mm_mul_ps(_mm_mul_ps(wx0, wy1), _mm_load_ps(p[2])));
+    res        = _mm_add_ps(res, _mm_mul_ps(_mm_mul_ps(wx1, wy1), _mm_load_ps(p[3])));
+    _mm_storeu_ps(out + _w, res);
+  }
+  return _w;
+}
+#endif
+
+// Rows [row_begin, row_end) of one picture.
+void SpatialTransformRows(float *dst,
+                          const float *src,
+                          const float *mat,
+                          int row_begin,
+                          int row_end,
+                          int dst_h,
+                          int dst_w,
+                          int src_h,
+                          int src_w,
+                          int c,
+                          bool nhwc) {
+  int64_t src_plane = (int64_t)src_h * src_w;
+  int64_t dst_plane = (int64_t)dst_h * dst_w;
+  for (int _h = row_begin; _h < row_end; ++_h) {
+    float h_ = ((float)_h / (float)dst_h) * 2 - 1;
+    int _w   = 0;
+#if defined(__SSE2__)
+    if (c == 1) {
+      _w = SpatialTransformRowSSE2(dst + (int64_t)_h * dst_w, src, mat, h_, dst_w, src_h, src_w);
+    }
+#endif
+    for (; _w < dst_w; ++_w) {
+      SpatialTap tap = ComputeTap(mat, h_, _w, dst_w, src_h, src_w);
+      if (nhwc) {
+        // channels of a pixel are contiguous
+        GatherPixel(dst + ((int64_t)_h * dst_w + _w) * c, src, tap, c, c, 1, 1);
+      } else {
+        GatherPixel(dst + (int64_t)_h * dst_w + _w, src, tap, c, 1, src_plane, dst_plane);
+      }
+    }
+  }
+}
+}  // namespace
+
+/*
+ * CpuPluginSpatialTransform computing the source coordinate and bilinear weights once per
+ * destination pixel and gathering every channel with them (channel k of a picture is sampled from
+ * channel k, unlike the loop above which always samples channel 0). Single channel rows run 4
+ * pixels at a time with SSE2 when available. mat is not modified. Rows of all pictures are split
+ * across pool if it is given.
+ */
+static void FastCpuPluginSpatialTransform(float *dst,
+                                          const float *src,
+                                          const float *mat,
+                                          const float *multable_value,
+                                          int batch_size,
+                                          int dst_h,
+                                          int dst_w,
+                                          int src_h,
+                                          int src_w,
+                                          int c,
+                                          int mat_no_broadcast,
+                                          bool nhwc,
+                                          ThreadPool *pool) {
+  CHECK_VALID(dst);
+  CHECK_VALID(src);
+  CHECK_VALID(mat);
+  // rows per task, small enough to balance a few pictures over threads
+  const int chunk = 8;
+  std::vector<std::future<void>> rets;
+  for (int i = 0; i < batch_size; i++) {
+    std::vector<float> mat_i(mat + i * 6 * mat_no_broadcast, mat + i * 6 * mat_no_broadcast + 6);
+    mat_i[0]             = multable_value[0 + i * 2];
+    mat_i[4]             = multable_value[1 + i * 2];
+    float *affined_ptr   = dst + (int64_t)i * dst_h * dst_w * c;
+    const float *src_ptr = src + (int64_t)i * src_h * src_w * c;
+    for (int row = 0; row < dst_h; row += chunk) {
+      int row_end = std::min(dst_h, row + chunk);
+      auto rows   = [=]() {
+        SpatialTransformRows(affined_ptr, src_ptr, mat_i.data(), row, row_end, dst_h, dst_w, src_h,
+                             src_w, c, nhwc);
+      };
+      if (pool) {
+        rets.push_back(pool->AddTask(rows));
+      } else {
+        rows();
+      }
+    }
+  }
+  for (auto &r : rets) {
+    r.get();
+  }
+}
+
+/*
+ * FastCpuPluginSpatialTransform on half data: input and output are converted in bulk with
+ * NormalCast around the float kernel.
+ */
+static void FastCpuPluginSpatialTransform(half_float::half *dst,
+                                          const half_float::half *src,
+                                          const float *mat,
+                                          const float *multable_value,
+                                          int batch_size,
+                                          int dst_h,
+                                          int dst_w,
+                                          int src_h,
+                                          int src_w,
+                                          int c,
+                                          int mat_no_broadcast,
+                                          bool nhwc,
+                                          ThreadPool *pool) {
+  int64_t src_count = (int64_t)batch_size * src_h * src_w * c;
+  int64_t dst_count = (int64_t)batch_size * dst_h * dst_w * c;
+  thread_local std::vector<float> src_float;
+  thread_local std::vector<float> dst_float;
+  src_float.resize(src_count);
+  dst_float.resize(dst_count);
+  CHECK_STATUS(NormalCast(src_float.data(), magicmind::DataType::FLOAT32, src,
+                          magicmind::DataType::FLOAT16, src_count, false));
+  FastCpuPluginSpatialTransform(dst_float.data(), src_float.data(), mat, multable_value,
+                                batch_size, dst_h, dst_w, src_h, src_w, c, mat_no_broadcast, nhwc,
+                                pool);
+  CHECK_STATUS(NormalCast(dst, magicmind::DataType::FLOAT16, dst_float.data(),
+                          magicmind::DataType::FLOAT32, dst_count, false));
+}
+
 class CPUSpatialTransArg : public ArgListBase {
   DECLARE_ARG(layout, (std::string))
       ->SetDescription("Input/Output layout")
@@ -110,8 +383,87 @@ class CPUSpatialTransArg : public ArgListBase {
   DECLARE_ARG(input_batches, (std::vector<int>))
       ->SetDescription("Input batches for cpu_spatial_trans.");
   DECLARE_ARG(input_dir, (std::string))->SetDescription("Input dir for cpu_spatial_trans.");
+  DECLARE_ARG(channels, (int))
+      ->SetDescription("Channels to benchmark the fast cpu path with, input is repeated on them.")
+      ->SetDefault({"1"});
+  DECLARE_ARG(threads, (int))
+      ->SetDescription("Threads for rows of the fast cpu path, 0 means the calling thread.")
+      ->SetDefault({"0"});
+  DECLARE_ARG(iterations, (int))
+      ->SetDescription("Iterations to time the reference and the fast cpu path.")
+      ->SetDefault({"1"});
 };
 
+/*
+ * Times CpuPluginSpatialTransform against FastCpuPluginSpatialTransform on input repeated to
+ * channels, and checks every channel of the fast path equals expected (the single channel
+ * reference result, in datatype precision). Returns false on mismatch.
+ */
+static bool BenchSpatialTransform(const std::vector<float> &input,
+                                  std::vector<float> mat,
+                                  std::vector<float> muta,
+                                  const std::vector<float> &expected,
+                                  int batch,
+                                  int h,
+                                  int w,
+                                  int no_broadcast,
+                                  bool nhwc,
+                                  bool is_half,
+                                  int channels,
+                                  int threads,
+                                  int iterations) {
+  int64_t plane = (int64_t)h * w;
+  int64_t count = batch * plane * channels;
+  std::vector<float> bench_input(count);
+  for (int64_t i = 0; i < count; ++i) {
+    int64_t n = i / (plane * channels);
+    int64_t p = nhwc ? (i % (plane * channels)) / channels : i % plane;
+    bench_input[i] = input[n * plane + p];
+  }
+  std::vector<float> ref_output(count);
+  uint64_t start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  for (int iter = 0; iter < iterations; ++iter) {
+    CpuPluginSpatialTransform(ref_output.data(), bench_input.data(), mat.data(), muta.data(), batch,
+                              h, w, h, w, channels, no_broadcast);
+  }
+  double ref_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0 / iterations;
+
+  std::unique_ptr<ThreadPool> pool(threads > 0 ? new ThreadPool(threads) : nullptr);
+  std::vector<float> fast_output(count);
+  double fast_ms = 0;
+  if (is_half) {
+    std::vector<half_float::half> input_half(count);
+    std::vector<half_float::half> output_half(count);
+    CHECK_STATUS(NormalCast(input_half.data(), magicmind::DataType::FLOAT16, bench_input.data(),
+                            magicmind::DataType::FLOAT32, count, false));
+    start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+    for (int iter = 0; iter < iterations; ++iter) {
+      FastCpuPluginSpatialTransform(output_half.data(), input_half.data(), mat.data(), muta.data(),
+                                    batch, h, w, h, w, channels, no_broadcast, nhwc, pool.get());
+    }
+    fast_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0 / iterations;
+    CHECK_STATUS(NormalCast(fast_output.data(), magicmind::DataType::FLOAT32, output_half.data(),
+                            magicmind::DataType::FLOAT16, count, false));
+  } else {
+    start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+    for (int iter = 0; iter < iterations; ++iter) {
+      FastCpuPluginSpatialTransform(fast_output.data(), bench_input.data(), mat.data(), muta.data(),
+                                    batch, h, w, h, w, channels, no_broadcast, nhwc, pool.get());
+    }
+    fast_ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0 / iterations;
+  }
+  int64_t mismatch = 0;
+  for (int64_t i = 0; i < count; ++i) {
+    int64_t n = i / (plane * channels);
+    int64_t p = nhwc ? (i % (plane * channels)) / channels : i % plane;
+    mismatch += fast_output[i] != expected[n * plane + p];
+  }
+  SLOG(INFO) << "SpatialTransform cpu with " << channels << " channels: reference " << ref_ms
+             << " ms, fast " << fast_ms << " ms with " << threads << " threads ("
+             << ref_ms / fast_ms << "x), " << mismatch << "/" << count << " values differ.";
+  return mismatch == 0;
+}
+
 int main(int argc, char *argv[]) {
   auto args = ArrangeArgs(argc, argv);
   CPUSpatialTransArg arg_reader;
@@ -120,6 +472,9 @@ int main(int argc, char *argv[]) {
   auto datatype = Value(arg_reader.datatype());
   auto input_batches = Value(arg_reader.input_batches());
   auto input_dir = Value(arg_reader.input_dir());
+  auto channels = std::max(1, Value(arg_reader.channels()));
+  auto threads = Value(arg_reader.threads());
+  auto iterations = std::max(1, Value(arg_reader.iterations()));
 
   /*
    *  in/out hw must be 40, 180
@@ -147,6 +502,8 @@ int main(int argc, char *argv[]) {
   CHECK_VALID(
       ReadDataFromFile(input_dir + "/input3_fp32.bin", muta.data(), muta.size() * sizeof(float)));
   std::vector<float> output(input_batches[0] * 40 * 180);
+  // output in datatype precision, to check the fast path
+  std::vector<float> expected;
   if (datatype == "half") {
     // cvt float-half-float to simulate half cast precision loss
     std::vector<half_float::half> input_half(input_batches[0] * 40 * 180);
@@ -180,6 +537,9 @@ int main(int argc, char *argv[]) {
                             magicmind::DataType::FLOAT32, output.size(), false));
     CHECK_VALID(WriteDataToFile("./baseline", output_half.data(),
                                 output_half.size() * sizeof(half_float::half)));
+    expected.resize(output.size());
+    CHECK_STATUS(NormalCast(expected.data(), magicmind::DataType::FLOAT32, output_half.data(),
+                            magicmind::DataType::FLOAT16, output.size(), false));
   } else {
     CHECK_VALID(WriteDataToFile("./input_data", input.data(), input.size() * sizeof(float)));
     CHECK_VALID(WriteDataToFile("./mat_data", mat.data(), mat.size() * sizeof(float)));
@@ -187,6 +547,12 @@ int main(int argc, char *argv[]) {
     CpuPluginSpatialTransform(output.data(), input.data(), mat.data(), muta.data(),
                               input_batches[0], 40, 180, 40, 180, 1, no_broadcast);
     CHECK_VALID(WriteDataToFile("./baseline", output.data(), output.size() * sizeof(float)));
+    expected = output;
+  }
+  if (!BenchSpatialTransform(input, mat, muta, expected, input_batches[0], 40, 180, no_broadcast,
+                             layout == "NHWC", datatype == "half", channels, threads, iterations)) {
+    SLOG(ERROR) << "Fast SpatialTransform cpu path differs from reference.";
+    return -1;
   }
   return 0;
 }
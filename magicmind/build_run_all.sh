@@ -27,6 +27,7 @@ build_all() {
     if [[ ! "${PATH[@]}" =~ "${SAMPLE_HOME}/tools/diff/build" ]]; then
       export PATH=${SAMPLE_HOME}/tools/diff/build:$PATH
     fi
+    source ${SAMPLE_HOME}/build_template.sh ${SAMPLE_HOME}/tools/host_check
     source ${BASIC_SAMPLE_HOME}/build.sh
     #mm_build
     source ${SAMPLE_HOME}/build_template.sh ${SAMPLE_HOME}/mm_build
@@ -50,6 +51,10 @@ run_all() {
   if [ -L "model" ] || [ -d "model" ]; then
     MODEL_PATH=${SAMPLE_HOME}/model
   fi
+  #tools
+  if [ -x ${SAMPLE_HOME}/tools/host_check/build/host_check ]; then
+    ${SAMPLE_HOME}/tools/host_check/build/host_check
+  fi
   #basic_samples
   if [ ${MODEL_PATH} ]; then
     python3 ${SAMPLE_HOME}/tools/preprocess/preprocess.py --framework caffe --image_path ${IMAGE_DATA} --save_path ${SAMPLE_HOME}/processed_data --labels ${BASIC_SAMPLE_HOME}/sample_calibration/sample_labels.txt -n 10 -m resnet50
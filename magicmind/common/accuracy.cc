@@ -0,0 +1,43 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Batched top1/top5 classification accuracy on flat output buffers.
+ *************************************************************************/
+#include <iomanip>
+#include <sstream>
+#include "common/accuracy.h"
+
+void TopKAccuracy::Merge(const TopKAccuracy &other) {
+  CHECK_EQ(class_total.size(), other.class_total.size());
+  samples += other.samples;
+  top1 += other.top1;
+  top5 += other.top5;
+  invalid_label += other.invalid_label;
+  for (size_t i = 0; i < class_total.size(); ++i) {
+    class_total[i] += other.class_total[i];
+    class_top1[i] += other.class_top1[i];
+    class_top5[i] += other.class_top5[i];
+  }
+}
+
+std::string TopKAccuracy::DebugString(bool per_class) const {
+  std::stringstream ret;
+  ret << std::fixed << std::setprecision(4);
+  ret << "Samples: " << samples << ", top1: " << Top1() << " (" << top1 << "), top5: " << Top5()
+      << " (" << top5 << ")";
+  if (invalid_label) {
+    ret << ", invalid labels: " << invalid_label;
+  }
+  ret << "\n";
+  if (!per_class) {
+    return ret.str();
+  }
+  ret << "Class\tSamples\tTop1\tTop5\n";
+  for (size_t i = 0; i < class_total.size(); ++i) {
+    if (!class_total[i]) {
+      continue;
+    }
+    ret << i << "\t" << class_total[i] << "\t" << double(class_top1[i]) / class_total[i] << "\t"
+        << double(class_top5[i]) / class_total[i] << "\n";
+  }
+  return ret.str();
+}
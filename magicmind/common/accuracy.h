@@ -0,0 +1,211 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Batched top1/top5 classification accuracy on flat output buffers.
+ *************************************************************************/
+#ifndef ACCURACY_H_
+#define ACCURACY_H_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <future>
+#include <algorithm>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "common/macros.h"
+#include "common/threadpool.h"
+/*
+ * A non-owning view of count elements at data, to pass outputs without copying them.
+ */
+template <typename T>
+struct Span {
+  Span() = default;
+  Span(const T *d, size_t n) : data(d), size(n) {}
+  Span(const std::vector<T> &v) : data(v.data()), size(v.size()) {}  // NOLINT
+  const T *data = nullptr;
+  size_t size   = 0;
+};
+/*
+ * Accumulated top1/top5 hits, overall and for each class (indexed by label).
+ * Results of disjoint sample ranges can be merged.
+ */
+struct TopKAccuracy {
+  explicit TopKAccuracy(size_t num_classes = 0)
+      : class_total(num_classes, 0), class_top1(num_classes, 0), class_top5(num_classes, 0) {}
+  void Merge(const TopKAccuracy &other);
+  double Top1() const { return samples ? double(top1) / samples : 0; }
+  double Top5() const { return samples ? double(top5) / samples : 0; }
+  /*
+   * Overall accuracy in one line, and per class accuracy for each class with samples.
+   */
+  std::string DebugString(bool per_class = true) const;
+
+  int64_t samples       = 0;
+  int64_t top1          = 0;
+  int64_t top5          = 0;
+  int64_t invalid_label = 0;  // labels out of [0, num_classes), counted as misses
+  std::vector<int64_t> class_total;
+  std::vector<int64_t> class_top1;
+  std::vector<int64_t> class_top5;
+};
+/*
+ * To return how many elements of src[0, n) rank before src[idx]: greater values, and equal values
+ * at lower indices. src[idx] is in topk iff the rank < k, which needs one streaming pass and no
+ * sort. Ties resolve to the lower index, the same as an argmax taking the first max.
+ */
+template <typename T>
+struct RankOf {
+  static int64_t Run(const T *src, int64_t n, int64_t idx) {
+    const T v     = src[idx];
+    int64_t count = 0;
+    for (int64_t i = 0; i < idx; ++i) {
+      count += (src[i] >= v);
+    }
+    for (int64_t i = idx + 1; i < n; ++i) {
+      count += (src[i] > v);
+    }
+    return count;
+  }
+};
+
+#if defined(__SSE__)
+/*
+ * Float rank counting compares 4 lanes at once and sums the masks.
+ */
+template <>
+struct RankOf<float> {
+  static int64_t Run(const float *src, int64_t n, int64_t idx) {
+    const float v   = src[idx];
+    const __m128 vv = _mm_set1_ps(v);
+    int64_t count   = 0;
+    int64_t i       = 0;
+    int64_t i4      = idx / 4 * 4;
+    for (; i < i4; i += 4) {
+      count += __builtin_popcount(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(src + i), vv)));
+    }
+    for (; i < idx; ++i) {
+      count += (src[i] >= v);
+    }
+    for (i = idx + 1; i < n && (i & 3); ++i) {
+      count += (src[i] > v);
+    }
+    int64_t n4 = i + (n - i) / 4 * 4;
+    for (; i < n4; i += 4) {
+      count += __builtin_popcount(_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(src + i), vv)));
+    }
+    for (; i < n; ++i) {
+      count += (src[i] > v);
+    }
+    return count;
+  }
+};
+#endif  // __SSE__
+/*
+ * To accumulate samples [begin, end) of a strided output buffer into acc.
+ * Sample i has num_classes scores at outputs + i * stride.
+ */
+template <typename T>
+void AccumulateTop1Top5(const T *outputs,
+                        int64_t stride,
+                        int64_t num_classes,
+                        const int *labels,
+                        int64_t begin,
+                        int64_t end,
+                        TopKAccuracy *acc) {
+  for (int64_t i = begin; i < end; ++i) {
+    ++acc->samples;
+    int label = labels[i];
+    if (label < 0 || label >= num_classes) {
+      ++acc->invalid_label;
+      continue;
+    }
+    int64_t rank = RankOf<T>::Run(outputs + i * stride, num_classes, label);
+    bool hit1    = rank < 1;
+    bool hit5    = rank < 5;
+    acc->top1 += hit1;
+    acc->top5 += hit5;
+    ++acc->class_total[label];
+    acc->class_top1[label] += hit1;
+    acc->class_top5[label] += hit5;
+  }
+}
+/*
+ * To evaluate top1/top5 of num_samples outputs in one flat buffer, e.g., a batched network output
+ * of [N, num_classes] (stride == num_classes) or a padded one (stride > num_classes).
+ * Samples are split into threads continuous ranges and evaluated on a threadpool.
+ */
+template <typename T>
+TopKAccuracy EvaluateTop1Top5(const T *outputs,
+                              int64_t num_samples,
+                              int64_t num_classes,
+                              int64_t stride,
+                              const int *labels,
+                              int threads = 1) {
+  CHECK_LE(num_classes, stride);
+  TopKAccuracy ret(num_classes);
+  // every sample costs one pass over num_classes, keep some work for each thread
+  const int64_t kMinPerThread = 256;
+  int64_t parts = std::min<int64_t>(std::max(threads, 1), num_samples / kMinPerThread);
+  if (parts <= 1) {
+    AccumulateTop1Top5(outputs, stride, num_classes, labels, 0, num_samples, &ret);
+    return ret;
+  }
+  std::vector<TopKAccuracy> accs(parts, TopKAccuracy(num_classes));
+  std::vector<std::future<void>> rets;
+  ThreadPool pool(parts);
+  int64_t step = (num_samples + parts - 1) / parts;
+  for (int64_t p = 0; p < parts; ++p) {
+    int64_t begin = std::min(num_samples, p * step);
+    int64_t end   = std::min(num_samples, begin + step);
+    rets.push_back(pool.AddTask(AccumulateTop1Top5<T>, outputs, stride, num_classes, labels, begin,
+                                end, &accs[p]));
+  }
+  for (int64_t p = 0; p < parts; ++p) {
+    rets[p].get();
+    ret.Merge(accs[p]);
+  }
+  return ret;
+}
+/*
+ * Spans version for outputs which are not in one buffer. All spans must hold num_classes scores.
+ */
+template <typename T>
+TopKAccuracy EvaluateTop1Top5(const std::vector<Span<T>> &outputs,
+                              const std::vector<int> &labels,
+                              int threads = 1) {
+  CHECK_EQ(outputs.size(), labels.size());
+  if (outputs.empty()) {
+    return TopKAccuracy();
+  }
+  const size_t num_classes = outputs[0].size;
+  TopKAccuracy ret(num_classes);
+  int64_t parts = std::min<int64_t>(std::max(threads, 1), outputs.size() / 256);
+  parts         = std::max<int64_t>(parts, 1);
+  std::vector<TopKAccuracy> accs(parts, TopKAccuracy(num_classes));
+  auto accumulate = [&outputs, &labels, num_classes](size_t begin, size_t end,
+                                                     TopKAccuracy *acc) {
+    for (size_t i = begin; i < end; ++i) {
+      CHECK_EQ(outputs[i].size, num_classes);
+      AccumulateTop1Top5(outputs[i].data, 0, num_classes, &labels[i], 0, 1, acc);
+    }
+  };
+  size_t step = (outputs.size() + parts - 1) / parts;
+  if (parts == 1) {
+    accumulate(0, outputs.size(), &ret);
+    return ret;
+  }
+  std::vector<std::future<void>> rets;
+  ThreadPool pool(parts);
+  for (int64_t p = 0; p < parts; ++p) {
+    size_t begin = std::min(outputs.size(), p * step);
+    size_t end   = std::min(outputs.size(), begin + step);
+    rets.push_back(pool.AddTask(accumulate, begin, end, &accs[p]));
+  }
+  for (int64_t p = 0; p < parts; ++p) {
+    rets[p].get();
+    ret.Merge(accs[p]);
+  }
+  return ret;
+}
+
+#endif  // ACCURACY_H_
@@ -7,6 +7,8 @@
 #include "common/logger.h"
 #include "common/data.h"
 #include "common/macros.h"
+#include "common/random.h"
+#include "common/type.h"
 
 namespace {
 static std::map<magicmind::TensorLocation, std::string> kTensorLocationMap{
@@ -155,6 +157,40 @@ void Buffers::FillIn(const std::vector<std::string> &path) {
   }
 }
 
+void Buffers::FillRand(float min, float max, uint64_t seed) {
+  ReInit();
+  int threads = std::max<int>(1, kThreadPoolDefaultNum);
+  for (size_t i = 0, buf_idx = 0; i < tensors_.size(); ++i, ++buf_idx) {
+    while (!buffers_[buf_idx]->on_use_) {
+      ++buf_idx;
+    }
+    auto data_type = tensors_[i]->GetDataType();
+    void *dst      = buffers_[buf_idx]->host_addr();
+    uint64_t count = tensors_[i]->GetSize() / DataTypeSize(data_type);
+#define CASE(type)                                                                       \
+  case DataTypeToEnum<type>::value: {                                                    \
+    ::FillRand<type>(static_cast<type *>(dst), count, ClampBound<type>(min),             \
+                     ClampBound<type>(max), seed, 0, threads);                           \
+    break;                                                                               \
+  }
+    switch (data_type) {
+      CASE(int8_t);
+      CASE(int16_t);
+      CASE(int32_t);
+      CASE(uint8_t);
+      CASE(uint16_t);
+      CASE(uint32_t);
+      CASE(half);
+      CASE(float);
+      default:
+        SLOG(WARNING) << "Unsupport datatype for random input " << name_ << ": "
+                      << tensors_[i]->GetName() << ", left uninitialized.";
+        break;
+    }
+#undef CASE
+  }
+}
+
 void Buffers::FillOut(const std::string &path) {
   for (size_t i = 0, buf_idx = 0; i < tensors_.size(); ++i, ++buf_idx) {
     while (!buffers_[buf_idx]->on_use_) {
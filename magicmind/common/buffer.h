@@ -57,6 +57,11 @@ class Buffers {
    * Recorded buffers will be free and remalloc if size is not enough.
    */
   void FillIn(const std::vector<std::string> &path);
+  /*
+   * To fill host buffers with uniform random data in [min, max] of stream seed.
+   * Each tensor is filled in its own datatype, without extra host copies.
+   */
+  void FillRand(float min, float max, uint64_t seed);
   /*
    * To write buffers out to path/output[idx].
    */
@@ -0,0 +1,207 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Content addressed on-disk cache for packed calibration batches.
+ *************************************************************************/
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common/logger.h"
+#include "common/calib_cache.h"
+
+namespace {
+const char kMagic[8]      = {'M', 'M', 'C', 'A', 'L', 'I', 'B', '1'};
+const uint64_t kAlignment = 64;
+
+struct Header {
+  char magic[8];
+  uint64_t key;
+  uint64_t count;
+  uint64_t index_offset;
+};
+
+uint64_t Fnv1a(uint64_t hash, const void *data, size_t size) {
+  auto p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t Fnv1a(uint64_t hash, const T &value) {
+  return Fnv1a(hash, &value, sizeof(T));
+}
+
+uint64_t Fnv1a(uint64_t hash, const std::string &value) {
+  hash = Fnv1a(hash, value.size());
+  return Fnv1a(hash, value.data(), value.size());
+}
+}  // namespace
+
+CalibCache::~CalibCache() {
+  Close();
+  if (writer_) {
+    fclose(writer_);
+    remove(tmp_.c_str());
+  }
+}
+
+bool CalibCache::ComputeKey(const std::string &dtype,
+                            const std::vector<std::vector<int64_t>> &shapes,
+                            const std::vector<std::string> &paths,
+                            uint64_t *key) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash          = Fnv1a(hash, dtype);
+  hash          = Fnv1a(hash, shapes.size());
+  for (auto &e_ : shapes) {
+    hash = Fnv1a(hash, e_.size());
+    hash = Fnv1a(hash, e_.data(), e_.size() * sizeof(int64_t));
+  }
+  hash = Fnv1a(hash, paths.size());
+  for (auto &e_ : paths) {
+    struct stat st;
+    if (stat(e_.c_str(), &st) != 0) {
+      SLOG(ERROR) << "Stat calibration file " << e_ << " failed.";
+      return false;
+    }
+    hash = Fnv1a(hash, e_);
+    hash = Fnv1a(hash, static_cast<int64_t>(st.st_size));
+    hash = Fnv1a(hash, static_cast<int64_t>(st.st_mtim.tv_sec));
+    hash = Fnv1a(hash, static_cast<int64_t>(st.st_mtim.tv_nsec));
+  }
+  *key = hash;
+  return true;
+}
+
+std::string CalibCache::CachePath(const std::string &dir, uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "calib_%016llx.bin", static_cast<unsigned long long>(key));
+  return dir + "/" + name;
+}
+
+bool CalibCache::Open(const std::string &path, uint64_t key) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return false;
+  }
+  void *ptr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<char *>(ptr);
+  size_ = st.st_size;
+  Header header;
+  memcpy(&header, base_, sizeof(Header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) || header.key != key ||
+      header.index_offset + header.count * sizeof(Record) > size_) {
+    SLOG(WARNING) << "Calibration cache " << path << " mismatch, ignored.";
+    Close();
+    return false;
+  }
+  for (uint64_t i = 0; i < header.count; ++i) {
+    Record r;
+    memcpy(&r, base_ + header.index_offset + i * sizeof(Record), sizeof(Record));
+    if (r.offset + r.size > header.index_offset) {
+      SLOG(WARNING) << "Calibration cache " << path << " broken, ignored.";
+      Close();
+      return false;
+    }
+    index_[std::make_pair(r.shape_idx, r.sample)] = r;
+  }
+  madvise(base_, size_, MADV_WILLNEED);
+  key_ = key;
+  return true;
+}
+
+void *CalibCache::Find(int shape_idx, int sample, uint64_t size) const {
+  auto iter = index_.find(std::make_pair(shape_idx, sample));
+  if (iter == index_.end() || iter->second.size != size) {
+    return nullptr;
+  }
+  return base_ + iter->second.offset;
+}
+
+bool CalibCache::Create(const std::string &path, uint64_t key) {
+  if (writer_) {
+    fclose(writer_);
+  }
+  // builds of several variants may record the same key at once, each into its own file
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".tmp.%d.%p", int(getpid()), static_cast<void *>(this));
+  path_   = path;
+  tmp_    = path + suffix;
+  key_    = key;
+  writer_ = fopen(tmp_.c_str(), "wb");
+  if (!writer_) {
+    SLOG(WARNING) << "Create calibration cache " << path << " failed.";
+    return false;
+  }
+  records_.clear();
+  Header header;
+  memset(&header, 0, sizeof(Header));
+  offset_ = fwrite(&header, 1, sizeof(Header), writer_);
+  return offset_ == sizeof(Header);
+}
+
+bool CalibCache::Append(int shape_idx, int sample, const void *data, uint64_t size) {
+  if (!writer_) {
+    return false;
+  }
+  static const char kPad[kAlignment] = {0};
+  uint64_t pad = (kAlignment - offset_ % kAlignment) % kAlignment;
+  if (fwrite(kPad, 1, pad, writer_) != pad || fwrite(data, 1, size, writer_) != size) {
+    SLOG(WARNING) << "Write calibration cache " << path_ << " failed.";
+    fclose(writer_);
+    writer_ = nullptr;
+    remove(tmp_.c_str());
+    return false;
+  }
+  offset_ += pad;
+  records_.push_back({shape_idx, sample, offset_, size});
+  offset_ += size;
+  return true;
+}
+
+bool CalibCache::Finish() {
+  if (!writer_) {
+    return false;
+  }
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.key          = key_;
+  header.count        = records_.size();
+  header.index_offset = offset_;
+  bool ret = fwrite(records_.data(), sizeof(Record), records_.size(), writer_) == records_.size();
+  ret      = ret && fseek(writer_, 0, SEEK_SET) == 0;
+  ret      = ret && fwrite(&header, 1, sizeof(Header), writer_) == sizeof(Header);
+  ret      = (fclose(writer_) == 0) && ret;
+  writer_  = nullptr;
+
+  if (!ret || rename(tmp_.c_str(), path_.c_str()) != 0) {
+    SLOG(WARNING) << "Finish calibration cache " << path_ << " failed.";
+    remove(tmp_.c_str());
+    return false;
+  }
+  SLOG(INFO) << "Calibration cache saved to " << path_ << " with " << records_.size()
+             << " batches.";
+  return true;
+}
+
+void CalibCache::Close() {
+  if (base_) {
+    munmap(base_, size_);
+  }
+  base_ = nullptr;
+  size_ = 0;
+  index_.clear();
+}
@@ -0,0 +1,83 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Content addressed on-disk cache for packed calibration batches.
+ *************************************************************************/
+#ifndef CALIB_CACHE_H_
+#define CALIB_CACHE_H_
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+/*
+ * CalibCache stores calibration batches exactly as SampleCalibData hands them to the calibrator,
+ * packed in one file per key, so builds of the same network with other precisions/archs can map
+ * them instead of opening and reading every source file again.
+ *
+ * The key covers datatype, shapes and every source file's path, size and mtime, so the cache is
+ * invalidated by any change of those; a changed key just names another cache file.
+ *
+ * File layout: header | batch data ... | index of (shape_idx, sample, offset, size).
+ */
+class CalibCache {
+ public:
+  CalibCache() = default;
+  ~CalibCache();
+  /*
+   * To compute the cache key. Returns false if a source file can not be stat.
+   */
+  static bool ComputeKey(const std::string &dtype,
+                         const std::vector<std::vector<int64_t>> &shapes,
+                         const std::vector<std::string> &paths,
+                         uint64_t *key);
+  /*
+   * Cache file path for key under dir.
+   */
+  static std::string CachePath(const std::string &dir, uint64_t key);
+  /*
+   * To map an existing cache file for reading. Returns false if it does not exist or mismatch.
+   */
+  bool Open(const std::string &path, uint64_t key);
+  /*
+   * To find one batch in a opened cache. Data is mapped private, so callers may write it.
+   * Returns nullptr on miss.
+   */
+  void *Find(int shape_idx, int sample, uint64_t size) const;
+  /*
+   * To start recording batches into a new cache file, which is visible under path only after
+   * Finish succeeds.
+   */
+  bool Create(const std::string &path, uint64_t key);
+  bool Append(int shape_idx, int sample, const void *data, uint64_t size);
+  bool Finish();
+
+  bool Opened() const { return base_ != nullptr; }
+  bool Recording() const { return writer_ != nullptr; }
+
+ private:
+  CalibCache(const CalibCache &) = delete;
+  CalibCache &operator=(const CalibCache &) = delete;
+  void Close();
+
+ private:
+  struct Record {
+    int32_t shape_idx;
+    int32_t sample;
+    uint64_t offset;
+    uint64_t size;
+  };
+  uint64_t key_ = 0;
+  // reading
+  char *base_    = nullptr;
+  uint64_t size_ = 0;
+  std::map<std::pair<int, int>, Record> index_;
+  // recording
+  FILE *writer_ = nullptr;
+  std::string path_;
+  std::string tmp_;
+  uint64_t offset_ = 0;
+  std::vector<Record> records_;
+};
+
+#endif  // CALIB_CACHE_H_
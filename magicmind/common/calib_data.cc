@@ -2,10 +2,14 @@
  * Copyright (C) [2020-2023] by Cambricon, Inc.
  * Description: Derived implements for CalibDataInterface.
  *************************************************************************/
+#include <algorithm>
+#include <sstream>
 #include "common/calib_data.h"
 #include "common/data.h"
 #include "common/logger.h"
 #include "common/macros.h"
+#include "common/random.h"
+#include "common/timer.h"
 #include "common/type.h"
 
 SampleCalibData::SampleCalibData(const magicmind::Dims &shape,
@@ -43,53 +47,238 @@ SampleCalibData::SampleCalibData(const magicmind::Dims &shape,
 }
 
 void SampleCalibData::Init() {
-  CHECK_LE(0, shapes_.size());
-  size_t max_size = 0;
+  CHECK_LE(1, shapes_.size());
   for (auto shape : shapes_) {
-    auto batch_size = shape.GetDimValue(0);
-    CHECK_LE(0, batch_size);
-    batch_sizes_.push_back(batch_size);
-    size_t size = DataTypeSize(data_type_) * shape.GetElementCount();
-    CHECK_LE(0, size);
-    max_size = max_size >= size ? max_size : size;
+    CHECK_LE(1, shape.GetDimsNum());
+    CHECK_LE(0, shape.GetDimValue(0));
   }
-  buffer_ = malloc(max_size);
+  BuildSteps({}, {});
+}
+
+void SampleCalibData::BuildSteps(const std::vector<int> &batch_sizes,
+                                 const std::vector<float> &ratios) {
+  steps_.clear();
+  if (shapes_.size() == 1) {
+    // static shape reads one batch of files each step, random data fills one batch
+    int batch_size = shapes_.front().GetDimValue(0);
+    int limit      = use_rand_ ? max_samples_ : std::min<int>(max_samples_, data_paths_.size());
+    for (int sample = 0; batch_size > 0 && sample + batch_size <= limit; sample += batch_size) {
+      Step step;
+      step.sample = sample;
+      step.shape  = shapes_.front();
+      for (int i = 0; !use_rand_ && i < batch_size; ++i) {
+        step.files.push_back(sample + i);
+      }
+      steps_.push_back(step);
+    }
+  } else {
+    // dynamic shapes read one file of its own shape each step, unless files are packed
+    int limit = std::min<int>({max_samples_, int(shapes_.size()), int(data_paths_.size())});
+    std::vector<std::vector<int64_t>> group_dims;
+    std::vector<std::vector<int>> group_files;
+    for (int i = 0; i < limit; ++i) {
+      auto dims = shapes_[i].GetDims();
+      dims.erase(dims.begin());
+      auto iter = std::find(group_dims.begin(), group_dims.end(), dims);
+      if (iter == group_dims.end()) {
+        group_dims.push_back(dims);
+        group_files.push_back({});
+        iter = group_dims.end() - 1;
+      }
+      group_files[iter - group_dims.begin()].push_back(i);
+    }
+    int groups = group_dims.size();
+    if (!batch_sizes.empty()) {
+      CHECK_VALID(batch_sizes.size() == 1 || int(batch_sizes.size()) == groups);
+    }
+    if (!ratios.empty()) {
+      CHECK_VALID(ratios.size() == 1 || int(ratios.size()) == groups);
+    }
+    // pack consecutive files of each group while the highest dimension fits its batch size
+    std::vector<std::vector<Step>> group_steps(groups);
+    for (int g = 0; g < groups; ++g) {
+      int64_t batch_size = 0;
+      if (!batch_sizes.empty()) {
+        batch_size = batch_sizes.size() == 1 ? batch_sizes[0] : batch_sizes[g];
+      }
+      for (auto file : group_files[g]) {
+        int64_t dim0 = shapes_[file].GetDimValue(0);
+        auto &last   = group_steps[g];
+        if (last.empty() || last.back().shape.GetDimValue(0) + dim0 > batch_size) {
+          Step step;
+          step.shape_idx = batch_sizes.empty() ? file : g;
+          step.sample    = file;
+          step.shape     = shapes_[file];
+          step.files     = {file};
+          last.push_back(step);
+          continue;
+        }
+        auto dims = last.back().shape.GetDims();
+        dims[0] += dim0;
+        last.back().shape = magicmind::Dims(dims);
+        last.back().files.push_back(file);
+      }
+    }
+    if (batch_sizes.empty() && ratios.empty()) {
+      // one file each step in file order
+      for (int i = 0; i < limit; ++i) {
+        for (int g = 0; g < groups; ++g) {
+          if (!group_steps[g].empty() && group_steps[g].front().sample == i) {
+            steps_.push_back(group_steps[g].front());
+            group_steps[g].erase(group_steps[g].begin());
+          }
+        }
+      }
+    } else {
+      // smooth weighted round robin over groups with steps left, e.g. 2,1 gives g0 g1 g0 g0 ...
+      std::vector<double> weights(groups, 1);
+      for (int g = 0; g < groups && !ratios.empty(); ++g) {
+        weights[g] = ratios.size() == 1 ? ratios[0] : ratios[g];
+        CHECK_LE(0, weights[g]);
+      }
+      std::vector<double> current(groups, 0);
+      std::vector<size_t> next(groups, 0);
+      while (true) {
+        int pick     = -1;
+        double total = 0;
+        for (int g = 0; g < groups; ++g) {
+          if (weights[g] <= 0 || next[g] == group_steps[g].size()) {
+            continue;
+          }
+          current[g] += weights[g];
+          total += weights[g];
+          if (pick < 0 || current[g] > current[pick]) {
+            pick = g;
+          }
+        }
+        if (pick < 0) {
+          break;
+        }
+        current[pick] -= total;
+        steps_.push_back(group_steps[pick][next[pick]++]);
+      }
+    }
+  }
+  // one buffer pair for the largest step, so no step allocates
+  size_t max_size = 0;
+  for (int i = 0; i < int(steps_.size()); ++i) {
+    max_size = std::max<size_t>(max_size, StepBytes(i));
+  }
+  if (max_size > buffer_size_) {
+    free(buffer_);
+    free(back_buffer_);
+    buffer_      = malloc(max_size);
+    back_buffer_ = use_rand_ ? nullptr : malloc(max_size);
+    buffer_size_ = max_size;
+  }
+}
+
+SampleCalibData::~SampleCalibData() {
+  WaitPrefetch();
+  prefetcher_.reset();
+  readers_.reset();
+  if (cache_ && cache_->Recording()) {
+    cache_->Finish();
+  }
+  if (files_read_ || cache_hits_) {
+    SLOG(INFO) << IOStatsString();
+  }
+  free(buffer_);
+  free(back_buffer_);
+}
+
+void SampleCalibData::SetCacheDir(const std::string &dir) {
+  if (use_rand_ || dir.empty()) {
+    return;
+  }
+  std::vector<std::vector<int64_t>> shapes;
+  for (auto e_ : shapes_) {
+    shapes.push_back(e_.GetDims());
+  }
+  uint64_t key = 0;
+  if (!CalibCache::ComputeKey(TypeEnumToString(data_type_), shapes, data_paths_, &key)) {
+    SLOG(WARNING) << "Calibration cache disabled.";
+    return;
+  }
+  auto path = CalibCache::CachePath(dir, key);
+  cache_.reset(new CalibCache());
+  if (cache_->Open(path, key)) {
+    SLOG(INFO) << "Calibration batches are mapped from cache " << path;
+  } else if (!cache_->Create(path, key)) {
+    cache_.reset();
+  }
+}
+
+void SampleCalibData::SetDynamicBatching(const std::vector<int> &batch_sizes,
+                                         const std::vector<float> &ratios) {
+  if (shapes_.size() == 1) {
+    SLOG(WARNING) << "Dynamic batching is only for calibration files with dynamic shapes, ignored.";
+    return;
+  }
+  WaitPrefetch();
+  BuildSteps(batch_sizes, ratios);
+  current_step_ = -1;
+  SLOG(INFO) << "Calibration packs " << data_paths_.size() << " files into " << steps_.size()
+             << " batches.";
+}
+
+void SampleCalibData::SetIOOptions(int io_threads, bool verbose) {
+  WaitPrefetch();
+  prefetcher_.reset();
+  readers_.reset();
+  io_threads_ = io_threads < 0 ? 0 : io_threads;
+  verbose_    = verbose;
+}
+
+std::string SampleCalibData::IOStatsString() const {
+  std::stringstream ret;
+  double read_ms = read_us_ / 1000.0;
+  double wait_ms = wait_us_ / 1000.0;
+  double mb      = bytes_read_ / 1024.0 / 1024.0;
+  ret << "Calibration I/O: " << batches_ << " batches, " << files_read_ << " files, " << mb
+      << " MB, read " << read_ms << " ms (" << (read_ms > 0 ? mb / read_ms * 1000 : 0)
+      << " MB/s), Next waited " << wait_ms << " ms ("
+      << (read_ms > 0 ? 100 * (1 - std::min(1.0, wait_ms / read_ms)) : 0)
+      << "% of reading hidden by prefetch)";
+  if (cache_) {
+    ret << ", " << cache_hits_ << " batches mapped from cache";
+  }
+  ret << ".";
+  return ret.str();
 }
 
 magicmind::Dims SampleCalibData::GetShape() const {
-  if (current_shape_idx_ == -1) {
+  if (current_step_ < 0 || current_step_ >= int(steps_.size())) {
     return magicmind::Dims();
   }
-  return shapes_[current_shape_idx_];
+  return steps_[current_step_].shape;
 }
 
 magicmind::DataType SampleCalibData::GetDataType() const {
   return data_type_;
 }
 
-void SampleCalibData::MoveShapeNext() {
-  if (shapes_.size() > 1) {
-    current_shape_idx_ = (current_shape_idx_ + 1) == int(batch_sizes_.size()) ? -1 : current_shape_idx_ + 1;
-  } else {
-    current_shape_idx_ = 0;
+uint64_t SampleCalibData::FileBytes(int step_idx, int file) const {
+  if (shapes_.size() == 1) {
+    // several files fill one batch of static shape
+    return StepBytes(step_idx) / steps_[step_idx].files.size();
   }
+  // one file for one sample of its own shape
+  return shapes_[file].GetElementCount() * DataTypeSize(data_type_);
+}
+
+uint64_t SampleCalibData::StepBytes(int step_idx) const {
+  return steps_[step_idx].shape.GetElementCount() * DataTypeSize(data_type_);
 }
 
 magicmind::Status SampleCalibData::Next() {
-  MoveShapeNext();
-  if (shapes_.size() == 1) {
-    if ((current_shape_idx_ < 0)
-        || (current_sample_ + batch_sizes_[current_shape_idx_] > max_samples_)) {
-      return magicmind::Status(magicmind::error::Code::OUT_OF_RANGE,
-                               "Sample number is bigger than max sample number");
-    }
-  } else {
-    if ((current_shape_idx_ < 0)
-        || (current_sample_ + 1 > max_samples_)) {
-      return magicmind::Status(magicmind::error::Code::OUT_OF_RANGE,
-                               "Sample number is bigger than max sample number");
-    }
+  if (current_step_ + 1 >= int(steps_.size())) {
+    current_step_ = steps_.size();
+    FinishCache();
+    return magicmind::Status(magicmind::error::Code::OUT_OF_RANGE,
+                             "Sample number is bigger than max sample number");
   }
+  ++current_step_;
   if (use_rand_) {
     if (!FillFromRand()) {
       return magicmind::Status(magicmind::error::Code::INTERNAL, "Bad init for calib data");
@@ -103,49 +292,119 @@ magicmind::Status SampleCalibData::Next() {
 }
 
 magicmind::Status SampleCalibData::Reset() {
-  current_sample_ = 0;
-  current_shape_idx_ = 0;
+  WaitPrefetch();
+  current_step_ = -1;
   return magicmind::Status::OK();
 }
 
 void *SampleCalibData::GetSample() {
-  return buffer_;
+  return sample_ ? sample_ : buffer_;
 }
 
-bool SampleCalibData::FillFromFile() {
+void SampleCalibData::FinishCache() {
+  // one full pass is recorded, later passes need nothing more
+  if (cache_ && cache_->Recording()) {
+    cache_->Finish();
+  }
+}
+
+bool SampleCalibData::ReadBatch(int step_idx, void *dst) {
+  auto start  = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  auto &files = steps_[step_idx].files;
+  std::vector<uint64_t> offsets(files.size() + 1, 0);
+  for (size_t i = 0; i < files.size(); ++i) {
+    offsets[i + 1] = offsets[i] + FileBytes(step_idx, files[i]);
+  }
+  auto read = [this, dst, &offsets](size_t index, int file) {
+    auto &path = data_paths_[file];
+    if (verbose_) {
+      SLOG(INFO) << "Calibration: reading file " << path;
+    }
+    return ReadDataFromFile(path, (char *)dst + offsets[index], offsets[index + 1] - offsets[index]);
+  };
   bool ret = true;
-  if (shapes_.size() == 1) {
-    // Fill static
-    // several img fill one data
-    std::vector<std::string> paths(data_paths_.begin() + current_sample_,
-                                   data_paths_.begin() + current_sample_ + batch_sizes_.front());
-    int index = 0;
-    size_t single_size = shapes_.front().GetElementCount() * DataTypeSize(data_type_) / batch_sizes_.front();
-    for (auto p_ : paths) {
-      SLOG(INFO) << "Calibration: reading file " << p_;
-      ret = ReadDataFromFile(p_, ((char *)buffer_ + index * single_size), single_size) && ret;
-      ++current_sample_;
-      ++index;
+  if (!readers_ || files.size() == 1) {
+    for (size_t i = 0; i < files.size(); ++i) {
+      ret = read(i, files[i]) && ret;
     }
   } else {
-    // fill dynamic
-    // one img for one data
-    SLOG(INFO) << "Calibration: reading file " << data_paths_[current_sample_];
-    ret = ReadDataFromFile(data_paths_[current_sample_], buffer_, shapes_[current_shape_idx_].GetElementCount() * DataTypeSize(data_type_));
-    ++current_sample_;
+    std::vector<std::future<bool>> rets;
+    for (size_t i = 0; i < files.size(); ++i) {
+      rets.push_back(readers_->AddTask(read, i, files[i]));
+    }
+    for (auto &r : rets) {
+      ret = r.get() && ret;
+    }
   }
+  files_read_ += files.size();
+  bytes_read_ += offsets.back();
+  read_us_ += EnvTime::NowMicros(CLOCK_MONOTONIC) - start;
+  return ret;
+}
+
+void SampleCalibData::Prefetch() {
+  int next = current_step_ + 1;
+  if (!prefetcher_ || next >= int(steps_.size())) {
+    return;
+  }
+  pending_.step  = next;
+  pending_.ready = prefetcher_->AddTask([this, next]() { return ReadBatch(next, back_buffer_); });
+}
+
+void SampleCalibData::WaitPrefetch() {
+  if (pending_.ready.valid()) {
+    pending_.ready.get();
+  }
+  pending_.step = -1;
+}
+
+bool SampleCalibData::FillFromFile() {
+  if (io_threads_ > 0 && !prefetcher_) {
+    readers_.reset(new ThreadPool(io_threads_));
+    prefetcher_.reset(new ThreadPool(1));
+  }
+  auto &step = steps_[current_step_];
+  if (cache_ && cache_->Opened()) {
+    void *cached = cache_->Find(step.shape_idx, step.sample, StepBytes(current_step_));
+    if (cached) {
+      sample_ = cached;
+      ++batches_;
+      ++cache_hits_;
+      return true;
+    }
+  }
+  bool ret   = true;
+  auto start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  if (pending_.ready.valid() && pending_.step == current_step_) {
+    // batch N was read in background during batch N - 1
+    ret = pending_.ready.get();
+    std::swap(buffer_, back_buffer_);
+  } else {
+    WaitPrefetch();
+    ret = ReadBatch(current_step_, buffer_);
+  }
+  wait_us_ += EnvTime::NowMicros(CLOCK_MONOTONIC) - start;
+  sample_ = buffer_;
+  if (ret && cache_ && cache_->Recording()) {
+    cache_->Append(step.shape_idx, step.sample, buffer_, StepBytes(current_step_));
+  }
+  ++batches_;
+  // read batch N + 1 while the calibrator consumes batch N
+  Prefetch();
   return ret;
 }
 
 bool SampleCalibData::FillFromRand() {
-  auto count = shapes_[current_shape_idx_].GetElementCount();
-#define CASE(type)                                                              \
-  case DataTypeToEnum<type>::value: {                                           \
-    auto vec = GenRand<type>(count, static_cast<type>(min_), \
-                             static_cast<type>(max_), 0);                       \
-    std::copy(vec.begin(), vec.end(), static_cast<type *>(buffer_));            \
-    current_sample_ += batch_sizes_[current_shape_idx_];                        \
-    return true;                                                                \
+  auto &step     = steps_[current_step_];
+  uint64_t count = step.shape.GetElementCount();
+  // Stream position follows the first sample, so every batch differs and reruns reproduce it.
+  uint64_t offset = count / std::max<int64_t>(1, step.shape.GetDimValue(0)) * step.sample;
+  int threads     = std::max<int>(1, kThreadPoolDefaultNum);
+#define CASE(type)                                                                     \
+  case DataTypeToEnum<type>::value: {                                                  \
+    FillRand<type>(static_cast<type *>(buffer_), count, ClampBound<type>(min_),        \
+                   ClampBound<type>(max_), 0, offset, threads);                        \
+    return true;                                                                       \
   }
   switch (data_type_) {
     CASE(int8_t);
@@ -154,18 +413,69 @@ bool SampleCalibData::FillFromRand() {
     CASE(uint8_t);
     CASE(uint16_t);
     CASE(uint32_t);
+    CASE(half);
     CASE(float);
-    // rand float data then cast to half
-    case magicmind::DataType::FLOAT16: {
-      auto vec = GenRand<float>(count, min_, max_, 0);
-      auto ret = NormalCast(buffer_, data_type_, vec.data(), magicmind::DataType::FLOAT32,
-                            count, false);
-      current_sample_ += batch_sizes_[current_shape_idx_];
-      return (ret.ok());
-    }
     default:
       SLOG(ERROR) << "Unsupport datatype for calib_data " << TypeEnumToString(data_type_);
       return false;
   }
 #undef CASE
 }
+
+bool CalibBatches::Load(magicmind::CalibDataInterface *src) {
+  shapes_.clear();
+  data_.clear();
+  data_type_ = src->GetDataType();
+  CHECK_STATUS(src->Reset());
+  while (true) {
+    auto ret = src->Next();
+    if (ret.code() == magicmind::error::Code::OUT_OF_RANGE) {
+      return true;
+    }
+    if (!ret.ok()) {
+      SLOG(ERROR) << ret.ToString();
+      return false;
+    }
+    auto shape  = src->GetShape();
+    auto sample = static_cast<const char *>(src->GetSample());
+    shapes_.push_back(shape);
+    data_.emplace_back(sample, sample + shape.GetElementCount() * DataTypeSize(data_type_));
+  }
+}
+
+ReplayCalibData::ReplayCalibData(std::shared_ptr<const CalibBatches> batches)
+    : batches_(batches) {}
+
+magicmind::Dims ReplayCalibData::GetShape() const {
+  if (current_ < 0 || current_ >= int(batches_->Size())) {
+    return magicmind::Dims();
+  }
+  return batches_->GetShape(current_);
+}
+
+magicmind::DataType ReplayCalibData::GetDataType() const {
+  return batches_->GetDataType();
+}
+
+magicmind::Status ReplayCalibData::Next() {
+  if (current_ + 1 >= int(batches_->Size())) {
+    current_ = batches_->Size();
+    return magicmind::Status(magicmind::error::Code::OUT_OF_RANGE,
+                             "Sample number is bigger than max sample number");
+  }
+  ++current_;
+  auto data = static_cast<const char *>(batches_->GetData(current_));
+  buffer_.assign(data,
+                 data + batches_->GetShape(current_).GetElementCount() *
+                            DataTypeSize(batches_->GetDataType()));
+  return magicmind::Status::OK();
+}
+
+magicmind::Status ReplayCalibData::Reset() {
+  current_ = -1;
+  return magicmind::Status::OK();
+}
+
+void *ReplayCalibData::GetSample() {
+  return buffer_.data();
+}
@@ -4,15 +4,24 @@
  *************************************************************************/
 #ifndef CALIB_DATA_H_
 #define CALIB_DATA_H_
+#include <atomic>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 #include "mm_calibrator.h"
+#include "common/threadpool.h"
+#include "common/calib_cache.h"
 /*
  * Class SampleCalibData supports three types of initialization:
  * 0. Read binary files from data_path with one static shape. One path represents one batch of input.
- * 1. Read binary files from data_path with dynamic shapes. One path represents one batch of input.
+ * 1. Read binary files from data_path with dynamic shapes. One path represents one batch of input,
+ *    and files with the same shape except the highest dimension can be packed into one batch
+ *    (see SetDynamicBatching).
  * 2. Use random data from min-max range to fill calibration input.
  * 3. Use zeros for only one iteration of calibration.
+ * For files, the next batch is read into a second buffer in background while the calibrator
+ * consumes the current one, and files of one batch are read in parallel (see SetIOOptions).
  */
 class SampleCalibData : public magicmind::CalibDataInterface {
  public:
@@ -34,7 +43,31 @@ class SampleCalibData : public magicmind::CalibDataInterface {
 
   SampleCalibData(const magicmind::Dims &shape, const magicmind::DataType &data_type);
 
-  ~SampleCalibData() { free(buffer_); }
+  ~SampleCalibData();
+  /*
+   * To set file reading behaviour, call before the first Next.
+   * io_threads: readers for files of one batch. 0 means reading in Next without prefetch.
+   * verbose: to log every file path when reading.
+   */
+  void SetIOOptions(int io_threads, bool verbose);
+  /*
+   * To share packed batches across builds under dir (see common/calib_cache.h). Batches are mapped
+   * from a matching cache file, or recorded into a new one during the first calibration pass.
+   */
+  void SetCacheDir(const std::string &dir);
+  /*
+   * For dynamic shapes only, call before the first Next.
+   * Files whose shapes only differ in the highest dimension form one shape group. Each step packs
+   * files of one group along the highest dimension up to batch_sizes[group] (one value applies to
+   * all groups), and groups are cycled by ratios (e.g. 2,1 gives g0 g1 g0 g0 g1 g0 ...), default
+   * equal. Groups follow the order of their first file.
+   */
+  void SetDynamicBatching(const std::vector<int> &batch_sizes, const std::vector<float> &ratios);
+  /*
+   * To describe file I/O: files and bytes read, read throughput, and how long Next waited for
+   * data. Wait close to read time means prefetch hides nothing, and the build is I/O bound.
+   */
+  std::string IOStatsString() const;
 
   magicmind::Dims GetShape() const override final;
   magicmind::DataType GetDataType() const override final;
@@ -46,12 +79,30 @@ class SampleCalibData : public magicmind::CalibDataInterface {
   bool FillFromFile();
   bool FillFromRand();
   void Init();
-  void MoveShapeNext();
+  void BuildSteps(const std::vector<int> &batch_sizes, const std::vector<float> &ratios);
+  uint64_t FileBytes(int step_idx, int file) const;
+  uint64_t StepBytes(int step_idx) const;
+  bool ReadBatch(int step_idx, void *dst);
+  void Prefetch();
+  void WaitPrefetch();
+  void FinishCache();
 
  private:
   std::vector<magicmind::Dims> shapes_ = {};
-  std::vector<int> batch_sizes_ = {};
-  int current_shape_idx_ = -1;
+  /*
+   * One step is what one Next fills: files (indices of data_paths_) in order, with the shape of
+   * their concatenation. shape_idx is shape group for dynamic shapes (0 for static), and sample is
+   * the first sample of the step, which together identify a step in cache.
+   */
+  struct Step {
+    int shape_idx = 0;
+    int sample    = 0;
+    std::vector<int> files;
+    magicmind::Dims shape;
+  };
+  std::vector<Step> steps_ = {};
+  int current_step_        = -1;
+  size_t buffer_size_      = 0;
   magicmind::DataType data_type_;
   int max_samples_                     = -1;
   std::vector<std::string> data_paths_ = {};
@@ -59,7 +110,65 @@ class SampleCalibData : public magicmind::CalibDataInterface {
   float max_                           = 0;
   bool use_rand_                       = false;
   void *buffer_                        = nullptr;
-  int current_sample_                  = 0;
+  // background reading
+  int io_threads_                      = 4;
+  bool verbose_                        = false;
+  void *back_buffer_                   = nullptr;
+  void *sample_                        = nullptr;
+  std::unique_ptr<CalibCache> cache_;
+  std::unique_ptr<ThreadPool> readers_;
+  std::unique_ptr<ThreadPool> prefetcher_;
+  struct Pending {
+    int step = -1;
+    std::future<bool> ready;
+  } pending_;
+  // I/O counters, updated by reader threads
+  std::atomic<uint64_t> files_read_{0};
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> read_us_{0};
+  uint64_t wait_us_    = 0;
+  uint64_t batches_    = 0;
+  uint64_t cache_hits_ = 0;
+};
+/*
+ * All batches of one calibration input read once into host memory, so several builds in one
+ * process replay them instead of reading files again. Not modified after Load, so replays on
+ * several threads can share it.
+ */
+class CalibBatches {
+ public:
+  /*
+   * To read every batch of src from its start. Returns false if a batch can not be read.
+   */
+  bool Load(magicmind::CalibDataInterface *src);
+  size_t Size() const { return shapes_.size(); }
+  magicmind::DataType GetDataType() const { return data_type_; }
+  const magicmind::Dims &GetShape(size_t i) const { return shapes_[i]; }
+  const void *GetData(size_t i) const { return data_[i].data(); }
+
+ private:
+  magicmind::DataType data_type_;
+  std::vector<magicmind::Dims> shapes_;
+  std::vector<std::vector<char>> data_;
+};
+/*
+ * Hands shared CalibBatches to one calibrator. The calibrator gets a writable sample, so each batch
+ * is copied into a buffer of its own rather than handed out from the shared ones.
+ */
+class ReplayCalibData : public magicmind::CalibDataInterface {
+ public:
+  explicit ReplayCalibData(std::shared_ptr<const CalibBatches> batches);
+
+  magicmind::Dims GetShape() const override final;
+  magicmind::DataType GetDataType() const override final;
+  magicmind::Status Next() override final;
+  magicmind::Status Reset() override final;
+  void *GetSample() override final;
+
+ private:
+  std::shared_ptr<const CalibBatches> batches_;
+  int current_ = -1;
+  std::vector<char> buffer_;
 };
 
 #endif  // CALIB_DATA_H_
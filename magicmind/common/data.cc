@@ -7,7 +7,10 @@
 #include <iterator>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "common/data.h"
 std::string AddLocalPathIfName(const std::string &filepath) {
@@ -108,110 +111,265 @@ bool WriteDataToFile(const std::string &file_path, void *ptr, size_t size) {
   return true;
 }
 
+namespace {
+/*
+ * A read only private mapping of a whole file, unmapped on destruction.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      return;
+    }
+    size_ = st.st_size;
+    if (!size_) {
+      valid_ = true;
+      return;
+    }
+    void *ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (ptr == MAP_FAILED) {
+      return;
+    }
+    madvise(ptr, size_, MADV_SEQUENTIAL);
+    data_  = static_cast<const char *>(ptr);
+    valid_ = true;
+  }
+  ~MappedFile() {
+    if (data_) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  bool Valid() const { return valid_; }
+  const char *Begin() const { return data_; }
+  const char *End() const { return data_ + size_; }
+  size_t LineCount() const {
+    size_t ret = 0;
+    for (const char *p = data_; p && p < End(); ++ret) {
+      p = static_cast<const char *>(memchr(p, '\n', End() - p));
+      p = p ? p + 1 : End();
+    }
+    return ret;
+  }
+
+ private:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  int fd_           = -1;
+  bool valid_       = false;
+  size_t size_      = 0;
+  const char *data_ = nullptr;
+};
+
+inline bool IsBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+/*
+ * To split [begin, end) of one line by blanks into at most max_tokens tokens.
+ * Return number of tokens found, or max_tokens + 1 if there are more.
+ */
+int SplitLine(const char *begin,
+              const char *end,
+              int max_tokens,
+              std::pair<const char *, const char *> *tokens) {
+  int num       = 0;
+  const char *p = begin;
+  while (true) {
+    while (p < end && IsBlank(*p)) {
+      ++p;
+    }
+    if (p == end) {
+      return num;
+    }
+    if (num == max_tokens) {
+      return max_tokens + 1;
+    }
+    tokens[num].first = p;
+    while (p < end && !IsBlank(*p)) {
+      ++p;
+    }
+    tokens[num++].second = p;
+  }
+}
+/*
+ * To parse a decimal int from [*p, end) and move *p after it, like from_chars for int.
+ */
+bool ParseInt(const char **p, const char *end, int *out) {
+  const char *c = *p;
+  bool neg      = false;
+  if (c < end && (*c == '-' || *c == '+')) {
+    neg = *c == '-';
+    ++c;
+  }
+  const char *digits = c;
+  int64_t value      = 0;
+  while (c < end && *c >= '0' && *c <= '9') {
+    value = value * 10 + (*c - '0');
+    if (value > int64_t(std::numeric_limits<int>::max()) + 1) {
+      return false;
+    }
+    ++c;
+  }
+  if (c == digits) {
+    return false;
+  }
+  value = neg ? -value : value;
+  if (value > std::numeric_limits<int>::max()) {
+    return false;
+  }
+  *out = static_cast<int>(value);
+  *p   = c;
+  return true;
+}
+/*
+ * To parse "shape[d0,d1,...]" in [begin, end).
+ */
+bool ParseShapeToken(const char *begin, const char *end, std::vector<int> *shape) {
+  static const char kPrefix[] = "shape[";
+  const size_t prefix_len     = sizeof(kPrefix) - 1;
+  if (size_t(end - begin) < prefix_len + 1 || memcmp(begin, kPrefix, prefix_len) ||
+      *(end - 1) != ']') {
+    return false;
+  }
+  const char *p    = begin + prefix_len;
+  const char *last = end - 1;
+  shape->clear();
+  while (p < last) {
+    int dim = 0;
+    if (!ParseInt(&p, last, &dim)) {
+      return false;
+    }
+    shape->push_back(dim);
+    if (p < last && *p++ != ',') {
+      return false;
+    }
+  }
+  return true;
+}
+/*
+ * To check whether name ends with one of upper case exts, ignoring the case of name.
+ */
+bool HasSupportedExt(const char *begin, const char *end) {
+  static const char *kSupportExts[] = {".JPG", ".JPEG", ".PNG", ".BMP", ".TIF", ".GIF"};
+  for (auto e_ : kSupportExts) {
+    size_t len = strlen(e_);
+    if (size_t(end - begin) < len) {
+      continue;
+    }
+    const char *tail = end - len;
+    size_t i         = 0;
+    while (i < len && toupper(static_cast<unsigned char>(tail[i])) == e_[i]) {
+      ++i;
+    }
+    if (i == len) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
 bool ReadListFromFile(const std::string &file_path,
                       std::vector<std::string> *lines,
                       std::vector<std::vector<int>> *shapes) {
-  std::ifstream in_file(file_path, std::ios::in | std::ios::binary);
-  if (!in_file) {
+  MappedFile file(file_path);
+  if (!file.Valid()) {
     SLOG(ERROR) << "Open file " << file_path << " failed during read.";
     return false;
   }
   if (!lines || !shapes) {
     SLOG(ERROR) << "Ptr invalid for " << file_path << " during read.";
-    in_file.close();
     return false;
   }
-  bool bad_parse = false;
   lines->clear();
   shapes->clear();
-  std::string line{};
-  std::vector<std::string> tokens;
-  while (getline(in_file, line)) {
-    tokens.clear();
-    std::istringstream iss(line);
-    std::copy(std::istream_iterator<std::string>(iss), std::istream_iterator<std::string>(),
-              std::back_inserter(tokens));
-    if (tokens.size() == 1) {
-      if (!line.empty()) {
-        lines->push_back(line);
-      }
-    } else if (tokens.size() == 2) {
-      lines->push_back(tokens[0]);
-      if ((tokens[1].rfind("shape[", 0) == 0) && (tokens[1].back() == ']')) {
-        auto nums = tokens[1].substr(6, tokens[1].size() - 7);
-        std::vector<int> shape;
-        std::string num;
-        std::stringstream shape_ss(nums);
-        while (getline(shape_ss, num, ',')) {
-          shape.push_back(std::stoi(num));
-        }
-        shapes->push_back(shape);
-        continue;
-      }
-      bad_parse = true;
-    } else {
-      bad_parse = true;
+  size_t line_count = file.LineCount();
+  lines->reserve(line_count);
+  std::pair<const char *, const char *> tokens[2];
+  std::vector<int> shape;
+  size_t line_idx = 0;
+  for (const char *p = file.Begin(); p && p < file.End(); ++line_idx) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', file.End() - p));
+    eol             = eol ? eol : file.End();
+    int num         = SplitLine(p, eol, 2, tokens);
+    p               = eol + 1;
+    if (num == 0) {
+      // skip blank lines
+      continue;
     }
+    lines->emplace_back(tokens[0].first, tokens[0].second);
+    if (num == 1) {
+      continue;
+    }
+    if (num != 2 || !ParseShapeToken(tokens[1].first, tokens[1].second, &shape)) {
+      SLOG(ERROR) << "File " << file_path << " bad format at line " << line_idx + 1 << ".";
+      return false;
+    }
+    if (shapes->empty()) {
+      shapes->reserve(line_count);
+    }
+    shapes->push_back(shape);
   }
-  if (bad_parse) {
-    SLOG(ERROR) << "File " << file_path << " bad format.";
-  }
-  in_file.close();
-  return !bad_parse;
+  return true;
 }
 
 bool ReadLabelFromFile(const std::string &file_path,
                        std::vector<std::string> *images,
                        std::vector<int> *labels) {
-  std::ifstream flabel(file_path, std::ios::in);
-  if (!flabel) {
+  MappedFile file(file_path);
+  if (!file.Valid()) {
     SLOG(ERROR) << "Open file " << file_path << " failed during read.";
     return false;
   }
   if (!images || !labels) {
     SLOG(ERROR) << "Ptr invalid for " << file_path << " during read.";
-    flabel.close();
     return false;
   }
   images->clear();
   labels->clear();
-  std::string line{};
-  std::vector<std::string> tokens;
-  const std::vector<std::string> support_exts = {".JPG", ".JPEG", ".PNG", ".BMP", ".TIF", ".GIF"};
-  while (getline(flabel, line)) {
-    tokens.clear();
-    std::istringstream iss(line);
-    std::copy(std::istream_iterator<std::string>(iss), std::istream_iterator<std::string>(),
-              std::back_inserter(tokens));
-    if (tokens.size() != 2) {
-      SLOG(ERROR) << "File " << file_path
+  size_t line_count = file.LineCount();
+  images->reserve(line_count);
+  labels->reserve(line_count);
+  std::pair<const char *, const char *> tokens[2];
+  size_t unsupported = 0;
+  size_t line_idx    = 0;
+  for (const char *p = file.Begin(); p && p < file.End(); ++line_idx) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', file.End() - p));
+    eol             = eol ? eol : file.End();
+    int num         = SplitLine(p, eol, 2, tokens);
+    p               = eol + 1;
+    if (num == 0) {
+      // skip blank lines
+      continue;
+    }
+    int label         = 0;
+    const char *digit = tokens[1].first;
+    if (num != 2 || !ParseInt(&digit, tokens[1].second, &label) || digit != tokens[1].second) {
+      SLOG(ERROR) << "File " << file_path << " line " << line_idx + 1
                   << " format can not be splited into img name and its label.";
-      flabel.close();
       return false;
     }
-    bool done = false;
-    for (auto e_ : support_exts) {
-      auto file_name = tokens[0];
-      if (file_name.size() < e_.size()) {
-        continue;
-      } else {
-        file_name = file_name.substr(file_name.size() - e_.size());
+    if (!HasSupportedExt(tokens[0].first, tokens[0].second)) {
+      if (!unsupported) {
+        SLOG(WARNING) << "File " << file_path << " contains unsupport filename "
+                      << std::string(tokens[0].first, tokens[0].second);
+        SLOG(WARNING) << "It may cause a failure of loading image.";
       }
-      std::transform(file_name.begin(), file_name.end(), file_name.begin(), ::toupper);
-      if (file_name != e_) {
-        continue;
-      } else {
-        done = true;
-        break;
-      }
-    }
-    if (!done) {
-      SLOG(WARNING) << "File " << file_path << " contains unsupport filename " << tokens[0];
-      SLOG(WARNING) << "It may cause a failure of loading image.";
+      ++unsupported;
     }
-    images->push_back(tokens[0]);
-    labels->push_back(std::stoi(tokens[1]));
+    images->emplace_back(tokens[0].first, tokens[0].second);
+    labels->push_back(label);
+  }
+  if (unsupported > 1) {
+    SLOG(WARNING) << "File " << file_path << " contains " << unsupported
+                  << " unsupport filenames in total.";
   }
-  flabel.close();
   return true;
 }
@@ -4,12 +4,15 @@
  *************************************************************************/
 #ifndef DATA_H_
 #define DATA_H_
+#include <algorithm>
 #include <limits>
 #include <queue>
 #include <random>
 #include <type_traits>
 #include "common/logger.h"
 #include "common/macros.h"
+#include "common/accuracy.h"
+#include "common/random.h"
 /*
  * LimitsClamped:
  * A helper To convert numeric type from V to T, and clamp the overflow value to its limits.
@@ -36,39 +39,35 @@ template <class T, class V>
 T Clamp(const V &v) {
   return LimitsClamped<T, V>::From(v);
 }
+/*
+ * To convert a float range bound to T, clamped to the limits of T whatever their sizes, so
+ * e.g. -1 becomes 0 and 1e10 becomes 4294967295 for uint32_t instead of wrapping.
+ */
+template <class T>
+T ClampBound(float v) {
+  double lowest = static_cast<double>(std::numeric_limits<T>::lowest());
+  double max    = static_cast<double>(std::numeric_limits<T>::max());
+  return static_cast<T>(std::min(std::max(static_cast<double>(v), lowest), max));
+}
 /*
  * A function to generate len number of uniform distribution int/float nums from begin to end.
+ * Values come from the Philox stream of seed (see common/random.h). Use FillRand to write into an
+ * existing buffer without the extra copy.
  */
-template <class T, bool is_integral = std::is_integral<T>::value>
-struct RandDist {};
-
-template <typename T>
-struct RandDist<T, false> {
-  typedef std::uniform_real_distribution<T> Dist;
-};
-
-template <typename T>
-struct RandDist<T, true> {
-  typedef std::uniform_int_distribution<T> Dist;
-};
-
 template <class T>
 std::vector<T> GenRand(uint64_t len, T begin, T end, unsigned int seed) {
   CHECK_LE(begin, end);
   std::vector<T> ret(len);
-  std::default_random_engine eng(seed);
-  typename RandDist<T>::Dist dist(begin, end);
-  for (size_t idx = 0; idx < len; ++idx) {
-    ret[idx] = dist(eng);
-  }
+  FillRand(ret.data(), len, begin, end, seed);
   return ret;
 }
 
 /*
  * To find min and max element values from src.
+ * See TensorStatistics in common/statistics.h for streaming and mergeable statistics.
  */
 template <class T>
-std::pair<double, double> GetMinMax(std::vector<T> src) {
+std::pair<double, double> GetMinMax(const std::vector<T> &src) {
   CHECK_VALID(src.size());
   double min = src[0];
   double max = src[0];
@@ -119,49 +118,36 @@ bool ReadLabelFromFile(const std::string &file_path,
                        std::vector<std::string> *images,
                        std::vector<int> *labels);
 /*
- * To find top k element indices from src.
+ * To find top k element indices from src, in descending order of values.
+ * Ties resolve to the lower index.
  */
 template <class T>
-std::vector<int> TopK(int k, std::vector<T> src) {
-  CHECK_LE(k, src.size());
-  std::priority_queue<std::pair<T, int>> q;
-  for (int i = 0; i < src.size(); ++i) {
-    if (q.size() < k) {
-      q.push(std::pair<T, int>(src[i], i));
-    } else if (q.top().first < src[i]) {
-      q.pop();
-      q.push(std::pair<T, int>(src[i], i));
-    }
+std::vector<int> TopK(int k, const std::vector<T> &src) {
+  CHECK_LE(size_t(k), src.size());
+  std::vector<int> ret(src.size());
+  for (size_t i = 0; i < src.size(); ++i) {
+    ret[i] = i;
   }
-  std::vector<int> ret(k);
-  for (int i = 0; i < k; ++i) {
-    ret[k - i - 1] = q.top().second;
-    q.pop();
+  auto greater = [&src](int a, int b) { return src[a] > src[b] || (src[a] == src[b] && a < b); };
+  if (size_t(k) < src.size()) {
+    std::nth_element(ret.begin(), ret.begin() + k, ret.end(), greater);
   }
+  ret.resize(k);
+  std::sort(ret.begin(), ret.end(), greater);
   return ret;
 }
 /*
- * To compute top1/top5 from labels.
+ * To compute top1/top5 from labels on up to threads threads, default to a quarter of host cores.
+ * Less than 256 samples per thread are evaluated serially.
+ * See common/accuracy.h for flat buffers and per class accuracy.
  */
 template <typename T>
-std::pair<int, int> ComputeTop1Top5(std::vector<std::vector<T>> buffers, std::vector<int> labels) {
-  int top1    = 0;
-  int top5    = 0;
-  const int k = 5;
-  CHECK_EQ(buffers.size(), labels.size());
-  for (uint32_t i = 0; i < labels.size(); ++i) {
-    std::vector<int32_t> result = TopK(k, buffers[i]);
-    if (labels[i] == result[0]) {
-      top1++;
-      top5++;
-    }
-    for (uint32_t res = 1; res < k; ++res) {
-      if (labels[i] == result[res]) {
-        top5++;
-      }
-    }
-  }
-  return std::make_pair(top1, top5);
+std::pair<int, int> ComputeTop1Top5(const std::vector<std::vector<T>> &buffers,
+                                    const std::vector<int> &labels,
+                                    int threads = kThreadPoolDefaultNum) {
+  std::vector<Span<T>> outputs(buffers.begin(), buffers.end());
+  auto acc = EvaluateTop1Top5(outputs, labels, threads);
+  return std::make_pair(int(acc.top1), int(acc.top5));
 }
 
 static const double EPSILON = 1e-9;
@@ -181,6 +167,16 @@ bool CheckBound(std::vector<T> data) {
   return false;
 }
 
+/*
+ * One line for the elements ComputeDiff skipped, instead of one line per element.
+ */
+inline void LogDiffSkipped(Diff type, size_t nan_count, size_t inf_count) {
+  if (nan_count || inf_count) {
+    SLOG(INFO) << "Diff" << int(type) << " skipped " << nan_count << " nan and " << inf_count
+               << " inf data found in both result.";
+  }
+}
+
 /*
  * Caculate the mse of two data with 4 different type of formulas:
  * - Diff1 = {{\sum {|data_{eval}-data_{base}|}} \over {\sum {| data_{base} |}}}
@@ -203,7 +199,9 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
   }
   CheckBound(evaluated_data);
   CheckBound(baseline_data);
-  float thre = 1e-6;
+  float thre       = 1e-6;
+  size_t nan_count = 0;
+  size_t inf_count = 0;
   switch (type) {
     case Diff::Type1: {
       if (evaluated_data.size() == 0)
@@ -213,12 +211,12 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
       for (size_t i = 0; i < evaluated_data.size(); i++) {
         // if find nan or inf skip for comparing
         if (std::isnan(float(evaluated_data[i])) && std::isnan(float(baseline_data[i]))) {
-          SLOG(INFO) << "Diff1 found nan data at " << i << " in both result.";
+          nan_count++;
           continue;
           // if found inf, checkif same inf or -inf, which can compare directly without exception
         } else if (std::isinf(float(evaluated_data[i])) && std::isinf(float(baseline_data[i]))) {
           if (float(evaluated_data[i]) == float(baseline_data[i])) {
-            SLOG(INFO) << "Diff1 found inf data at " << i << " in both result.";
+            inf_count++;
             continue;
           } else {
             SLOG(WARNING) << "Diff1 found different inf data, baseline is " << baseline_data[i]
@@ -230,6 +228,7 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
             fabsf(static_cast<float>(evaluated_data[i]) - static_cast<float>(baseline_data[i]));
         denominator_sum += fabsf(static_cast<float>(baseline_data[i]));
       }
+      LogDiffSkipped(type, nan_count, inf_count);
       SLOG(INFO) << "Diff1: numerator sum = " << numerator_sum
                  << ", denominator sum = " << denominator_sum;
       if (denominator_sum == 0) {
@@ -245,12 +244,12 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
       for (size_t i = 0; i < evaluated_data.size(); i++) {
         // if find nan or inf skip for comparing
         if (std::isnan(float(evaluated_data[i])) && std::isnan(float(baseline_data[i]))) {
-          SLOG(INFO) << "Diff2 found nan data at " << i << " in both result.";
+          nan_count++;
           continue;
           // if found inf, checkif same inf or -inf, which can compare directly without exception
         } else if (std::isinf(float(evaluated_data[i])) && std::isinf(float(baseline_data[i]))) {
           if (float(evaluated_data[i]) == float(baseline_data[i])) {
-            SLOG(INFO) << "Diff2 found inf data at " << i << " in both result.";
+            inf_count++;
             continue;
           } else {
             SLOG(WARNING) << "Diff2 found different inf data, baseline is " << baseline_data[i]
@@ -263,6 +262,7 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
         numerator_sum += powf(delta, 2);
         denominator_sum += powf(fabsf(static_cast<float>(baseline_data[i])), 2);
       }
+      LogDiffSkipped(type, nan_count, inf_count);
       SLOG(INFO) << "Diff2: numerator sum = " << numerator_sum
                  << ", denominator sum = " << denominator_sum;
       if (denominator_sum == 0) {
@@ -278,12 +278,12 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
       for (size_t i = 0; i < evaluated_data.size(); i++) {
         // if find nan or inf skip for comparing
         if (std::isnan(float(evaluated_data[i])) && std::isnan(float(baseline_data[i]))) {
-          SLOG(INFO) << "Diff3 found nan data at " << i << " in both result.";
+          nan_count++;
           continue;
           // if found inf, checkif same inf or -inf, which can compare directly without exception
         } else if (std::isinf(float(evaluated_data[i])) && std::isinf(float(baseline_data[i]))) {
           if (float(evaluated_data[i]) == float(baseline_data[i])) {
-            SLOG(INFO) << "Diff3 found inf data at " << i << " in both result.";
+            inf_count++;
             continue;
           } else {
             SLOG(WARNING) << "Diff3 found different inf data, baseline is " << baseline_data[i]
@@ -299,6 +299,7 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
         diff_3_2 = ((numerator > diff_3_2) && (fabsf((float)baseline_data[i]) <= thre)) ? numerator
                                                                                         : diff_3_2;
       }
+      LogDiffSkipped(type, nan_count, inf_count);
       return {diff_3_1, diff_3_2};
     }
     case Diff::Type4: {
@@ -311,13 +312,13 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
         // if find nan or inf skip for comparing
         if (std::isnan(float(evaluated_data[i])) && std::isnan(float(baseline_data[i]))) {
           total_data -= 1;
-          SLOG(INFO) << "Diff4 found nan data at " << i << " in both result.";
+          nan_count++;
           continue;
           // if found inf, checkif same inf or -inf, which can compare directly without exception
         } else if (std::isinf(float(evaluated_data[i])) && std::isinf(float(baseline_data[i]))) {
           if (float(evaluated_data[i]) == float(baseline_data[i])) {
             total_data -= 1;
-            SLOG(INFO) << "Diff4 found inf data at " << i << " in both result.";
+            inf_count++;
             continue;
           } else {
             SLOG(WARNING) << "Diff4 found different inf data, baseline is " << baseline_data[i]
@@ -335,6 +336,7 @@ std::vector<float> ComputeDiff(std::vector<T> evaluated_data,
           total_data -= 1;
         }
       }
+      LogDiffSkipped(type, nan_count, inf_count);
       // when full output total number >= 100, count diff4, or may random fail.
       if (evaluated_data.size() < 100) {
         SLOG(INFO) << "Diff4 {" << float(count_1) / total_data << " " << float(count_2) / total_data
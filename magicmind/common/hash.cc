@@ -0,0 +1,146 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Streaming 64 bit content hash for files and values.
+ *************************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "common/logger.h"
+#include "common/hash.h"
+
+namespace {
+const uint64_t kPrime1 = 11400714785074694791ULL;
+const uint64_t kPrime2 = 14029467366897019727ULL;
+const uint64_t kPrime3 = 1609587929392839161ULL;
+const uint64_t kPrime4 = 9650029242287828579ULL;
+const uint64_t kPrime5 = 2870177450012600261ULL;
+
+inline uint64_t Rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = Rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= Round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+}  // namespace
+
+Hash64::Hash64(uint64_t seed) : seed_(seed) {
+  acc_[0] = seed + kPrime1 + kPrime2;
+  acc_[1] = seed + kPrime2;
+  acc_[2] = seed;
+  acc_[3] = seed - kPrime1;
+}
+
+void Hash64::Consume(const unsigned char *stripe) {
+  for (int i = 0; i < 4; ++i) {
+    acc_[i] = Round(acc_[i], Read64(stripe + 8 * i));
+  }
+}
+
+void Hash64::Update(const void *data, size_t size) {
+  auto p = static_cast<const unsigned char *>(data);
+  total_ += size;
+  if (buffered_) {
+    size_t fill = std::min(size, sizeof(buffer_) - buffered_);
+    memcpy(buffer_ + buffered_, p, fill);
+    buffered_ += fill;
+    p += fill;
+    size -= fill;
+    if (buffered_ < sizeof(buffer_)) {
+      return;
+    }
+    Consume(buffer_);
+    buffered_ = 0;
+  }
+  for (; size >= sizeof(buffer_); p += sizeof(buffer_), size -= sizeof(buffer_)) {
+    Consume(p);
+  }
+  memcpy(buffer_, p, size);
+  buffered_ = size;
+}
+
+void Hash64::Update(const std::string &value) {
+  uint64_t size = value.size();
+  Update(&size, sizeof(size));
+  Update(value.data(), value.size());
+}
+
+bool Hash64::UpdateFile(const std::string &path) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp) {
+    SLOG(ERROR) << "Open file " << path << " for hashing failed.";
+    return false;
+  }
+  std::vector<char> chunk(1 << 20);
+  size_t n = 0;
+  while ((n = fread(chunk.data(), 1, chunk.size(), fp)) > 0) {
+    Update(chunk.data(), n);
+  }
+  bool ret = !ferror(fp);
+  fclose(fp);
+  if (!ret) {
+    SLOG(ERROR) << "Read file " << path << " for hashing failed.";
+  }
+  return ret;
+}
+
+uint64_t Hash64::Digest() const {
+  uint64_t h = 0;
+  if (total_ >= sizeof(buffer_)) {
+    h = Rotl(acc_[0], 1) + Rotl(acc_[1], 7) + Rotl(acc_[2], 12) + Rotl(acc_[3], 18);
+    for (int i = 0; i < 4; ++i) {
+      h = MergeRound(h, acc_[i]);
+    }
+  } else {
+    h = seed_ + kPrime5;
+  }
+  h += total_;
+  const unsigned char *p = buffer_;
+  size_t left            = buffered_;
+  for (; left >= 8; p += 8, left -= 8) {
+    h ^= Round(0, Read64(p));
+    h = Rotl(h, 27) * kPrime1 + kPrime4;
+  }
+  if (left >= 4) {
+    h ^= uint64_t(Read32(p)) * kPrime1;
+    h = Rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+    left -= 4;
+  }
+  for (; left > 0; ++p, --left) {
+    h ^= (*p) * kPrime5;
+    h = Rotl(h, 11) * kPrime1;
+  }
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+std::string Hash64::ToHex(uint64_t hash) {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return hex;
+}
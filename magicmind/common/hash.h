@@ -0,0 +1,39 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Streaming 64 bit content hash for files and values.
+ *************************************************************************/
+#ifndef HASH_H_
+#define HASH_H_
+#include <cstdint>
+#include <string>
+/*
+ * Hash64 is XXH64 over everything passed to Update, in order. It is not cryptographic, but is fast
+ * enough (several GB/s) to hash model files on every build to tell whether inputs changed.
+ */
+class Hash64 {
+ public:
+  explicit Hash64(uint64_t seed = 0);
+  void Update(const void *data, size_t size);
+  /*
+   * Strings are hashed with their length, so ("ab", "c") and ("a", "bc") differ.
+   */
+  void Update(const std::string &value);
+  /*
+   * To hash content of a file. Returns false if it can not be read.
+   */
+  bool UpdateFile(const std::string &path);
+  uint64_t Digest() const;
+  static std::string ToHex(uint64_t hash);
+
+ private:
+  void Consume(const unsigned char *stripe);
+
+ private:
+  uint64_t seed_  = 0;
+  uint64_t total_ = 0;
+  uint64_t acc_[4];
+  unsigned char buffer_[32];
+  size_t buffered_ = 0;
+};
+
+#endif  // HASH_H_
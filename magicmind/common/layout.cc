@@ -0,0 +1,24 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Host layout transforms between channel second and channel last layouts.
+ *************************************************************************/
+#include <unordered_map>
+#include "common/logger.h"
+#include "common/layout.h"
+
+namespace {
+const std::unordered_map<std::string, std::string> kChannelOppositeLayouts = {
+    {"NCT", "NTC"}, {"NCHW", "NHWC"}, {"NCDHW", "NDHWC"}};
+}  // namespace
+
+std::string GetChannelOppositeLayout(const std::string &in) {
+  for (auto e_ : kChannelOppositeLayouts) {
+    if (in == e_.first) {
+      return e_.second;
+    } else if (in == e_.second) {
+      return e_.first;
+    }
+  }
+  SLOG(ERROR) << "Unsupport layout convertion";
+  abort();
+}
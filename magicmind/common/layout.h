@@ -0,0 +1,116 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Host layout transforms between channel second and channel last layouts.
+ *************************************************************************/
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+/*
+ * Edge length of square tiles used by ChannelTranspose. 32x32 tiles of 4-byte elements
+ * take 4KB for each side and stay resident in L1 during one tile.
+ */
+const int64_t kLayoutTileSize = 32;
+/*
+ * To return the opposite layout of given one, e.g., NCHW <-> NHWC, NCT <-> NTC,
+ * NCDHW <-> NDHWC. Abort for unsupported layouts.
+ */
+std::string GetChannelOppositeLayout(const std::string &in);
+/*
+ * To transpose block [r0, r1) x [c0, c1) of a [rows, cols] matrix into dst of [cols, rows].
+ */
+template <typename SrcT, typename DstT>
+struct TransposeTile {
+  static void Run(const SrcT *src,
+                  DstT *dst,
+                  int64_t rows,
+                  int64_t cols,
+                  int64_t r0,
+                  int64_t r1,
+                  int64_t c0,
+                  int64_t c1) {
+    for (int64_t c = c0; c < c1; ++c) {
+      DstT *out = dst + c * rows;
+      for (int64_t r = r0; r < r1; ++r) {
+        out[r] = static_cast<DstT>(src[r * cols + c]);
+      }
+    }
+  }
+};
+
+#if defined(__SSE__)
+/*
+ * Float to float tiles go through 4x4 SSE register transposes, with scalar borders.
+ */
+template <>
+struct TransposeTile<float, float> {
+  static void Run(const float *src,
+                  float *dst,
+                  int64_t rows,
+                  int64_t cols,
+                  int64_t r0,
+                  int64_t r1,
+                  int64_t c0,
+                  int64_t c1) {
+    int64_t r4 = r0 + (r1 - r0) / 4 * 4;
+    int64_t c4 = c0 + (c1 - c0) / 4 * 4;
+    for (int64_t r = r0; r < r4; r += 4) {
+      for (int64_t c = c0; c < c4; c += 4) {
+        __m128 row0 = _mm_loadu_ps(src + (r + 0) * cols + c);
+        __m128 row1 = _mm_loadu_ps(src + (r + 1) * cols + c);
+        __m128 row2 = _mm_loadu_ps(src + (r + 2) * cols + c);
+        __m128 row3 = _mm_loadu_ps(src + (r + 3) * cols + c);
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+        _mm_storeu_ps(dst + (c + 0) * rows + r, row0);
+        _mm_storeu_ps(dst + (c + 1) * rows + r, row1);
+        _mm_storeu_ps(dst + (c + 2) * rows + r, row2);
+        _mm_storeu_ps(dst + (c + 3) * rows + r, row3);
+      }
+    }
+    // right border: every row, columns [c4, c1)
+    for (int64_t c = c4; c < c1; ++c) {
+      for (int64_t r = r0; r < r1; ++r) {
+        dst[c * rows + r] = src[r * cols + c];
+      }
+    }
+    // bottom border: rows [r4, r1), columns [c0, c4)
+    for (int64_t c = c0; c < c4; ++c) {
+      for (int64_t r = r4; r < r1; ++r) {
+        dst[c * rows + r] = src[r * cols + c];
+      }
+    }
+  }
+};
+#endif  // __SSE__
+
+/*
+ * Transposes `batch` row-major matrices of [rows, cols] from src to [cols, rows] in dst,
+ * casting each element from SrcT to DstT in the same pass.
+ * Both channel second -> channel last and channel last -> channel second collapse to this:
+ * - NCHW -> NHWC: rows = C, cols = H * W
+ * - NHWC -> NCHW: rows = H * W, cols = C
+ * Work is split into kLayoutTileSize square tiles so both reads and writes stay in cache.
+ * src and dst must not overlap.
+ */
+template <typename SrcT, typename DstT>
+void ChannelTranspose(const SrcT *src, DstT *dst, int64_t batch, int64_t rows, int64_t cols) {
+  const int64_t matrix = rows * cols;
+  for (int64_t n = 0; n < batch; ++n) {
+    const SrcT *s = src + n * matrix;
+    DstT *d       = dst + n * matrix;
+    for (int64_t r = 0; r < rows; r += kLayoutTileSize) {
+      int64_t r_end = std::min(r + kLayoutTileSize, rows);
+      for (int64_t c = 0; c < cols; c += kLayoutTileSize) {
+        int64_t c_end = std::min(c + kLayoutTileSize, cols);
+        TransposeTile<SrcT, DstT>::Run(s, d, rows, cols, r, r_end, c, c_end);
+      }
+    }
+  }
+}
+
+#endif  // LAYOUT_H_
@@ -2,14 +2,380 @@
  * Copyright (C) [2020-2023] by Cambricon, Inc.
  * Description: A simple implement for a light-weight logger
  *************************************************************************/
+#include <signal.h>
 #include <stdint.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
 #include "common/logger.h"
 #include "common/timer.h"
 
+namespace {
+const char kSeverityName[NUM_SEVERITIES][8] = {"INFO", "WARNING", "ERROR"};
+// Per thread ring size, lines longer than a ring are written directly.
+const size_t kRingBytes = 256 * 1024;
+const int kFlushMs      = 20;
+
+/*
+ * "%Y-%m-%d %H:%M:%S" of the second, formatted again only when the second changes.
+ */
+const char *FormatSeconds(time_t seconds) {
+  thread_local time_t cached_seconds = -1;
+  thread_local char cached[TimeBufferSize];
+  if (seconds != cached_seconds) {
+    struct tm time_tm_buf;
+    strftime(cached, TimeBufferSize, "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &time_tm_buf));
+    cached_seconds = seconds;
+  }
+  return cached;
+}
+
+/*
+ * Single producer (the logging thread) single consumer (whoever holds AsyncLogger::drain_mutex_)
+ * byte ring of records: 8 bytes time, 4 bytes length, then the line.
+ */
+class LogRing {
+ public:
+  static constexpr size_t kHeader = sizeof(uint64_t) + sizeof(uint32_t);
+  LogRing() : buffer_(kRingBytes) {}
+
+  bool Push(uint64_t micros, const std::string &line) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    if (kHeader + line.size() > buffer_.size() - (head - tail)) {
+      return false;
+    }
+    uint32_t size = line.size();
+    Copy(head, &micros, sizeof(micros));
+    Copy(head + sizeof(micros), &size, sizeof(size));
+    Copy(head + kHeader, line.data(), size);
+    head_.store(head + kHeader + size, std::memory_order_release);
+    return true;
+  }
+
+  void Drain(std::vector<std::pair<uint64_t, std::string>> *records) {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail < head) {
+      uint64_t micros = 0;
+      uint32_t size   = 0;
+      Read(tail, &micros, sizeof(micros));
+      Read(tail + sizeof(micros), &size, sizeof(size));
+      std::string line(size, '\0');
+      Read(tail + kHeader, &line[0], size);
+      records->emplace_back(micros, std::move(line));
+      tail += kHeader + size;
+    }
+    tail_.store(tail, std::memory_order_release);
+  }
+
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+  std::atomic<bool> closed{false};
+
+ private:
+  void Copy(uint64_t pos, const void *src, size_t size) {
+    size_t offset = pos % buffer_.size();
+    size_t first  = std::min(size, buffer_.size() - offset);
+    memcpy(&buffer_[offset], src, first);
+    memcpy(&buffer_[0], static_cast<const char *>(src) + first, size - first);
+  }
+  void Read(uint64_t pos, void *dst, size_t size) const {
+    size_t offset = pos % buffer_.size();
+    size_t first  = std::min(size, buffer_.size() - offset);
+    memcpy(dst, &buffer_[offset], first);
+    memcpy(static_cast<char *>(dst) + first, &buffer_[0], size - first);
+  }
+
+  std::vector<char> buffer_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> tail_{0};
+};
+
+class AsyncLogger {
+ public:
+  // Never destroyed, threads may log while statics are destroyed.
+  static AsyncLogger *Get() {
+    static AsyncLogger *logger = new AsyncLogger();
+    return logger;
+  }
+
+  bool Running() const { return running_.load(std::memory_order_acquire); }
+
+  void Start(const std::string &log_file, bool to_stderr, size_t rotate_mb, int keep_files) {
+    Stop();
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    path_       = log_file;
+    to_stderr_  = to_stderr || log_file.empty();
+    rotate_     = std::max<size_t>(rotate_mb, 1) * 1024 * 1024;
+    keep_files_ = std::max(keep_files, 1);
+    if (!path_.empty()) {
+      OpenFile("a");
+    }
+    stop_ = false;
+    running_.store(true, std::memory_order_release);
+    flusher_ = std::thread([this]() {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      while (!stop_) {
+        wake_cv_.wait_for(lock, std::chrono::milliseconds(kFlushMs));
+        lock.unlock();
+        Flush();
+        lock.lock();
+      }
+    });
+    static bool once = false;
+    if (!once) {
+      once = true;
+      signal(SIGABRT, OnAbort);
+      atexit(StopAsyncLog);
+    }
+  }
+
+  void Stop() {
+    if (!flusher_.joinable()) {
+      return;
+    }
+    running_.store(false, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      stop_ = true;
+    }
+    wake_cv_.notify_all();
+    flusher_.join();
+    Flush();
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    if (file_) {
+      fclose(file_);
+      file_ = nullptr;
+    }
+  }
+
+  // Returns false if not running, then the caller writes the line itself.
+  bool Write(uint64_t micros, const std::string &line) {
+    if (!Running()) {
+      return false;
+    }
+    if (LogRing::kHeader + line.size() > kRingBytes) {
+      Flush();
+      std::lock_guard<std::mutex> lock(drain_mutex_);
+      Output(line);
+      Sync();
+      return true;
+    }
+    LogRing *ring = ThreadRing();
+    while (!ring->Push(micros, line)) {
+      // Full, drain it here rather than drop lines.
+      Flush();
+    }
+    return true;
+  }
+
+  void Flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    draining_ = true;
+    Drain();
+    draining_ = false;
+  }
+
+ private:
+  struct RingHolder {
+    std::shared_ptr<LogRing> ring;
+    ~RingHolder() {
+      if (ring) {
+        ring->closed.store(true, std::memory_order_release);
+      }
+    }
+  };
+
+  LogRing *ThreadRing() {
+    thread_local RingHolder holder;
+    if (!holder.ring) {
+      holder.ring = std::make_shared<LogRing>();
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.push_back(holder.ring);
+    }
+    return holder.ring.get();
+  }
+
+  // Must hold drain_mutex_.
+  void Drain() {
+    std::vector<std::shared_ptr<LogRing>> rings;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings = rings_;
+    }
+    records_.clear();
+    for (auto &e_ : rings) {
+      e_->Drain(&records_);
+    }
+    std::stable_sort(records_.begin(), records_.end(),
+                     [](const std::pair<uint64_t, std::string> &a,
+                        const std::pair<uint64_t, std::string> &b) { return a.first < b.first; });
+    for (auto &e_ : records_) {
+      Output(e_.second);
+    }
+    if (!records_.empty()) {
+      Sync();
+    }
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                                [](const std::shared_ptr<LogRing> &r) {
+                                  return r->closed.load(std::memory_order_acquire) && r->Empty();
+                                }),
+                 rings_.end());
+  }
+
+  // Must hold drain_mutex_.
+  void Output(const std::string &line) {
+    if (to_stderr_) {
+      fwrite(line.data(), 1, line.size(), stderr);
+    }
+    if (!file_) {
+      return;
+    }
+    if (written_ > 0 && written_ + line.size() > rotate_) {
+      Rotate();
+    }
+    if (file_) {
+      written_ += fwrite(line.data(), 1, line.size(), file_);
+    }
+  }
+
+  void Sync() {
+    if (to_stderr_) {
+      fflush(stderr);
+    }
+    if (file_) {
+      fflush(file_);
+    }
+  }
+
+  void OpenFile(const char *mode) {
+    file_ = fopen(path_.c_str(), mode);
+    if (!file_) {
+      fprintf(stderr, "Open log file %s failed, logging to stderr only.\n", path_.c_str());
+      to_stderr_ = true;
+      return;
+    }
+    fseek(file_, 0, SEEK_END);
+    long pos = ftell(file_);
+    written_ = pos > 0 ? pos : 0;
+  }
+
+  // log_file -> log_file.1 -> ... -> log_file.(keep_files_ - 1), the oldest is dropped.
+  void Rotate() {
+    fclose(file_);
+    file_ = nullptr;
+    for (int i = keep_files_ - 1; i > 0; --i) {
+      std::string from = i == 1 ? path_ : path_ + "." + std::to_string(i - 1);
+      rename(from.c_str(), (path_ + "." + std::to_string(i)).c_str());
+    }
+    if (keep_files_ == 1) {
+      remove(path_.c_str());
+    }
+    OpenFile("w");
+  }
+
+  static void OnAbort(int sig) {
+    auto logger = AsyncLogger::Get();
+    // The aborting thread may already be draining, then there is nothing safe left to do.
+    if (!draining_ && logger->drain_mutex_.try_lock()) {
+      logger->Drain();
+      logger->drain_mutex_.unlock();
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+  }
+
+  static thread_local bool draining_;
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<LogRing>> rings_;
+  std::mutex drain_mutex_;
+  std::vector<std::pair<uint64_t, std::string>> records_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::thread flusher_;
+  bool stop_ = false;
+  std::atomic<bool> running_{false};
+  std::string path_;
+  bool to_stderr_  = true;
+  size_t rotate_   = 0;
+  int keep_files_  = 1;
+  FILE *file_      = nullptr;
+  size_t written_  = 0;
+};
+
+thread_local bool AsyncLogger::draining_ = false;
+}  // namespace
+
+int LogLevelFromName(const std::string &name) {
+  for (int i = 0; i < NUM_SEVERITIES; ++i) {
+    if (name == kSeverityName[i] || name == std::to_string(i)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+namespace {
+int InitialLogLevel() {
+  const char *env = getenv("SAMPLE_LOG_LEVEL");
+  int level       = env ? LogLevelFromName(env) : -1;
+  return level < 0 ? INFO : level;
+}
+}  // namespace
+
+std::atomic<int> g_sample_log_level{InitialLogLevel()};
+
+void SetMinLogLevel(int severity) {
+  g_sample_log_level.store(std::min(std::max(severity, int(INFO)), ERROR));
+}
+
+bool LogEveryMs(LogSite *site, uint64_t ms) {
+  uint64_t now  = EnvTime::NowMicros(CLOCK_MONOTONIC);
+  uint64_t last = site->last_micros.load(std::memory_order_relaxed);
+  if (last && now - last < ms * 1000) {
+    return false;
+  }
+  // Only one of the threads reaching here at the same time logs.
+  return site->last_micros.compare_exchange_strong(last, now);
+}
+
+void StartAsyncLog(const std::string &log_file, bool to_stderr, size_t rotate_mb, int keep_files) {
+  AsyncLogger::Get()->Start(log_file, to_stderr, rotate_mb, keep_files);
+}
+
+void StopAsyncLog() {
+  AsyncLogger::Get()->Stop();
+}
+
+void FlushLog() {
+  auto logger = AsyncLogger::Get();
+  if (logger->Running()) {
+    logger->Flush();
+  }
+}
+
 void LogMessage::GenerateLogMessage() {
   uint64_t now_micros = EnvTime::NowMicros();
   int32_t micros_remainder = static_cast<int32_t>(now_micros % 1000000);
-  char severity_buffer[4][10] = {"INFO", "WARNING", "ERROR"};
-  fprintf(stderr, "%s.%06d: %s: %s:%d] %s\n", EnvTime::CurrentTime().c_str(), micros_remainder,
-          severity_buffer[severity_], fname_, line_, str().c_str());
+  char prefix[TimeBufferSize + 64];
+  snprintf(prefix, sizeof(prefix), "%s.%06d: %s: ",
+           FormatSeconds(static_cast<time_t>(now_micros / 1000000)), micros_remainder,
+           kSeverityName[severity_]);
+  std::string line = prefix;
+  line.append(fname_).append(":").append(std::to_string(line_)).append("] ");
+  line.append(str()).append("\n");
+  auto logger = AsyncLogger::Get();
+  if (!logger->Write(now_micros, line)) {
+    fwrite(line.data(), 1, line.size(), stderr);
+  } else if (severity_ >= ERROR) {
+    logger->Flush();
+  }
 }
@@ -13,12 +13,26 @@
 #include <limits>
 #include <memory>
 #include <sstream>
+#include <cstdint>
 
 /*
  * A logger which supports 3 kinds of severities: info/warning/error.
  * To use it, call macro SLOG(INFO/WARNING/ERROR) << in corresponding line.
  * LOG will be print as follow:
  * y-m-d h:m:s.micro: INFO/WARNING/ERROR:  filepath:line] Your Content
+ *
+ * Messages below the minimum level are skipped before the stream is built, so nothing after << is
+ * evaluated. The minimum level is the larger one of:
+ *   - SAMPLE_LOG_MIN_LEVEL at compile time (e.g. -DSAMPLE_LOG_MIN_LEVEL=1 drops INFO), disabled
+ *     levels are removed by the compiler;
+ *   - SetMinLogLevel at runtime, initialized from environment SAMPLE_LOG_LEVEL (0/1/2 or
+ *     INFO/WARNING/ERROR).
+ * ERROR is never dropped.
+ *
+ * For messages on hot paths:
+ *   SLOG_EVERY_N(severity, n)   the 1st, (n+1)th, (2n+1)th... time this line is reached
+ *   SLOG_FIRST_N(severity, n)   the first n times
+ *   SLOG_EVERY_MS(severity, ms) at most once every ms milliseconds
  */
 
 const int INFO           = 0;
@@ -26,6 +40,38 @@ const int WARNING        = 1;
 const int ERROR          = 2;
 const int NUM_SEVERITIES = 3;
 
+#ifndef SAMPLE_LOG_MIN_LEVEL
+#define SAMPLE_LOG_MIN_LEVEL 0
+#endif
+static_assert(SAMPLE_LOG_MIN_LEVEL <= ERROR, "SAMPLE_LOG_MIN_LEVEL can not drop ERROR.");
+
+extern std::atomic<int> g_sample_log_level;
+void SetMinLogLevel(int severity);
+// INFO/WARNING/ERROR or 0/1/2 to severity, -1 if unknown.
+int LogLevelFromName(const std::string &name);
+inline int MinLogLevel() {
+  return g_sample_log_level.load(std::memory_order_relaxed);
+}
+inline bool LogEnabled(int severity) {
+  return severity >= SAMPLE_LOG_MIN_LEVEL && severity >= MinLogLevel();
+}
+
+/*
+ * State of one rate limited log line, see _SAMPLE_LOG_SITE.
+ */
+struct LogSite {
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> last_micros{0};
+};
+inline bool LogEveryN(LogSite *site, uint64_t n) {
+  return site->count.fetch_add(1, std::memory_order_relaxed) % (n ? n : 1) == 0;
+}
+inline bool LogFirstN(LogSite *site, uint64_t n) {
+  return site->count.load(std::memory_order_relaxed) < n &&
+         site->count.fetch_add(1, std::memory_order_relaxed) < n;
+}
+bool LogEveryMs(LogSite *site, uint64_t ms);
+
 class LogMessage : public std::basic_ostringstream<char> {
  public:
   LogMessage(const char *fname, int line, int severity)
@@ -34,6 +80,7 @@ class LogMessage : public std::basic_ostringstream<char> {
 
  public:
   void GenerateLogMessage();
+  std::ostream &stream() { return *this; }
 
  private:
   const char *fname_;
@@ -41,15 +88,52 @@ class LogMessage : public std::basic_ostringstream<char> {
   int severity_;
 };
 
-#define _SAMPLE_LOG_INFO LogMessage(__FILE__, __LINE__, INFO)
-#define _SAMPLE_LOG_WARNING LogMessage(__FILE__, __LINE__, WARNING)
-#define _SAMPLE_LOG_ERROR LogMessage(__FILE__, __LINE__, ERROR)
+/*
+ * By default every message is written to stderr by the thread logging it. After StartAsyncLog the
+ * thread only formats the line and pushes it to its own lock free ring, and a background thread
+ * writes all rings to stderr and/or log_file every few milliseconds, ordered by time. log_file is
+ * rotated when it exceeds rotate_mb, keeping log_file.1 ... log_file.(keep_files - 1).
+ *
+ * ERROR messages flush all rings before returning, so CHECK_* failures are written before abort.
+ * Other aborts (assert, abort) are flushed by a SIGABRT handler installed by StartAsyncLog.
+ */
+void StartAsyncLog(const std::string &log_file = "",
+                   bool to_stderr     = true,
+                   size_t rotate_mb   = 64,
+                   int keep_files     = 5);
+// Flush and go back to writing from the logging thread.
+void StopAsyncLog();
+// Write everything logged so far. No-op in synchronous mode.
+void FlushLog();
+
+/*
+ * Turns "stream << ..." into void, so SLOG can be the false branch of ?: below.
+ */
+struct LogMessageVoidify {
+  void operator&(std::ostream &) {}
+};
+
+#define _SAMPLE_LOG_IF(severity, condition) \
+  !(condition) ? (void)0                    \
+               : LogMessageVoidify() & LogMessage(__FILE__, __LINE__, severity).stream()
+// A LogSite owned by the line using it.
+#define _SAMPLE_LOG_SITE                  \
+  ([]() -> LogSite * {                    \
+    static LogSite site;                  \
+    return &site;                         \
+  }())
 
 /*
  * SLOG stands for "sample log", to avoid duplicated defination
  * for macro "LOG".
  */
-#define SLOG(severity) _SAMPLE_LOG_##severity
+#define SLOG(severity) _SAMPLE_LOG_IF(severity, LogEnabled(severity))
+#define SLOG_EVERY_N(severity, n) \
+  _SAMPLE_LOG_IF(severity, LogEnabled(severity) && LogEveryN(_SAMPLE_LOG_SITE, n))
+#define SLOG_FIRST_N(severity, n) \
+  _SAMPLE_LOG_IF(severity, LogEnabled(severity) && LogFirstN(_SAMPLE_LOG_SITE, n))
+#define SLOG_EVERY_MS(severity, ms) \
+  _SAMPLE_LOG_IF(severity, LogEnabled(severity) && LogEveryMs(_SAMPLE_LOG_SITE, ms))
 
 namespace std {
 template <class T>
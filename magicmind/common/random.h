@@ -0,0 +1,198 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: A counter-based random generator to fill host buffers in parallel.
+ *************************************************************************/
+#ifndef RANDOM_H_
+#define RANDOM_H_
+#include <cstdint>
+#include <algorithm>
+#include <future>
+#include <type_traits>
+#include <vector>
+#include "common/macros.h"
+#include "common/threadpool.h"
+/*
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+ * Every 128-bit counter maps to 4 random uint32s under a 64-bit key (the seed), so value i
+ * of a stream only depends on (seed, i). Any split of a buffer across threads gives the
+ * same bits, which keeps parallel fills reproducible for any thread count.
+ */
+class Philox4x32 {
+ public:
+  explicit Philox4x32(uint64_t seed)
+      : k0_(static_cast<uint32_t>(seed)), k1_(static_cast<uint32_t>(seed >> 32)) {}
+  /*
+   * Blocks generated by one call of Generate. Rounds are applied lane by lane over the whole
+   * chunk in structure-of-arrays form, so compilers can keep kChunk counters in SIMD registers.
+   */
+  static constexpr int kChunk = 64;
+  /*
+   * To generate blocks [first, first + num) into out, 4 uint32 each. num <= kChunk.
+   */
+  void Generate(uint64_t first, int num, uint32_t *out) const {
+    uint32_t c0[kChunk], c1[kChunk], c2[kChunk], c3[kChunk];
+    for (int b = 0; b < num; ++b) {
+      c0[b] = static_cast<uint32_t>(first + b);
+      c1[b] = static_cast<uint32_t>((first + b) >> 32);
+      c2[b] = 0;
+      c3[b] = 0;
+    }
+    uint32_t k0 = k0_;
+    uint32_t k1 = k1_;
+    for (int round = 0; round < 10; ++round) {
+      for (int b = 0; b < num; ++b) {
+        uint64_t p0 = static_cast<uint64_t>(kM0) * c0[b];
+        uint64_t p1 = static_cast<uint64_t>(kM1) * c2[b];
+        uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[b] ^ k0;
+        uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[b] ^ k1;
+        c1[b]       = static_cast<uint32_t>(p1);
+        c3[b]       = static_cast<uint32_t>(p0);
+        c0[b]       = n0;
+        c2[b]       = n2;
+      }
+      k0 += kW0;
+      k1 += kW1;
+    }
+    for (int b = 0; b < num; ++b) {
+      out[4 * b + 0] = c0[b];
+      out[4 * b + 1] = c1[b];
+      out[4 * b + 2] = c2[b];
+      out[4 * b + 3] = c3[b];
+    }
+  }
+
+ private:
+  static constexpr uint32_t kM0 = 0xD2511F53;
+  static constexpr uint32_t kM1 = 0xCD9E8D57;
+  static constexpr uint32_t kW0 = 0x9E3779B9;
+  static constexpr uint32_t kW1 = 0xBB67AE85;
+  uint32_t k0_;
+  uint32_t k1_;
+};
+/*
+ * Samplers map a run of random uint32 to values. Each one keeps its loop free of branches
+ * so it vectorizes.
+ * UniformRealSampler: [begin, end) with 24 random bits.
+ * UniformIntSampler: [begin, end] with a multiply-shift reduction, so end - begin + 1 must be
+ *   within 2^32 (all 32 bit and smaller types).
+ */
+struct UniformRealSampler {
+  typedef float ValueType;
+  UniformRealSampler(float begin, float end) : begin_(begin), scale_(end - begin) {}
+  void operator()(const uint32_t *bits, int n, float *out) const {
+    const float k = 1.0f / 16777216.0f;
+    for (int i = 0; i < n; ++i) {
+      out[i] = begin_ + scale_ * (static_cast<float>(bits[i] >> 8) * k);
+    }
+  }
+  float begin_;
+  float scale_;
+};
+
+struct UniformIntSampler {
+  typedef int64_t ValueType;
+  UniformIntSampler(int64_t begin, int64_t end)
+      : begin_(begin), range_(static_cast<uint64_t>(end) - static_cast<uint64_t>(begin) + 1) {
+    CHECK_LE(begin, end);
+    // bits * range_ must fit in 64 bits, a wider range would also leave most values unreachable
+    CHECK_LE(range_ - 1, uint64_t(UINT32_MAX));
+  }
+  void operator()(const uint32_t *bits, int n, int64_t *out) const {
+    for (int i = 0; i < n; ++i) {
+      out[i] = begin_ + static_cast<int64_t>((static_cast<uint64_t>(bits[i]) * range_) >> 32);
+    }
+  }
+  int64_t begin_;
+  uint64_t range_;
+};
+
+/*
+ * To fill dst[0, len) with values offset..offset+len of the stream (seed, sampler).
+ */
+template <typename T, typename Sampler>
+void FillRandSpan(T *dst, uint64_t len, uint64_t offset, uint64_t seed, const Sampler &sampler) {
+  const int kChunk = Philox4x32::kChunk;
+  Philox4x32 gen(seed);
+  uint32_t bits[4 * kChunk];
+  typename Sampler::ValueType values[4 * kChunk];
+  uint64_t idx = offset;
+  uint64_t end = offset + len;
+  while (idx < end) {
+    uint64_t block      = idx / 4;
+    uint64_t last_block = (end - 1) / 4;
+    int num             = static_cast<int>(std::min<uint64_t>(kChunk, last_block - block + 1));
+    gen.Generate(block, num, bits);
+    sampler(bits, 4 * num, values);
+    uint64_t chunk_end = std::min<uint64_t>(end, (block + num) * 4);
+    for (uint64_t i = idx; i < chunk_end; ++i) {
+      dst[i - offset] = static_cast<T>(values[i - block * 4]);
+    }
+    idx = chunk_end;
+  }
+}
+/*
+ * The threadpool of FillRandParallel, created on first use and kept for later fills. Only
+ * FillRandSpan runs on it, so callers waiting on it from any thread can not deadlock.
+ */
+inline ThreadPool &RandFillPool() {
+  static ThreadPool pool(std::max<size_t>(1, kThreadPoolMaxNum));
+  return pool;
+}
+/*
+ * To split dst into threads parts and fill them on RandFillPool.
+ * Output only depends on (seed, offset, len), never on threads.
+ */
+template <typename T, typename Sampler>
+void FillRandParallel(T *dst,
+                      uint64_t len,
+                      uint64_t offset,
+                      uint64_t seed,
+                      const Sampler &sampler,
+                      int threads) {
+  // small buffers are not worth waking up threads
+  const uint64_t kMinPerThread = 1 << 16;
+  uint64_t parts = std::min<uint64_t>(std::max(threads, 1), len / kMinPerThread);
+  if (parts <= 1) {
+    FillRandSpan(dst, len, offset, seed, sampler);
+    return;
+  }
+  ThreadPool &pool = RandFillPool();
+  std::vector<std::future<void>> rets;
+  uint64_t step = (len + parts - 1) / parts;
+  for (uint64_t begin = 0; begin < len; begin += step) {
+    uint64_t count = std::min(step, len - begin);
+    rets.push_back(pool.AddTask(FillRandSpan<T, Sampler>, dst + begin, count, offset + begin, seed,
+                                sampler));
+  }
+  for (auto &r : rets) {
+    r.get();
+  }
+}
+
+template <class T, bool is_integral = std::is_integral<T>::value>
+struct RandSampler {
+  typedef UniformRealSampler Type;
+};
+
+template <class T>
+struct RandSampler<T, true> {
+  typedef UniformIntSampler Type;
+};
+/*
+ * To fill len number of uniform distribution int/float nums from begin to end into dst.
+ * Integral types cover [begin, end], others cover [begin, end).
+ * offset selects the position in stream seed, e.g., use sample index * len to give each
+ * calibration sample distinct but reproducible data.
+ */
+template <class T>
+void FillRand(T *dst,
+              uint64_t len,
+              T begin,
+              T end,
+              uint64_t seed,
+              uint64_t offset = 0,
+              int threads     = 1) {
+  typename RandSampler<T>::Type sampler(begin, end);
+  FillRandParallel(dst, len, offset, seed, sampler, threads);
+}
+#endif  // RANDOM_H_
@@ -0,0 +1,196 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Hierarchical scoped profiler with per thread call trees.
+ *************************************************************************/
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+#include "common/timer.h"
+#include "common/scope_profiler.h"
+
+std::atomic<bool> ScopeProfiler::enabled_(false);
+
+namespace {
+// Node of trees of all threads merged by path
+struct MergedNode {
+  std::string name;
+  int threads     = 0;
+  int last_thread = -1;
+  uint64_t count  = 0;
+  uint64_t total  = 0;
+  uint64_t child  = 0;
+  std::vector<int> children;
+};
+
+double ToMs(uint64_t ns) {
+  return ns / 1e6;
+}
+
+// A scope still open has no total yet while its closed children already count, so clamp at 0.
+uint64_t SelfTime(uint64_t total, uint64_t child) {
+  return total > child ? total - child : 0;
+}
+}  // namespace
+
+ScopeProfiler *ScopeProfiler::Get() {
+  static ScopeProfiler profiler;
+  return &profiler;
+}
+
+ScopeProfiler::ThreadTree *ScopeProfiler::Local() {
+  // shared with trees_, so trees of finished threads are still there for reports
+  thread_local std::shared_ptr<ThreadTree> tree;
+  if (!tree) {
+    tree = std::make_shared<ThreadTree>();
+    tree->nodes.resize(1);
+    std::lock_guard<std::mutex> lock(mutex_);
+    tree->name = "thread_" + std::to_string(trees_.size());
+    trees_.push_back(tree);
+  }
+  return tree.get();
+}
+
+void ScopeProfiler::SetThreadName(const std::string &name) {
+  auto tree = Local();
+  std::lock_guard<std::mutex> lock(tree->mutex);
+  tree->name = name;
+}
+
+int ScopeProfiler::Enter(const char *name) {
+  auto tree = Local();
+  std::lock_guard<std::mutex> lock(tree->mutex);
+  auto &nodes = tree->nodes;
+  for (auto e_ : nodes[tree->current].children) {
+    if (nodes[e_].name == name) {
+      return tree->current = e_;
+    }
+  }
+  int idx = nodes.size();
+  nodes.emplace_back();
+  nodes[idx].name   = name;
+  nodes[idx].parent = tree->current;
+  nodes[tree->current].children.push_back(idx);
+  return tree->current = idx;
+}
+
+void ScopeProfiler::Exit(int node, uint64_t ns) {
+  auto tree = Local();
+  std::lock_guard<std::mutex> lock(tree->mutex);
+  auto &n = tree->nodes[node];
+  n.count += 1;
+  n.total += ns;
+  tree->nodes[n.parent].child += ns;
+  tree->current = n.parent;
+}
+
+std::string ScopeProfiler::Table() const {
+  std::vector<MergedNode> merged(1);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t t = 0; t < trees_.size(); ++t) {
+      std::lock_guard<std::mutex> tree_lock(trees_[t]->mutex);
+      const auto &nodes = trees_[t]->nodes;
+      // (node in this tree, node in merged tree)
+      std::vector<std::pair<int, int>> stack = {{0, 0}};
+      while (!stack.empty()) {
+        auto top = stack.back();
+        stack.pop_back();
+        for (auto c : nodes[top.first].children) {
+          int m = -1;
+          for (auto e_ : merged[top.second].children) {
+            if (merged[e_].name == nodes[c].name) {
+              m = e_;
+              break;
+            }
+          }
+          if (m < 0) {
+            m = merged.size();
+            merged.emplace_back();
+            merged[m].name = nodes[c].name;
+            merged[top.second].children.push_back(m);
+          }
+          auto &mn = merged[m];
+          if (mn.last_thread != int(t)) {
+            mn.last_thread = t;
+            mn.threads += 1;
+          }
+          mn.count += nodes[c].count;
+          mn.total += nodes[c].total;
+          mn.child += nodes[c].child;
+          stack.push_back({c, m});
+        }
+      }
+    }
+  }
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << std::setw(40) << std::left << "Scope" << std::setw(9) << "Threads" << std::setw(10)
+     << "Count" << std::setw(14) << "Total(ms)" << std::setw(14) << "Self(ms)"
+     << "Avg(ms)\n";
+  // (node, depth) in preorder, children by first entered
+  std::vector<std::pair<int, int>> stack;
+  for (auto it = merged[0].children.rbegin(); it != merged[0].children.rend(); ++it) {
+    stack.push_back({*it, 0});
+  }
+  while (!stack.empty()) {
+    auto top = stack.back();
+    stack.pop_back();
+    const auto &n = merged[top.first];
+    ss << std::setw(40) << std::string(2 * top.second, ' ') + n.name << std::setw(9) << n.threads
+       << std::setw(10) << n.count << std::setw(14) << ToMs(n.total) << std::setw(14)
+       << ToMs(SelfTime(n.total, n.child)) << (n.count ? ToMs(n.total) / n.count : 0.0) << "\n";
+    for (auto it = n.children.rbegin(); it != n.children.rend(); ++it) {
+      stack.push_back({*it, top.second + 1});
+    }
+  }
+  return ss.str();
+}
+
+std::string ScopeProfiler::Folded() const {
+  std::stringstream ss;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &tree : trees_) {
+    std::lock_guard<std::mutex> tree_lock(tree->mutex);
+    const auto &nodes = tree->nodes;
+    // (node, its stack)
+    std::vector<std::pair<int, std::string>> stack = {{0, tree->name}};
+    while (!stack.empty()) {
+      auto top = stack.back();
+      stack.pop_back();
+      for (auto c : nodes[top.first].children) {
+        std::string path = top.second + ";" + nodes[c].name;
+        uint64_t self_us = SelfTime(nodes[c].total, nodes[c].child) / EnvTime::kMicrosToNanos;
+        if (self_us > 0) {
+          ss << path << " " << self_us << "\n";
+        }
+        stack.push_back({c, path});
+      }
+    }
+  }
+  return ss.str();
+}
+
+bool ScopeProfiler::WriteFolded(const std::string &path) const {
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+  out << Folded();
+  return bool(out);
+}
+
+ScopedProfile::ScopedProfile(const char *name) {
+  if (!ScopeProfiler::Enabled()) {
+    return;
+  }
+  node_  = ScopeProfiler::Get()->Enter(name);
+  start_ = FastClock::NowNanos();
+}
+
+ScopedProfile::~ScopedProfile() {
+  if (node_ < 0) {
+    return;
+  }
+  ScopeProfiler::Get()->Exit(node_, FastClock::NowNanos() - start_);
+}
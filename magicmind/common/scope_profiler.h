@@ -0,0 +1,88 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Hierarchical scoped profiler with per thread call trees.
+ *************************************************************************/
+#ifndef SCOPE_PROFILER_H_
+#define SCOPE_PROFILER_H_
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+/*
+ * ScopeProfiler keeps one call tree per thread. Each ScopedProfile enters a child of the scope
+ * currently open on its thread, so nested scopes build a path such as infer;Query;H2D, and
+ * repeated scopes on the same path are aggregated into one node with count and total time. Self
+ * time is total time minus the time of child scopes.
+ *
+ * Reports merge trees of all threads by path:
+ *   Table():  indented summary with threads/count/total/self/avg per path
+ *   Folded(): "thread;scope;...;scope self_us" lines, input of flamegraph.pl
+ *
+ * Disabled by default, a ScopedProfile then costs one relaxed atomic load. Take reports after the
+ * profiled threads are done, scopes still open are not counted.
+ */
+class ScopeProfiler {
+ public:
+  static ScopeProfiler *Get();
+  static void Enable(bool enable) { enabled_.store(enable, std::memory_order_relaxed); }
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+  /*
+   * Label for calling thread, used as root of its stacks in Folded(). Defaults to thread_<n> by
+   * order of first scope.
+   */
+  void SetThreadName(const std::string &name);
+  std::string Table() const;
+  std::string Folded() const;
+  bool WriteFolded(const std::string &path) const;
+
+ private:
+  friend class ScopedProfile;
+  struct Node {
+    std::string name;
+    int parent       = -1;
+    uint64_t count   = 0;
+    uint64_t total   = 0;
+    uint64_t child   = 0;
+    std::vector<int> children;
+  };
+  struct ThreadTree {
+    std::mutex mutex;
+    std::string name;
+    // nodes[0] is the root, its children are the outermost scopes
+    std::vector<Node> nodes;
+    int current = 0;
+  };
+  ScopeProfiler() = default;
+  ThreadTree *Local();
+  int Enter(const char *name);
+  void Exit(int node, uint64_t ns);
+
+ private:
+  static std::atomic<bool> enabled_;
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadTree>> trees_;
+};
+/*
+ * Profile from construction to destruction, e.g.
+ *   {
+ *     ScopedProfile scope("DeserializeModel");
+ *     model->DeserializeFromFile(path);
+ *   }
+ */
+class ScopedProfile {
+ public:
+  explicit ScopedProfile(const char *name);
+  explicit ScopedProfile(const std::string &name) : ScopedProfile(name.c_str()) {}
+  ~ScopedProfile();
+
+ private:
+  ScopedProfile() = delete;
+  ScopedProfile(const ScopedProfile &) = delete;
+  ScopedProfile &operator=(const ScopedProfile &) = delete;
+  int node_       = -1;
+  uint64_t start_ = 0;
+};
+
+#endif  // SCOPE_PROFILER_H_
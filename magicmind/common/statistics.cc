@@ -0,0 +1,173 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Streaming tensor statistics and host side calibration ranges.
+ *************************************************************************/
+#include <sstream>
+#include "common/json_util.h"
+#include "common/logger.h"
+#include "common/macros.h"
+#include "common/statistics.h"
+
+namespace {
+json11::Json CustomRanges(const std::map<std::string, std::pair<double, double>> &ranges) {
+  json11::Json::object tensors;
+  for (auto e_ : ranges) {
+    tensors[e_.first] = json11::Json::object{{"min", json11::Json::array{e_.second.first}},
+                                             {"max", json11::Json::array{e_.second.second}}};
+  }
+  return json11::Json::object{{"custom_ranges", tensors}};
+}
+}  // namespace
+
+TensorStatistics::TensorStatistics(int bins) : bins_(bins), hist_(bins, 0) {
+  if (bins_ < 2 || bins_ % 2) {
+    SLOG(ERROR) << "Histogram bins for TensorStatistics must be a positive even number, got "
+                << bins_ << ".";
+    abort();
+  }
+}
+
+void TensorStatistics::GrowHistogram(double abs_max) {
+  if (hist_max_ == 0) {
+    // smallest power of two covering abs_max, so histograms of any instance align
+    int exp   = 0;
+    double m  = std::frexp(abs_max, &exp);
+    hist_max_ = abs_max > 0 ? std::ldexp(1.0, m == 0.5 ? exp - 1 : exp) : std::ldexp(1.0, -64);
+    return;
+  }
+  const int half = bins_ / 2;
+  while (abs_max > hist_max_) {
+    for (int i = 0; i < half; ++i) {
+      hist_[i] = hist_[2 * i] + hist_[2 * i + 1];
+    }
+    std::fill(hist_.begin() + half, hist_.end(), 0);
+    hist_max_ *= 2;
+  }
+}
+
+void TensorStatistics::Merge(const TensorStatistics &other) {
+  CHECK_EQ(bins_, other.bins_);
+  if (!other.count_) {
+    non_finite_ += other.non_finite_;
+    return;
+  }
+  TensorStatistics aligned(other);
+  GrowHistogram(other.hist_max_);
+  aligned.GrowHistogram(hist_max_);
+  for (int i = 0; i < bins_; ++i) {
+    hist_[i] += aligned.hist_[i];
+  }
+  double delta = other.mean_ - mean_;
+  uint64_t n   = count_ + other.count_;
+  mean_ += delta * other.count_ / n;
+  m2_ += other.m2_ + delta * delta * (double(count_) * other.count_ / n);
+  count_ = n;
+  non_finite_ += other.non_finite_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+std::pair<double, double> TensorStatistics::PercentileRange(double percentile) const {
+  if (!count_) {
+    return std::make_pair(0.0, 0.0);
+  }
+  const double width  = hist_max_ / bins_;
+  const double target = count_ * std::min(std::max(percentile, 0.0), 100.0) / 100;
+  double threshold    = hist_max_;
+  uint64_t sum        = 0;
+  for (int i = 0; i < bins_; ++i) {
+    sum += hist_[i];
+    if (sum >= target) {
+      threshold = (i + 1) * width;
+      break;
+    }
+  }
+  return std::make_pair(std::max(min_, -threshold), std::min(max_, threshold));
+}
+
+std::pair<double, double> TensorStatistics::KLRange(int quant_levels) const {
+  if (!count_) {
+    return std::make_pair(0.0, 0.0);
+  }
+  CHECK_LE(1, quant_levels);
+  const double width = hist_max_ / bins_;
+  // only search up to the last non empty bin
+  int last = bins_;
+  while (last > 1 && !hist_[last - 1]) {
+    --last;
+  }
+  if (last <= quant_levels) {
+    return std::make_pair(min_, max_);
+  }
+  std::vector<double> p(last);
+  std::vector<double> q(last);
+  double best_kl = std::numeric_limits<double>::max();
+  int best_i     = last;
+  for (int i = quant_levels; i <= last; ++i) {
+    // reference: first i bins, with the clipped tail folded into the last one
+    double outliers = 0;
+    for (int j = i; j < last; ++j) {
+      outliers += hist_[j];
+    }
+    double p_sum = 0;
+    for (int j = 0; j < i; ++j) {
+      p[j] = hist_[j];
+      p_sum += p[j];
+    }
+    p[i - 1] += outliers;
+    p_sum += outliers;
+    // candidate: first i bins merged into quant_levels levels, spread back over non empty bins
+    double q_sum = 0;
+    for (int level = 0; level < quant_levels; ++level) {
+      int begin     = static_cast<int>(int64_t(level) * i / quant_levels);
+      int end       = static_cast<int>(int64_t(level + 1) * i / quant_levels);
+      double total  = 0;
+      int non_empty = 0;
+      for (int j = begin; j < end; ++j) {
+        total += hist_[j];
+        non_empty += (hist_[j] != 0);
+      }
+      for (int j = begin; j < end; ++j) {
+        q[j] = (hist_[j] && non_empty) ? total / non_empty : 0;
+        q_sum += q[j];
+      }
+    }
+    if (q_sum == 0) {
+      continue;
+    }
+    double kl = 0;
+    for (int j = 0; j < i; ++j) {
+      if (p[j] == 0) {
+        continue;
+      }
+      double pj = p[j] / p_sum;
+      // tail bin can be non empty in p but empty in q, smooth it
+      double qj = std::max(q[j] / q_sum, 1e-12);
+      kl += pj * std::log(pj / qj);
+    }
+    if (kl < best_kl) {
+      best_kl = kl;
+      best_i  = i;
+    }
+  }
+  // upper edge of the last kept bin, the clipped tail is folded into it
+  double threshold = best_i * width;
+  return std::make_pair(std::max(min_, -threshold), std::min(max_, threshold));
+}
+
+std::string TensorStatistics::DebugString() const {
+  std::stringstream ret;
+  ret << "Count: " << count_ << ", NonFinite: " << non_finite_ << ", Min: " << Min()
+      << ", Max: " << Max() << ", AbsMax: " << AbsMax() << ", Mean: " << Mean()
+      << ", Std: " << std::sqrt(Variance());
+  return ret.str();
+}
+
+std::string CustomRangesToJson(const std::map<std::string, std::pair<double, double>> &ranges) {
+  return WriteJsonToString(CustomRanges(ranges));
+}
+
+bool WriteCustomRangesToFile(const std::string &path,
+                             const std::map<std::string, std::pair<double, double>> &ranges) {
+  return WriteJsonToFile(path, CustomRanges(ranges));
+}
@@ -0,0 +1,136 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Streaming tensor statistics and host side calibration ranges.
+ *************************************************************************/
+#ifndef STATISTICS_H_
+#define STATISTICS_H_
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+/*
+ * TensorStatistics accumulates min/max, mean/variance, absolute max and a histogram of |x| over any
+ * number of Update calls, without keeping the data. Results of different threads or samples can be
+ * merged and are equal to one pass over all data (up to float rounding of mean/variance).
+ *
+ * The histogram has bins_ equal width bins over [0, hist_max_], where hist_max_ is a power of two.
+ * When a larger |x| arrives, hist_max_ doubles and pairs of bins are folded, so two histograms can
+ * always be brought to the same range before merging.
+ */
+class TensorStatistics {
+ public:
+  explicit TensorStatistics(int bins = 2048);
+  /*
+   * To stream count elements of data into the statistics. NaN/Inf are counted apart and skipped.
+   */
+  template <typename T>
+  void Update(const T *data, uint64_t count);
+  void Merge(const TensorStatistics &other);
+
+  uint64_t Count() const { return count_; }
+  uint64_t NonFinite() const { return non_finite_; }
+  double Min() const { return min_; }
+  double Max() const { return max_; }
+  double AbsMax() const { return std::max(std::fabs(min_), std::fabs(max_)); }
+  double Mean() const { return mean_; }
+  double Variance() const { return count_ ? m2_ / count_ : 0; }
+  const std::vector<uint64_t> &Histogram() const { return hist_; }
+  double HistogramMax() const { return hist_max_; }
+  /*
+   * Range clipping |x| at the given percentile (e.g. 99.99) of the histogram, intersected with
+   * [Min(), Max()].
+   */
+  std::pair<double, double> PercentileRange(double percentile) const;
+  /*
+   * Range with the clipping threshold minimizing KL divergence between the histogram and its
+   * quant_levels level quantization, as entropy calibration does. quant_levels is 128 for int8,
+   * intersected with [Min(), Max()]. Data within the first quant_levels bins gives
+   * [Min(), Max()], so quant_levels must stay well below bins.
+   */
+  std::pair<double, double> KLRange(int quant_levels = 128) const;
+  std::string DebugString() const;
+
+ private:
+  void GrowHistogram(double abs_max);
+  template <typename T>
+  void UpdateBlock(const T *data, uint64_t count);
+
+ private:
+  int bins_            = 0;
+  uint64_t count_      = 0;
+  uint64_t non_finite_ = 0;
+  double min_          = std::numeric_limits<double>::max();
+  double max_          = std::numeric_limits<double>::lowest();
+  double mean_         = 0;
+  double m2_           = 0;
+  double hist_max_     = 0;
+  std::vector<uint64_t> hist_;
+};
+
+template <typename T>
+void TensorStatistics::Update(const T *data, uint64_t count) {
+  // Blocks stay in L1 between the min/max/sum pass and the m2/histogram pass.
+  const uint64_t kBlock = 4096;
+  for (uint64_t i = 0; i < count; i += kBlock) {
+    UpdateBlock(data + i, std::min(kBlock, count - i));
+  }
+}
+
+template <typename T>
+void TensorStatistics::UpdateBlock(const T *data, uint64_t count) {
+  float block_min = std::numeric_limits<float>::max();
+  float block_max = std::numeric_limits<float>::lowest();
+  double sum      = 0;
+  uint64_t valid  = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    float v = static_cast<float>(data[i]);
+    if (!std::isfinite(v)) {
+      continue;
+    }
+    block_min = std::min(block_min, v);
+    block_max = std::max(block_max, v);
+    sum += v;
+    ++valid;
+  }
+  non_finite_ += count - valid;
+  if (!valid) {
+    return;
+  }
+  double block_mean = sum / valid;
+  GrowHistogram(std::max(std::fabs(block_min), std::fabs(block_max)));
+  const double scale = bins_ / hist_max_;
+  double block_m2    = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    float v = static_cast<float>(data[i]);
+    if (!std::isfinite(v)) {
+      continue;
+    }
+    double d = v - block_mean;
+    block_m2 += d * d;
+    int bin = std::min(static_cast<int>(std::fabs(v) * scale), bins_ - 1);
+    ++hist_[bin];
+  }
+  // Chan et al. parallel variance combination
+  double delta = block_mean - mean_;
+  uint64_t n   = count_ + valid;
+  mean_ += delta * valid / n;
+  m2_ += block_m2 + delta * delta * (double(count_) * valid / n);
+  count_ = n;
+  min_   = std::min<double>(min_, block_min);
+  max_   = std::max<double>(max_, block_max);
+}
+/*
+ * To write ranges as MagicMind build config, e.g.
+ * {"custom_ranges": {"tensor_name": {"min": [-1.5], "max": [1.5]}}}
+ * An empty tensor name sets the range for all tensors without their own.
+ */
+std::string CustomRangesToJson(const std::map<std::string, std::pair<double, double>> &ranges);
+
+bool WriteCustomRangesToFile(const std::string &path,
+                             const std::map<std::string, std::pair<double, double>> &ranges);
+
+#endif  // STATISTICS_H_
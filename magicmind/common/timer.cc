@@ -2,7 +2,15 @@
  * Copyright (C) [2020-2023] by Cambricon, Inc.
  * Description: An timer implement for system time and program benchmark.
  *************************************************************************/
+#include <unistd.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <string>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
 #include "common/logger.h"
 #include "common/timer.h"
 
@@ -25,12 +33,101 @@ std::string EnvTime::CurrentTime() {
   return std::string(time_buffer);
 }
 
-TimeCollapse::TimeCollapse(const std::string &name) : name_(name) {
-  start_ = EnvTime::NowMicros(CLOCK_MONOTONIC);
+FastClock::State FastClock::state_;
+
+namespace {
+// One (counter, CLOCK_MONOTONIC) pair, taking the tightest bracket of a few tries so that a
+// preemption between the two reads does not skew the calibration.
+struct ClockPair {
+  uint64_t ticks;
+  uint64_t nanos;
+};
+
+template <typename ReadTicks>
+ClockPair SamplePair(ReadTicks read_ticks) {
+  ClockPair best{0, 0};
+  uint64_t best_gap = UINT64_MAX;
+  for (int i = 0; i < 5; ++i) {
+    uint64_t before = EnvTime::NowNanos(CLOCK_MONOTONIC);
+    uint64_t ticks  = read_ticks();
+    uint64_t after  = EnvTime::NowNanos(CLOCK_MONOTONIC);
+    if (after - before < best_gap) {
+      best_gap = after - before;
+      best     = {ticks, before + (after - before) / 2};
+    }
+  }
+  return best;
+}
+
+bool CounterIsInvariant() {
+#if defined(__x86_64__)
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  if (!(edx & (1u << 8))) {
+    return false;
+  }
+  // The kernel drops tsc from its clocksources once its watchdog finds it unstable
+  // (unsynced sockets, broken firmware, ...), trust that verdict over cpuid when available.
+  std::ifstream sources("/sys/devices/system/clocksource/clocksource0/available_clocksource");
+  std::string line;
+  if (sources && std::getline(sources, line)) {
+    return line.find("tsc") != std::string::npos;
+  }
+  return true;
+#elif defined(__aarch64__)
+  // The generic timer runs at a fixed frequency regardless of core power states.
+  return true;
+#else
+  return false;
+#endif
+}
+}  // namespace
+
+bool FastClock::Calibrate() {
+  const char *env = getenv("SAMPLE_CLOCK");
+  if ((env && strcmp(env, "monotonic") == 0) || !CounterIsInvariant()) {
+    state_.enabled = false;
+    return false;
+  }
+  // Measure the tick rate over two consecutive windows, a counter which can not agree with
+  // itself within 200 ppm is not one to build timestamps on.
+  const useconds_t kWindowMicros = 10000;
+  ClockPair p0 = SamplePair(ReadTicks);
+  usleep(kWindowMicros);
+  ClockPair p1 = SamplePair(ReadTicks);
+  usleep(kWindowMicros);
+  ClockPair p2 = SamplePair(ReadTicks);
+  if (p1.ticks <= p0.ticks || p2.ticks <= p1.ticks) {
+    state_.enabled = false;
+    return false;
+  }
+  double rate1 = double(p1.ticks - p0.ticks) / double(p1.nanos - p0.nanos);
+  double rate2 = double(p2.ticks - p1.ticks) / double(p2.nanos - p1.nanos);
+  if (std::fabs(rate1 - rate2) / rate1 > 2e-4) {
+    SLOG(WARNING) << "Counter rate unstable (" << rate1 << " vs " << rate2
+                  << " ticks/ns), FastClock falls back to CLOCK_MONOTONIC.";
+    state_.enabled = false;
+    return false;
+  }
+  double ticks_per_ns = double(p2.ticks - p0.ticks) / double(p2.nanos - p0.nanos);
+  state_.mult       = static_cast<uint64_t>(std::ldexp(1.0 / ticks_per_ns, kShift));
+  state_.base_ticks = p2.ticks;
+  state_.base_nanos = p2.nanos;
+  state_.enabled    = true;
+  SLOG(INFO) << "FastClock uses " << Source() << " at " << ticks_per_ns << " GHz.";
+  return true;
 }
 
-TimeCollapse::~TimeCollapse() {
-  uint64_t end = EnvTime::NowMicros(CLOCK_MONOTONIC);
-  uint64_t dur = end - start_;
-  SLOG(INFO) << name_ << " time is " << float(dur) / 1000 << " ms.";
+const char *FastClock::Source() {
+  if (!state_.enabled) {
+    return "clock_gettime(CLOCK_MONOTONIC)";
+  }
+#if defined(__x86_64__)
+  return "invariant tsc";
+#else
+  return "cntvct_el0";
+#endif
 }
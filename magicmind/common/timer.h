@@ -5,6 +5,8 @@
 #ifndef TIMER_H_
 #define TIMER_H_
 #include <time.h>
+#include <stdint.h>
+#include <string>
 #define TimeBufferSize 30
 /*
  * A struct using clock_gettime() for system time and steady time.
@@ -18,17 +20,53 @@ struct EnvTime {
 };
 
 /*
- * A class to calculate time from its construction to destruction.
+ * A low overhead monotonic clock for hot path timestamps (stage interface timing etc.).
+ * Reads the invariant TSC on x86_64 or the virtual counter on aarch64 and converts ticks to
+ * nanoseconds with a ratio calibrated against CLOCK_MONOTONIC, so readings stay comparable with
+ * EnvTime::NowNanos(CLOCK_MONOTONIC). Calibrate() must run once before worker threads start;
+ * until then, on other archs, when the counter is not invariant or fails calibration, or when
+ * environment SAMPLE_CLOCK=monotonic is set, it falls back to clock_gettime(CLOCK_MONOTONIC).
  */
-class TimeCollapse {
+class FastClock {
  public:
-  TimeCollapse(const std::string &name);
-  ~TimeCollapse();
+  static bool Calibrate();
+  static bool Enabled() { return state_.enabled; }
+  static const char *Source();
+  static uint64_t NowNanos() {
+#if defined(__x86_64__) || defined(__aarch64__)
+    if (state_.enabled) {
+      // signed, a core whose counter trails the calibrating one by a few ticks stays sane
+      __int128 delta = static_cast<int64_t>(ReadTicks() - state_.base_ticks);
+      return state_.base_nanos + static_cast<uint64_t>((delta * state_.mult) >> kShift);
+    }
+#endif
+    return EnvTime::NowNanos(CLOCK_MONOTONIC);
+  }
+  static uint64_t NowMicros() { return NowNanos() / EnvTime::kMicrosToNanos; }
 
  private:
-  uint64_t start_;
-  std::string name_;
-  TimeCollapse() = delete;
+  static constexpr int kShift = 32;
+  static uint64_t ReadTicks() {
+#if defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return 0;
+#endif
+  }
+  struct State {
+    bool enabled{false};
+    uint64_t base_ticks{0};
+    uint64_t base_nanos{0};
+    // nanoseconds per tick in 32.32 fixed point
+    uint64_t mult{0};
+  };
+  static State state_;
 };
 
 #endif  // TIMER_H_
@@ -56,9 +56,45 @@ class BuildParam : public ArgListBase {
   DECLARE_ARG(calibration_data_path, (std::string))
       ->SetDescription("Directory for calibration data. MUST input with file_list.")
       ->SetDefault({});
+  DECLARE_ARG(calibration_io_threads, (int))
+      ->SetDescription(
+          "Threads to read calibration files of one batch in parallel, while the next batch is "
+          "prefetched in background. 0 means reading synchronously.")
+      ->SetDefault({"4"});
+  DECLARE_ARG(calibration_verbose, (bool))
+      ->SetDescription("To log every calibration file path when reading.")
+      ->SetDefault({"false"});
+  DECLARE_ARG(calibration_cache_dir, (std::string))
+      ->SetDescription(
+          "Directory to cache packed calibration batches, keyed by file list, datatype and shape. "
+          "Builds with the same calibration inputs map batches from it instead of reading files.")
+      ->SetDefault({});
+  DECLARE_ARG(calibration_batch_size, (std::vector<int>))
+      ->SetDescription(
+          "For calibration files with shapes in file list. Files with the same shape except the "
+          "highest dim are packed into one batch up to this size, one value per shape group in "
+          "order of first appearance, or one value for all. Default one file per batch.")
+      ->SetDefault({});
+  DECLARE_ARG(calibration_shape_ratios, (std::vector<float>))
+      ->SetDescription(
+          "For calibration files with shapes in file list. Ratios of batches to cycle shape "
+          "groups, e.g. 2,1 for twice as many batches of the first shape. 0 skips a group. "
+          "Default equal.")
+      ->SetDefault({});
   DECLARE_ARG(random_calib_range, (std::vector<float>))
       ->SetDescription("Set random range for calibration. Will override path and filelist.")
       ->SetDefault({});
+  DECLARE_ARG(custom_ranges, (std::string))
+      ->SetDescription(
+          "Json file with custom_ranges for tensors, e.g., computed from host TensorStatistics. "
+          "Will skip calibration passes and override random range, path and filelist.")
+      ->SetDefault({});
+  DECLARE_ARG(calibration_input_ranges, (std::string))
+      ->SetDescription(
+          "Json file to write custom_ranges of network inputs, computed on host by "
+          "TensorStatistics from file_list and calibration_data_path. Can be given back as "
+          "custom_ranges.")
+      ->SetDefault({});
   DECLARE_ARG(batch_size, (std::vector<int>))
       ->SetDescription(
           "Input batchsize by order, will override all highest dimensions for all inputs and not "
@@ -104,6 +140,41 @@ class BuildParam : public ArgListBase {
   DECLARE_ARG(magicmind_model, (std::string))
       ->SetDescription("File path for output serialization model file.")
       ->SetDefault({"./model"});
+  DECLARE_ARG(build_variants, (std::vector<std::string>))
+      ->SetDescription(
+          "Variants to build from one parsed network, each as precision:mlu_arch, e.g. "
+          "qint8_mixed_float16:mtp_372,force_float16:mtp_592. An empty part keeps precision or "
+          "mlu_arch param. Each variant is serialized to magicmind_model_precision_arch.")
+      ->SetDefault({});
+  DECLARE_ARG(build_threads, (int))
+      ->SetDescription(
+          "Variants to calibrate and build concurrently. 1 means one by one, 0 means a quarter of "
+          "host cores, at most the number of variants.")
+      ->SetDefault({"0"});
+  DECLARE_ARG(build_profile, (std::string))
+      ->SetDescription(
+          "Json file to write time and memory of build phases to. The table is always logged.")
+      ->SetDefault({});
+  DECLARE_ARG(build_cache, (bool))
+      ->SetDescription(
+          "To skip building a model whose inputs (model files, params, build_config, "
+          "custom_ranges, plugin libraries, calibration lists and files) are unchanged since it was "
+          "built. The hash of inputs is stored next to the model as magicmind_model.build_hash.")
+      ->SetDefault({"false"});
+  DECLARE_ARG(log_level, (std::string))
+      ->SetDescription(
+          "Minimum severity to log, lower ones are skipped without formatting. Defaults to "
+          "environment SAMPLE_LOG_LEVEL or INFO.")
+      ->SetAlternative({"INFO", "WARNING", "ERROR"})
+      ->SetDefault({});
+  DECLARE_ARG(log_async, (bool))
+      ->SetDescription(
+          "Write logs from a background thread so calibration threads do not block on stderr.")
+      ->SetDefault({"false"});
+  DECLARE_ARG(log_file, (std::string))
+      ->SetDescription(
+          "Also write logs to log_file, rotated every 64MB keeping 5 files. Implies log_async.")
+      ->SetDefault({});
   DECLARE_ARG(build_config, (std::string))
       ->SetDescription(
           "Additional json build config for build. Config json will override other arg params.")
@@ -0,0 +1,181 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Per phase wall time and memory profiler for building models.
+ *************************************************************************/
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include "common/json_util.h"
+#include "common/timer.h"
+#include "mm_build/build_profiler.h"
+
+namespace {
+double ToMB(uint64_t bytes) {
+  return bytes / 1024.0 / 1024.0;
+}
+
+uint64_t NowMicros() {
+  return EnvTime::NowMicros(CLOCK_MONOTONIC);
+}
+}  // namespace
+
+BuildProfiler *BuildProfiler::Get() {
+  static BuildProfiler profiler;
+  return &profiler;
+}
+
+BuildProfiler::BuildProfiler() : begin_(NowMicros()) {}
+
+BuildProfiler::~BuildProfiler() {
+  StopSampling();
+}
+
+uint64_t BuildProfiler::CurrentRSS() {
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (!fp) {
+    return 0;
+  }
+  unsigned long long size = 0, resident = 0;
+  int n = fscanf(fp, "%llu %llu", &size, &resident);
+  fclose(fp);
+  return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+uint64_t BuildProfiler::PeakRSS() {
+  FILE *fp = fopen("/proc/self/status", "r");
+  if (!fp) {
+    return 0;
+  }
+  char line[256];
+  unsigned long long kb = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    if (!strncmp(line, "VmHWM:", 6)) {
+      sscanf(line + 6, "%llu", &kb);
+      break;
+    }
+  }
+  fclose(fp);
+  return kb * 1024;
+}
+
+void BuildProfiler::StartSampling(int sample_ms) {
+  if (sampler_.joinable()) {
+    return;
+  }
+  stop_    = false;
+  sampler_ = std::thread([this, sample_ms]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto period = std::chrono::milliseconds(sample_ms);
+    while (!stop_cv_.wait_for(lock, period, [this] { return stop_; })) {
+      lock.unlock();
+      Sample();
+      lock.lock();
+    }
+  });
+}
+
+void BuildProfiler::StopSampling() {
+  if (!sampler_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  sampler_.join();
+}
+
+void BuildProfiler::Sample() {
+  uint64_t rss = CurrentRSS();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto e_ : active_) {
+    e_->peak_rss = std::max(e_->peak_rss, rss);
+  }
+}
+
+void BuildProfiler::Add(const std::string &name,
+                        uint64_t start,
+                        uint64_t us,
+                        uint64_t peak,
+                        int64_t delta) {
+  uint64_t rss = CurrentRSS();
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &phase = phases_[name];
+  if (!phase.count) {
+    phase.first_started = start;
+  }
+  phase.count += 1;
+  phase.us += us;
+  phase.peak_rss = std::max(phase.peak_rss, std::max(peak, rss));
+  phase.end_rss  = rss;
+  phase.rss_delta += delta;
+}
+
+std::vector<std::pair<std::string, BuildProfiler::Phase>> BuildProfiler::Sorted() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::pair<std::string, Phase>> ret(phases_.begin(), phases_.end());
+  std::stable_sort(ret.begin(), ret.end(),
+                   [](const std::pair<std::string, Phase> &a,
+                      const std::pair<std::string, Phase> &b) {
+                     return a.second.first_started < b.second.first_started;
+                   });
+  return ret;
+}
+
+std::string BuildProfiler::Table() const {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1);
+  ss << std::setw(28) << std::left << "Phase" << std::setw(8) << "Count" << std::setw(14)
+     << "Total(ms)" << std::setw(14) << "Mean(ms)" << std::setw(16) << "PeakRSS(MB)"
+     << "RSSDelta(MB)\n";
+  for (auto e_ : Sorted()) {
+    auto &p = e_.second;
+    ss << std::setw(28) << e_.first << std::setw(8) << p.count << std::setw(14) << p.us / 1000.0
+       << std::setw(14) << p.us / 1000.0 / p.count << std::setw(16) << ToMB(p.peak_rss)
+       << p.rss_delta / 1024.0 / 1024.0 << "\n";
+  }
+  ss << "Wall time " << (NowMicros() - begin_) / 1000.0 << " ms, process peak RSS "
+     << ToMB(PeakRSS()) << " MB.\n";
+  return ss.str();
+}
+
+bool BuildProfiler::WriteJson(const std::string &path) const {
+  json11::Json::array phases;
+  for (auto e_ : Sorted()) {
+    auto &p = e_.second;
+    phases.push_back(json11::Json::object{{"name", e_.first},
+                                          {"count", p.count},
+                                          {"total_ms", p.us / 1000.0},
+                                          {"start_ms", (double(p.first_started) - begin_) / 1000.0},
+                                          {"peak_rss_mb", ToMB(p.peak_rss)},
+                                          {"end_rss_mb", ToMB(p.end_rss)},
+                                          {"rss_delta_mb", p.rss_delta / 1024.0 / 1024.0}});
+  }
+  json11::Json::object root{{"wall_ms", (NowMicros() - begin_) / 1000.0},
+                            {"peak_rss_mb", ToMB(PeakRSS())},
+                            {"phases", phases}};
+  return WriteJsonToFile(path, root);
+}
+
+ScopedPhase::ScopedPhase(const std::string &name) : name_(name) {
+  start_           = NowMicros();
+  start_rss_       = BuildProfiler::CurrentRSS();
+  active_.peak_rss = start_rss_;
+  auto profiler    = BuildProfiler::Get();
+  std::lock_guard<std::mutex> lock(profiler->mutex_);
+  profiler->active_.insert(&active_);
+}
+
+ScopedPhase::~ScopedPhase() {
+  auto profiler = BuildProfiler::Get();
+  {
+    std::lock_guard<std::mutex> lock(profiler->mutex_);
+    profiler->active_.erase(&active_);
+  }
+  int64_t delta = int64_t(BuildProfiler::CurrentRSS()) - int64_t(start_rss_);
+  profiler->Add(name_, start_, NowMicros() - start_, active_.peak_rss, delta);
+}
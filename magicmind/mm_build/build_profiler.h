@@ -0,0 +1,85 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Per phase wall time and memory profiler for building models.
+ *************************************************************************/
+#ifndef BUILD_PROFILER_H_
+#define BUILD_PROFILER_H_
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+/*
+ * BuildProfiler collects phases of mm_build (parse, calibration, BuildModel, ...), each with wall
+ * time, resident memory at its end and peak resident memory while it was running. Phases with the
+ * same name (e.g. calibration of several variants) are summed up in report.
+ *
+ * Peak memory is sampled by a background thread every sample_ms, so spikes shorter than that may
+ * be missed; the process peak (VmHWM) is exact and reported apart.
+ */
+class BuildProfiler {
+ public:
+  static BuildProfiler *Get();
+  ~BuildProfiler();
+  void StartSampling(int sample_ms = 10);
+  void StopSampling();
+  // Table of phases by first start
+  std::string Table() const;
+  bool WriteJson(const std::string &path) const;
+
+  static uint64_t CurrentRSS();
+  static uint64_t PeakRSS();
+
+ private:
+  friend class ScopedPhase;
+  struct Phase {
+    int count              = 0;
+    uint64_t us            = 0;
+    uint64_t peak_rss      = 0;
+    uint64_t end_rss       = 0;
+    int64_t rss_delta      = 0;
+    uint64_t first_started = 0;
+  };
+  struct Active {
+    uint64_t peak_rss = 0;
+  };
+  BuildProfiler();
+  void Add(const std::string &name, uint64_t start, uint64_t us, uint64_t peak, int64_t delta);
+  void Sample();
+  std::vector<std::pair<std::string, Phase>> Sorted() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, Phase> phases_;
+  std::set<Active *> active_;
+  uint64_t begin_ = 0;
+  std::thread sampler_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
+};
+/*
+ * Phase from construction to destruction, e.g.
+ *   {
+ *     ScopedPhase phase("parse");
+ *     parser.Parse(net);
+ *   }
+ */
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const std::string &name);
+  ~ScopedPhase();
+
+ private:
+  ScopedPhase() = delete;
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+  std::string name_;
+  uint64_t start_     = 0;
+  uint64_t start_rss_ = 0;
+  BuildProfiler::Active active_;
+};
+
+#endif  // BUILD_PROFILER_H_
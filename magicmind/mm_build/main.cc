@@ -10,10 +10,17 @@ int call_main(int argc, char *argv[]) {
   auto args = ArrangeArgs(argc, argv);
   auto param = new ParserParam<Kind>();
   param->ReadIn(args);
+  if (HasValue(param->log_level())) {
+    SetMinLogLevel(LogLevelFromName(Value(param->log_level())));
+  }
+  if (Value(param->log_async()) || HasValue(param->log_file())) {
+    StartAsyncLog(HasValue(param->log_file()) ? Value(param->log_file()) : "");
+  }
   SLOG(INFO) << "\n==================== Parameter Information\n"
              << param->DebugString() << "MagicMind: " << MM_VERSION_STR;
   auto ret = MainProcess<Kind>(param);
   delete param;
+  StopAsyncLog();
   return ret;
 }
 
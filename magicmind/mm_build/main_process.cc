@@ -3,9 +3,20 @@
  * Description:
  *************************************************************************/
 #include <dlfcn.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include "common/data.h"
+#include "common/hash.h"
 #include "common/logger.h"
 #include "common/macros.h"
+#include "common/threadpool.h"
+#include "common/timer.h"
 #include "common/type.h"
+#include "common/layout.h"
+#include "common/statistics.h"
 #include "mm_build/main_process.h"
 
 namespace {
@@ -72,20 +83,193 @@ bool ConvertRGB2BGRForFirstLayer(INetwork *net) {
   }
   return true;
 }
-std::string GetChannelOppositeLayout(const std::string &in) {
-  static const std::unordered_map<std::string, std::string> layouts = {
-      {"NCT", "NTC"}, {"NCHW", "NHWC"}, {"NCDHW", "NDHWC"}};
-  for (auto e_ : layouts) {
-    if (in == e_.first) {
-      return e_.second;
-    } else if (in == e_.second) {
-      return e_.first;
-    }
-  }
-  SLOG(ERROR) << "Unsupport layout convertion";
-  abort();
+
+bool HashBuildInputs(BuildParam *param,
+                     const std::vector<std::string> &model_files,
+                     Hash64 *hash) {
+  hash->Update(std::string(MM_VERSION_STR));
+  // effective params, except those only deciding where or how fast to build
+  const std::set<std::string> ignored = {"build_variants",         "build_threads",
+                                         "build_cache",            "build_profile",
+                                         "magicmind_model",        "calibration_io_threads",
+                                         "calibration_verbose",    "calibration_cache_dir",
+                                         "log_level",              "log_async",
+                                         "log_file",               "calibration_input_ranges"};
+  std::stringstream params(param->DebugString());
+  std::string line;
+  while (std::getline(params, line)) {
+    auto end = line.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789_", 2);
+    if (!ignored.count(line.substr(2, end - 2))) {
+      hash->Update(line);
+    }
+  }
+  std::vector<std::string> files = model_files;
+  if (HasValue(param->build_config())) {
+    files.push_back(Value(param->build_config()));
+  }
+  if (HasValue(param->custom_ranges())) {
+    files.push_back(Value(param->custom_ranges()));
+  }
+  for (auto e_ : Value(param->plugin())) {
+    files.push_back(AddLocalPathIfName(e_));
+  }
+  bool calibration = HasValue(param->calibration()) && Value(param->calibration());
+  auto file_lists  = Value(param->file_list());
+  if (calibration && !HasValue(param->custom_ranges())) {
+    files.insert(files.end(), file_lists.begin(), file_lists.end());
+  }
+  for (auto e_ : files) {
+    hash->Update(e_);
+    if (!hash->UpdateFile(e_)) {
+      return false;
+    }
+  }
+  if (!calibration || HasValue(param->custom_ranges()) || HasValue(param->random_calib_range())) {
+    return true;
+  }
+  // calibration files by path, size and mtime like calibration cache, reading all is too slow
+  for (auto e_ : file_lists) {
+    std::vector<std::string> paths;
+    std::vector<std::vector<int>> shapes;
+    if (!ReadListFromFile(e_, &paths, &shapes)) {
+      return false;
+    }
+    for (auto p_ : paths) {
+      p_ = Value(param->calibration_data_path()) + "/" + p_;
+      struct stat st;
+      if (stat(p_.c_str(), &st) != 0) {
+        SLOG(ERROR) << "Stat calibration file " << p_ << " failed.";
+        return false;
+      }
+      int64_t meta[] = {st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+      hash->Update(p_);
+      hash->Update(meta, sizeof(meta));
+    }
+  }
+  return true;
+}
+
+std::string BuildHashPath(const BuildVariant &variant) {
+  return variant.model + ".build_hash";
+}
+
+bool UpToDate(const BuildVariant &variant) {
+  struct stat st;
+  if (stat(variant.model.c_str(), &st) != 0) {
+    return false;
+  }
+  std::ifstream in(BuildHashPath(variant));
+  std::string hash;
+  int64_t size = -1;
+  in >> hash >> size;
+  return in && hash == variant.hash && size == int64_t(st.st_size);
+}
+
+bool RecordBuildHash(const BuildVariant &variant) {
+  struct stat st;
+  if (stat(variant.model.c_str(), &st) != 0) {
+    return false;
+  }
+  std::ofstream out(BuildHashPath(variant));
+  out << variant.hash << " " << int64_t(st.st_size) << "\n";
+  return bool(out);
+}
+
+// Calibration data of network input i from its file list, nullptr if the list can not be read
+SampleCalibData *CreateFileCalibData(INetwork *net, size_t i, BuildParam *param) {
+  auto data_type = net->GetInput(i)->GetDataType();
+  auto input_dim = net->GetInput(i)->GetDimension();
+  SampleCalibData *file_data = nullptr;
+  std::vector<std::string> files;
+  std::vector<std::vector<int>> shapes;
+  if (!ReadListFromFile(Value(param->file_list())[i], &files, &shapes)) {
+    SLOG(ERROR) << "Read file list failed.";
+    return nullptr;
+  }
+  for (size_t f = 0; f < files.size(); ++f) {
+    files[f] = Value(param->calibration_data_path()) + "/" + files[f];
+  }
+  if (shapes.size()) {
+    // With shape size in file list
+    auto dims = ToDims(shapes);
+    file_data = new SampleCalibData(dims, data_type, files.size(), files);
+    if (dims.size() > 1 && (HasValue(param->calibration_batch_size()) ||
+                            HasValue(param->calibration_shape_ratios()))) {
+      std::vector<int> batch_sizes;
+      std::vector<float> ratios;
+      if (HasValue(param->calibration_batch_size())) {
+        batch_sizes = Value(param->calibration_batch_size());
+      }
+      if (HasValue(param->calibration_shape_ratios())) {
+        ratios = Value(param->calibration_shape_ratios());
+      }
+      file_data->SetDynamicBatching(batch_sizes, ratios);
+    }
+  } else {
+    // Use network shape as input shape.
+    if (input_dim.GetElementCount() == -1) {
+      SLOG(ERROR)
+          << "Can not get elmentcount of calibration set, maybe there is one -1 in its shape.";
+      return nullptr;
+    }
+    file_data = new SampleCalibData(input_dim, data_type, files.size(), files);
+  }
+  file_data->SetIOOptions(Value(param->calibration_io_threads()),
+                          Value(param->calibration_verbose()));
+  if (HasValue(param->calibration_cache_dir())) {
+    file_data->SetCacheDir(Value(param->calibration_cache_dir()));
+  }
+  return file_data;
+}
+
+// Dtypes of all inputs then all outputs
+std::vector<DataType> GetIODataTypes(INetwork *net) {
+  std::vector<DataType> ret;
+  for (size_t i = 0; i < net->GetInputCount(); ++i) {
+    ret.push_back(net->GetInput(i)->GetDataType());
+  }
+  for (size_t i = 0; i < net->GetOutputCount(); ++i) {
+    ret.push_back(net->GetOutput(i)->GetDataType());
+  }
+  return ret;
+}
+
+bool ResetIODataTypes(INetwork *net, const std::vector<DataType> &types) {
+  size_t input_count = net->GetInputCount();
+  for (size_t i = 0; i < types.size(); ++i) {
+    auto tensor = i < input_count ? net->GetInput(i) : net->GetOutput(i - input_count);
+    if (!tensor->SetDataType(types[i]).ok()) {
+      return false;
+    }
+  }
+  return true;
 }
 
+bool UpdateStatistics(TensorStatistics *stats,
+                      const void *data,
+                      DataType data_type,
+                      uint64_t count) {
+#define CASE(type)                                         \
+  case DataTypeToEnum<type>::value: {                      \
+    stats->Update(static_cast<const type *>(data), count); \
+    return true;                                           \
+  }
+  switch (data_type) {
+    CASE(int8_t);
+    CASE(int16_t);
+    CASE(int32_t);
+    CASE(uint8_t);
+    CASE(uint16_t);
+    CASE(uint32_t);
+    CASE(half);
+    CASE(float);
+    default:
+      break;
+  }
+#undef CASE
+  SLOG(ERROR) << "Unsupport datatype for input ranges: " << TypeEnumToString(data_type);
+  return false;
+}
 }  // namespace
 
 void BindCluster(std::stringstream *ss,
@@ -110,23 +294,87 @@ void BindCluster(std::stringstream *ss,
   }
   return;
 } 
-IBuilderConfig *GetConfig(BuildParam *param) {
+std::vector<BuildVariant> GetVariants(BuildParam *param) {
+  BuildVariant base;
+  if (HasValue(param->precision())) {
+    base.precision = Value(param->precision());
+  }
+  base.mlu_arch = Value(param->mlu_arch());
+  base.model    = Value(param->magicmind_model());
+  if (!HasValue(param->build_variants())) {
+    return {base};
+  }
+  std::vector<BuildVariant> variants;
+  for (auto e_ : Value(param->build_variants())) {
+    auto pos             = e_.find(':');
+    BuildVariant variant = base;
+    auto precision       = e_.substr(0, pos);
+    auto arch            = pos == std::string::npos ? "" : e_.substr(pos + 1);
+    if (!precision.empty()) {
+      variant.precision = precision;
+    }
+    if (!arch.empty()) {
+      variant.mlu_arch = {arch};
+    }
+    variant.model += "_" + (variant.precision.empty() ? "default" : variant.precision);
+    for (auto a_ : variant.mlu_arch) {
+      variant.model += "_" + a_;
+    }
+    variants.push_back(variant);
+  }
+  return variants;
+}
+
+bool SkipUnchangedVariants(BuildParam *param,
+                           const std::vector<std::string> &model_files,
+                           std::vector<BuildVariant> *variants) {
+  Hash64 inputs;
+  if (!HashBuildInputs(param, model_files, &inputs)) {
+    SLOG(ERROR) << "Hash build inputs failed.";
+    return false;
+  }
+  std::vector<BuildVariant> outdated;
+  for (auto e_ : *variants) {
+    Hash64 hash = inputs;
+    hash.Update(e_.precision);
+    for (auto a_ : e_.mlu_arch) {
+      hash.Update(a_);
+    }
+    e_.hash = Hash64::ToHex(hash.Digest());
+    if (UpToDate(e_)) {
+      SLOG(INFO) << "Model " << e_.model << " is up to date (" << e_.hash << "), skip building.";
+    } else {
+      outdated.push_back(e_);
+    }
+  }
+  *variants = outdated;
+  return true;
+}
+
+IBuilderConfig *GetConfig(BuildParam *param, const BuildVariant &variant) {
   auto config_ptr_ = CreateIBuilderConfig();
   CHECK_VALID(config_ptr_);
   // arch
-  if (!Value(param->mlu_arch()).empty()) {
-    CHECK_STATUS(config_ptr_->SetMLUArch(Value(param->mlu_arch())));
+  if (!variant.mlu_arch.empty()) {
+    CHECK_STATUS(config_ptr_->SetMLUArch(variant.mlu_arch));
   }
 
   // precision
-  if (HasValue(param->precision())) {
+  if (!variant.precision.empty()) {
     CHECK_STATUS(config_ptr_->ParseFromString("{\"precision_config\":{\"precision_mode\":\"" +
-                                              Value(param->precision()) + "\"}}"));
-  }
-  // cluster num
-  auto cluster_num =  Value(param->cluster_num());
-  auto mlu_arch =  Value(param->mlu_arch());
-  if (cluster_num.size() > 0 && mlu_arch.size() > 0) {
+                                              variant.precision + "\"}}"));
+  }
+  // cluster num, given by order of mlu_arch param
+  auto all_cluster_num = Value(param->cluster_num());
+  auto all_mlu_arch    = Value(param->mlu_arch());
+  auto mlu_arch        = variant.mlu_arch;
+  std::vector<std::vector<int>> cluster_num;
+  for (auto e_ : mlu_arch) {
+    size_t index = std::find(all_mlu_arch.begin(), all_mlu_arch.end(), e_) - all_mlu_arch.begin();
+    cluster_num.push_back(index < all_cluster_num.size() ? all_cluster_num[index]
+                                                         : std::vector<int>());
+  }
+  if (all_cluster_num.size() > 0 && mlu_arch.size() > 0) {
     // set bitmap of visible cluster for each architecture
     // example: "archs": [{"mtp_372": [cluster_num_1, cluster_num_2, cluster_num_3]}]
     std::stringstream ss;
@@ -258,15 +506,17 @@ bool ConfigNetwork(INetwork *net, BuildParam *param) {
   /////////////Other user action below////////////////
   if (HasValue(param->rgb2bgr()) && Value(param->rgb2bgr())) {
     SLOG(INFO) << "Convert RGB to BGR for first layer's Conv/BatchNorm/Scale of network";
+    ScopedPhase phase("config_network/rgb2bgr");
     CHECK_VALID(ConvertRGB2BGRForFirstLayer(net));
   }
   /////////////Other user action end here/////////////
   return true;
 }
 
-bool Calibration(INetwork *net, IBuilderConfig *config, BuildParam *param) {
-  bool rand_calib = false;
-  bool fake_calib = false;
+bool LoadCalibInputs(INetwork *net, BuildParam *param, CalibInputs *inputs) {
+  bool calibration = HasValue(param->calibration()) && Value(param->calibration());
+  inputs->custom   = HasValue(param->custom_ranges());
+  bool rand_calib  = false;
   std::vector<float> value;
   if (HasValue(param->random_calib_range())) {
     value = Value(param->random_calib_range());
@@ -274,62 +524,85 @@ bool Calibration(INetwork *net, IBuilderConfig *config, BuildParam *param) {
       SLOG(ERROR) << "Random range for calibration must be two numbers (min, max).";
       return false;
     }
-    SLOG(INFO) << "Do rand calibration with custom range: " << value;
     rand_calib = true;
   } else if (!HasValue(param->file_list()) && !HasValue(param->calibration_data_path())) {
-    SLOG(INFO) << "Fill fixed quant param without real calibration.";
-    fake_calib = true;
-  } else if (!HasValue(param->file_list()) || !HasValue(param->calibration_data_path())) {
-    SLOG(ERROR) << "Calibration list file and path must be provided together.";
-    return false;
-  }
-  if (fake_calib) {
-    CHECK_STATUS(config->ParseFromString(R"({"custom_ranges": {"" : {"max": [1], "min": [-1]}}})"));
+    inputs->fake = true;
+  } else if (HasValue(param->file_list()) && HasValue(param->calibration_data_path())) {
+    inputs->files = true;
+  }
+  bool input_ranges = HasValue(param->calibration_input_ranges()) && inputs->files;
+  if ((!calibration || inputs->custom) && !input_ranges) {
+    return true;
+  }
+  if (calibration && !inputs->custom) {
+    if (rand_calib) {
+      SLOG(INFO) << "Do rand calibration with custom range: " << value;
+    } else if (inputs->fake) {
+      SLOG(INFO) << "Fill fixed quant param without real calibration.";
+    } else if (!inputs->files) {
+      SLOG(ERROR) << "Calibration list file and path must be provided together.";
+      return false;
+    }
   }
-  std::vector<CalibDataInterface *> calib_datas(net->GetInputCount());
-  auto file_lists = Value(param->file_list());
-  auto calibration_data_path = Value(param->calibration_data_path());
+  auto file_lists  = Value(param->file_list());
   size_t input_num = net->GetInputCount();
-  if (!rand_calib && !fake_calib && (file_lists.size() != input_num)) {
+  if (inputs->files && file_lists.size() != input_num) {
     SLOG(ERROR) << "Got " << input_num << " inputs from network, but " << file_lists.size()
                 << " from calibration file list.";
     return false;
   }
+  // variants only differ in precision and arch, so they all calibrate on the same batches
   for (size_t i = 0; i < input_num; ++i) {
     auto data_type = net->GetInput(i)->GetDataType();
     auto input_dim = net->GetInput(i)->GetDimension();
-    if (fake_calib) {
+    std::unique_ptr<SampleCalibData> data;
+    if (inputs->fake) {
       // Init empty calibration data. Calibration process will be passed in fake calibration.
-      calib_datas[i] = new SampleCalibData(input_dim, data_type);
+      data.reset(new SampleCalibData(input_dim, data_type));
     } else if (rand_calib) {
       // Init rand calibration data.
-      calib_datas[i] =
-          new SampleCalibData(input_dim, data_type, input_dim.GetDimValue(0), value[0], value[1]);
+      data.reset(
+          new SampleCalibData(input_dim, data_type, input_dim.GetDimValue(0), value[0], value[1]));
     } else {
       // Init calibration data from files.
-      std::vector<std::string> files;
-      std::vector<std::vector<int>> shapes;
-      if (!ReadListFromFile(file_lists[i], &files, &shapes)) {
-        SLOG(ERROR) << "Read file list failed.";
+      data.reset(CreateFileCalibData(net, i, param));
+      if (!data) {
         return false;
       }
-      for (size_t f = 0; f < files.size(); ++f) {
-        files[f] = calibration_data_path + "/" + files[f];
-      }
-      if (shapes.size()) {
-        // With shape size in file list
-        auto dims = ToDims(shapes);
-        calib_datas[i] = new SampleCalibData(dims, data_type, files.size(), files);
-      } else {
-        // Use network shape as input shape.
-        if (input_dim.GetElementCount() == -1) {
-          SLOG(ERROR)
-              << "Can not get elmentcount of calibration set, maybe there is one -1 in its shape.";
-          return false;
-        }
-        calib_datas[i] = new SampleCalibData(input_dim, data_type, files.size(), files);
-      }
     }
+    std::shared_ptr<CalibBatches> batches(new CalibBatches());
+    if (!batches->Load(data.get())) {
+      SLOG(ERROR) << "Read calibration data of input " << i << " failed.";
+      return false;
+    }
+    inputs->batches.push_back(batches);
+  }
+  return true;
+}
+
+bool Calibration(INetwork *net,
+                 IBuilderConfig *config,
+                 BuildParam *param,
+                 const CalibInputs &inputs) {
+  if (inputs.custom) {
+    SLOG(INFO) << "Use custom ranges from " << Value(param->custom_ranges())
+               << " without calibration.";
+    CHECK_STATUS(config->ParseFromFile(Value(param->custom_ranges())));
+    return true;
+  }
+  if (inputs.fake) {
+    CHECK_STATUS(config->ParseFromString(R"({"custom_ranges": {"" : {"max": [1], "min": [-1]}}})"));
+  }
+  if (inputs.batches.size() != net->GetInputCount()) {
+    SLOG(ERROR) << "Got " << net->GetInputCount() << " inputs from network, but "
+                << inputs.batches.size() << " loaded for calibration.";
+    return false;
+  }
+  std::vector<std::unique_ptr<ReplayCalibData>> replays;
+  std::vector<CalibDataInterface *> calib_datas;
+  for (auto e_ : inputs.batches) {
+    replays.emplace_back(new ReplayCalibData(e_));
+    calib_datas.push_back(replays.back().get());
   }
   auto calibrator = CreateICalibrator(calib_datas);
   if (!calibrator) {
@@ -344,24 +617,59 @@ bool Calibration(INetwork *net, IBuilderConfig *config, BuildParam *param) {
   }
   CHECK_STATUS(calibrator->SetQuantizationAlgorithm(StringToAlgo(Value(param->calibration_algo()))));
   auto ret = calibrator->Calibrate(net, config);
+  calibrator->Destroy();
   if (!ret.ok()) {
     SLOG(ERROR) << ret.ToString();
     return false;
   }
-  for (auto &calib_data : calib_datas) {
-    delete calib_data;
-  }
-  calibrator->Destroy();
   return true;
 }
 
-bool BuildAndSerialize(INetwork *net, IBuilderConfig *config, BuildParam *param) {
-  auto builder = CreateIBuilder();
-  auto model_name = Value(param->magicmind_model());
-  if (!builder) {
-    SLOG(ERROR) << "CreateIBuilder failed.";
+bool WriteInputRanges(INetwork *net,
+                      BuildParam *param,
+                      const std::string &precision,
+                      const CalibInputs &inputs) {
+  if (!inputs.files) {
+    SLOG(ERROR) << "Input ranges are computed from calibration data, file_list and "
+                   "calibration_data_path must be provided.";
+    return false;
+  }
+  size_t input_num = net->GetInputCount();
+  if (inputs.batches.size() != input_num) {
+    SLOG(ERROR) << "Got " << input_num << " inputs from network, but " << inputs.batches.size()
+                << " loaded from calibration file list.";
+    return false;
+  }
+  // KL search is quadratic in histogram bins, and int16's 32768 levels would need far more bins
+  // than the default 2048. int16 rarely gains from clipping, so it takes [min, max], and float
+  // precisions are taken as int8.
+  bool qint16 = precision.find("qint16") != std::string::npos;
+  std::map<std::string, std::pair<double, double>> ranges;
+  for (size_t i = 0; i < input_num; ++i) {
+    auto input    = net->GetInput(i);
+    auto &batches = *inputs.batches[i];
+    TensorStatistics stats;
+    for (size_t b = 0; b < batches.Size(); ++b) {
+      if (!UpdateStatistics(&stats, batches.GetData(b), batches.GetDataType(),
+                            batches.GetShape(b).GetElementCount())) {
+        return false;
+      }
+    }
+    auto range = qint16 ? std::make_pair(stats.Min(), stats.Max()) : stats.KLRange(128);
+    SLOG(INFO) << "Input " << input->GetTensorName() << ": " << stats.DebugString()
+               << ", range: [" << range.first << ", " << range.second << "]";
+    ranges[input->GetTensorName()] = range;
+  }
+  if (!WriteCustomRangesToFile(Value(param->calibration_input_ranges()), ranges)) {
+    SLOG(ERROR) << "Write input ranges to " << Value(param->calibration_input_ranges())
+                << " failed.";
     return false;
   }
+  SLOG(INFO) << "Write input ranges to " << Value(param->calibration_input_ranges()) << ".";
+  return true;
+}
+
+bool SetIODataTypes(INetwork *net, BuildParam *param) {
   size_t input_count = net->GetInputCount();
   size_t output_count = net->GetOutputCount();
   if (HasValue(param->input_dtypes())) {
@@ -394,13 +702,29 @@ bool BuildAndSerialize(INetwork *net, IBuilderConfig *config, BuildParam *param)
       }
     }
   }
+  return true;
+}
 
-  auto model = builder->BuildModel("network", net, config);
+bool BuildAndSerialize(INetwork *net, IBuilderConfig *config, const std::string &model_name) {
+  auto builder = CreateIBuilder();
+  if (!builder) {
+    SLOG(ERROR) << "CreateIBuilder failed.";
+    return false;
+  }
+  IModel *model = nullptr;
+  {
+    ScopedPhase phase("build_model");
+    model = builder->BuildModel("network", net, config);
+  }
   if (!model) {
     SLOG(ERROR) << "BuildModel failed";
     return false;
   }
-  auto ret = model->SerializeToFile(model_name.c_str());
+  Status ret;
+  {
+    ScopedPhase phase("serialize");
+    ret = model->SerializeToFile(model_name.c_str());
+  }
   if (!ret.ok()) {
     SLOG(ERROR) << "Serialization failed with " << ret.ToString();
     return false;
@@ -427,3 +751,125 @@ bool BuildAndSerialize(INetwork *net, IBuilderConfig *config, BuildParam *param)
   model->Destroy();
   return true;
 }
+
+bool BuildVariants(const std::function<INetwork *()> &create_net,
+                   BuildParam *param,
+                   const std::vector<BuildVariant> &variants) {
+  size_t num       = variants.size();
+  bool calibration = HasValue(param->calibration()) && Value(param->calibration());
+  int threads      = Value(param->build_threads());
+  if (threads <= 0) {
+    threads = kThreadPoolDefaultNum;
+  }
+  threads = std::max(1, std::min<int>(threads, num));
+  std::vector<IBuilderConfig *> configs(num, nullptr);
+  std::vector<uint64_t> calib_us(num, 0);
+  std::vector<uint64_t> build_us(num, 0);
+  std::vector<int> status(num, 0);
+  // calibration data and input ranges are the same for all variants, read them once
+  INetwork *first = create_net();
+  CalibInputs inputs;
+  bool loaded = true;
+  {
+    ScopedPhase phase("calibration_data");
+    loaded = LoadCalibInputs(first, param, &inputs);
+  }
+  if (loaded && HasValue(param->calibration_input_ranges())) {
+    ScopedPhase phase("input_ranges");
+    std::string precision = variants[0].precision;
+    if (precision.empty() && HasValue(param->precision())) {
+      precision = Value(param->precision());
+    }
+    loaded = WriteInputRanges(first, param, precision, inputs);
+  }
+  if (!loaded) {
+    first->Destroy();
+    return false;
+  }
+  // Calibration writes quantization ranges and precisions into the network, so one network can
+  // not serve variants at the same time. Each thread parses one network (the first thread takes
+  // the one above) and calibrates and builds its variants on it in turn, from the dtypes of
+  // parsing each time. build_model and serialize phases are timed in BuildAndSerialize.
+  std::atomic<size_t> next(0);
+  auto work = [&](INetwork *net) {
+    std::vector<DataType> parsed_types;
+    for (size_t i = next++; i < num; i = next++) {
+      if (!net) {
+        net = create_net();
+      }
+      if (parsed_types.empty()) {
+        parsed_types = GetIODataTypes(net);
+      } else {
+        CHECK_VALID(ResetIODataTypes(net, parsed_types));
+      }
+      auto start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      configs[i] = GetConfig(param, variants[i]);
+      bool ret   = true;
+      if (calibration) {
+        ScopedPhase phase("calibration");
+        ret = Calibration(net, configs[i], param, inputs);
+      }
+      // calibration runs with the dtypes of parsing, inference dtypes are set after it
+      ret         = ret && SetIODataTypes(net, param);
+      calib_us[i] = EnvTime::NowMicros(CLOCK_MONOTONIC) - start;
+      if (ret) {
+        // a model being rebuilt is not up to date even if building fails
+        remove(BuildHashPath(variants[i]).c_str());
+        start       = EnvTime::NowMicros(CLOCK_MONOTONIC);
+        ret         = BuildAndSerialize(net, configs[i], variants[i].model);
+        build_us[i] = EnvTime::NowMicros(CLOCK_MONOTONIC) - start;
+        if (ret && !variants[i].hash.empty() && !RecordBuildHash(variants[i])) {
+          SLOG(WARNING) << "Record build hash for " << variants[i].model << " failed.";
+        }
+      }
+      status[i] = ret;
+    }
+    if (net) {
+      net->Destroy();
+    }
+  };
+  {
+    ThreadPool pool(threads);
+    std::vector<std::future<void>> rets;
+    rets.push_back(pool.AddTask(work, first));
+    for (int t = 1; t < threads; ++t) {
+      rets.push_back(pool.AddTask(work, static_cast<INetwork *>(nullptr)));
+    }
+    for (auto &r : rets) {
+      r.get();
+    }
+  }
+  std::stringstream summary;
+  summary << std::fixed << std::setprecision(1);
+  summary << std::setw(24) << std::left << "Precision" << std::setw(16) << "MLU arch"
+          << std::setw(16) << "Calib(ms)" << std::setw(16) << "Build(ms)" << std::setw(16)
+          << "Total(ms)" << std::setw(8) << "Status"
+          << "Model\n";
+  for (size_t i = 0; i < num; ++i) {
+    std::string archs;
+    for (auto e_ : variants[i].mlu_arch) {
+      archs += (archs.empty() ? "" : ",") + e_;
+    }
+    summary << std::setw(24) << (variants[i].precision.empty() ? "-" : variants[i].precision)
+            << std::setw(16) << (archs.empty() ? "all" : archs) << std::setw(16)
+            << calib_us[i] / 1000.0 << std::setw(16) << build_us[i] / 1000.0 << std::setw(16)
+            << (calib_us[i] + build_us[i]) / 1000.0 << std::setw(8)
+            << (status[i] ? "OK" : "FAILED") << variants[i].model << "\n";
+    if (configs[i]) {
+      configs[i]->Destroy();
+    }
+  }
+  SLOG(INFO) << "\n==================== Build Summary (" << num << " variants, " << threads
+             << " threads)\n"
+             << summary.str();
+  return std::all_of(status.begin(), status.end(), [](int e_) { return e_ != 0; });
+}
+
+void ReportBuildProfile(BuildParam *param) {
+  auto profiler = BuildProfiler::Get();
+  profiler->StopSampling();
+  SLOG(INFO) << "\n==================== Build Phases\n" << profiler->Table();
+  if (HasValue(param->build_profile()) && !profiler->WriteJson(Value(param->build_profile()))) {
+    SLOG(WARNING) << "Write build profile to " << Value(param->build_profile()) << " failed.";
+  }
+}
@@ -4,6 +4,9 @@
  *************************************************************************/
 #ifndef MAIN_PROCESS_H_
 #define MAIN_PROCESS_H_
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include "mm_builder.h"
@@ -11,32 +14,114 @@
 #include "mm_builder.h"
 #include "common/calib_data.h"
 #include "mm_build/build_param.h"
+#include "mm_build/build_profiler.h"
 #include "mm_build/parser.h"
 
+/*
+ * One model to build from the parsed network. Empty precision/mlu_arch keep what params set.
+ */
+struct BuildVariant {
+  std::string precision;
+  std::vector<std::string> mlu_arch;
+  std::string model;
+  // hash of build inputs to record with model, empty without build cache
+  std::string hash;
+};
+// Variants from build_variants, or the single one from precision/mlu_arch/magicmind_model
+std::vector<BuildVariant> GetVariants(BuildParam *param);
+
+/*
+ * For build cache: to hash build inputs for every variant, and drop variants whose model was built
+ * from the same inputs. Returns false if an input can not be read.
+ */
+bool SkipUnchangedVariants(BuildParam *param,
+                           const std::vector<std::string> &model_files,
+                           std::vector<BuildVariant> *variants);
+
 // Wrapper for build config
-IBuilderConfig *GetConfig(BuildParam *param);
+IBuilderConfig *GetConfig(BuildParam *param, const BuildVariant &variant);
 
 bool ConfigNetwork(INetwork *net, BuildParam *param);
 
-bool Calibration(INetwork *net, IBuilderConfig *config, BuildParam *param);
+/*
+ * Calibration data of all network inputs, read once and shared read only by all variants.
+ */
+struct CalibInputs {
+  // ranges are given by custom_ranges, nothing to read
+  bool custom = false;
+  // neither file_list nor calibration_data_path, calibration fills fixed ranges
+  bool fake = false;
+  // batches are read from file_list and calibration_data_path
+  bool files = false;
+  std::vector<std::shared_ptr<const CalibBatches>> batches;
+};
+/*
+ * To read the batches calibration or calibration_input_ranges of param need, from files, random
+ * or zeros.
+ */
+bool LoadCalibInputs(INetwork *net, BuildParam *param, CalibInputs *inputs);
+
+bool Calibration(INetwork *net,
+                 IBuilderConfig *config,
+                 BuildParam *param,
+                 const CalibInputs &inputs);
+/*
+ * To stream calibration batches of every network input through TensorStatistics on host and write
+ * their KL ranges for precision as custom_ranges json to calibration_input_ranges.
+ */
+bool WriteInputRanges(INetwork *net,
+                      BuildParam *param,
+                      const std::string &precision,
+                      const CalibInputs &inputs);
+// Input/output dtypes for inference, set after calibration
+bool SetIODataTypes(INetwork *net, BuildParam *param);
 
-bool BuildAndSerialize(INetwork *net, IBuilderConfig *config, BuildParam *param);
+bool BuildAndSerialize(INetwork *net, IBuilderConfig *config, const std::string &model_name);
+/*
+ * To calibrate and build variants on build_threads threads. Calibration data is read once for all
+ * variants. Calibration writes quantization params into the network, so each thread calibrates
+ * and builds on its own parsed and configured network from create_net, reused for its variants
+ * in turn. Prints build time of every variant.
+ */
+bool BuildVariants(const std::function<INetwork *()> &create_net,
+                   BuildParam *param,
+                   const std::vector<BuildVariant> &variants);
+
+// Logs phase table, and writes it to build_profile if set
+void ReportBuildProfile(BuildParam *param);
 
 template <ModelKind Kind>
 int MainProcess(ParserParam<Kind> *param) {
+  BuildProfiler::Get()->StartSampling();
   ModelParser<Kind> parser(param);
-  auto net = CreateINetwork();
-  CHECK_VALID(net);
-  parser.Parse(net);
-  CHECK_VALID(ConfigNetwork(net, param));
-  auto config = GetConfig(param);
-  CHECK_VALID(config);
-  if (HasValue(param->calibration()) && Value(param->calibration())) {
-    CHECK_VALID(Calibration(net, config, param));
+  auto variants = GetVariants(param);
+  if (Value(param->build_cache())) {
+    ScopedPhase phase("hash_inputs");
+    CHECK_VALID(SkipUnchangedVariants(param, parser.ModelFiles(), &variants));
+  }
+  if (variants.empty()) {
+    SLOG(INFO) << "All models are up to date, nothing to build.";
+    ReportBuildProfile(param);
+    return 0;
   }
-  CHECK_VALID(BuildAndSerialize(net, config, param));
-  config->Destroy();
-  net->Destroy();
+  // the parser object is shared, networks are parsed one at a time
+  std::mutex parse_mutex;
+  auto create_net = [&]() {
+    auto net = CreateINetwork();
+    CHECK_VALID(net);
+    {
+      std::lock_guard<std::mutex> lock(parse_mutex);
+      ScopedPhase phase("parse");
+      parser.Parse(net);
+    }
+    {
+      ScopedPhase phase("config_network");
+      CHECK_VALID(ConfigNetwork(net, param));
+    }
+    return net;
+  };
+  CHECK_VALID(BuildVariants(create_net, param, variants));
+  ReportBuildProfile(param);
   return 0;
 }
 
@@ -31,3 +31,23 @@ void ModelParser<ModelKind::kTensorflow>::Parse(INetwork *network) {
       parser_raw_ptr_->SetModelParam("tf-graphdef-outputs", Value(param_->output_names())));
   CHECK_STATUS(parser_raw_ptr_->Parse(network, Value(param_->tf_pb()).c_str()));
 }
+
+template <>
+std::vector<std::string> ModelParser<ModelKind::kCaffe>::ModelFiles() const {
+  return {Value(param_->caffemodel()), Value(param_->prototxt())};
+}
+
+template <>
+std::vector<std::string> ModelParser<ModelKind::kOnnx>::ModelFiles() const {
+  return {Value(param_->onnx())};
+}
+
+template <>
+std::vector<std::string> ModelParser<ModelKind::kPytorch>::ModelFiles() const {
+  return {Value(param_->pytorch_pt())};
+}
+
+template <>
+std::vector<std::string> ModelParser<ModelKind::kTensorflow>::ModelFiles() const {
+  return {Value(param_->tf_pb())};
+}
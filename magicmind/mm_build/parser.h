@@ -84,6 +84,8 @@ class ModelParser {
   }
 
   void Parse(INetwork *network);
+  // Model files to parse from, for build cache
+  std::vector<std::string> ModelFiles() const;
 
  private:
   RawParserT *parser_raw_ptr_;
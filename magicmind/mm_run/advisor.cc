@@ -0,0 +1,267 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Bottleneck advisor for mm_run pipelines.
+ *************************************************************************/
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include "mm_run/advisor.h"
+
+namespace {
+// occupancy(%) above which a stage/device is taken as saturated
+constexpr float kSaturated = 85.0f;
+// process cpu occupancy(% of all cores) above which host is taken as saturated
+constexpr float kHostBusy = 90.0f;
+// suggestions expected to gain less than this(%) are not worth a rerun
+constexpr float kMinGain = 5.0f;
+
+// Host time spent on issuing one iteration. In host async mode h2d/enqueue/d2h are called from
+// their own threads, otherwise the inference thread calls all of them in turn.
+float IssueTime(const std::array<float, 3> &interface, bool host_async) {
+  if (host_async) {
+    return std::max(std::max(interface[0], interface[1]), interface[2]);
+  }
+  return interface[0] + interface[1] + interface[2];
+}
+
+float Gain(float from, float to) {
+  return to > 0 ? (from / to - 1) * 100 : 0;
+}
+
+std::string Percent(float v) {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1) << v << "%";
+  return ss.str();
+}
+}  // namespace
+
+std::string BottleneckToString(Bottleneck b) {
+  switch (b) {
+    case Bottleneck::h2d:
+      return "H2D-bound";
+    case Bottleneck::launch:
+      return "Launch-bound";
+    case Bottleneck::compute:
+      return "Compute-bound";
+    case Bottleneck::d2h:
+      return "D2H-bound";
+    case Bottleneck::host:
+      return "Host-CPU-bound";
+  }
+  return "invalid";
+}
+
+float ModelPeriod(const std::array<float, 3> &stage,
+                  float launch,
+                  int buffer_depth,
+                  int infer_depth) {
+  constexpr int kIters = 64;
+  std::vector<float> compute_end(kIters, 0);
+  std::vector<float> d2h_end(kIters, 0);
+  float issue_end = 0;
+  float h2d_end   = 0;
+  for (int i = 0; i < kIters; ++i) {
+    float in_free  = i >= buffer_depth ? compute_end[i - buffer_depth] : 0;
+    float out_free = i >= infer_depth ? d2h_end[i - infer_depth] : 0;
+    float last_compute = i > 0 ? compute_end[i - 1] : 0;
+    float last_d2h     = i > 0 ? d2h_end[i - 1] : 0;
+    // issuing waits until the input slot is back, it polls the notifier on host
+    issue_end      = std::max(issue_end, in_free) + launch;
+    h2d_end        = std::max(h2d_end, issue_end) + stage[0];
+    compute_end[i] = std::max(std::max(last_compute, h2d_end), out_free) + stage[1];
+    d2h_end[i]     = std::max(last_d2h, compute_end[i]) + stage[2];
+  }
+  // skip the ramp up
+  constexpr int kHalf = kIters / 2;
+  return (d2h_end[kIters - 1] - d2h_end[kHalf - 1]) / (kIters - kHalf);
+}
+
+Advice Advise(const PipelineProfile &p) {
+  Advice a;
+  float launch   = IssueTime(p.interface, p.host_async);
+  a.model_period = ModelPeriod(p.stage, launch, p.buffer_depth, p.infer_depth);
+  a.period       = p.period > 0 ? p.period : a.model_period;
+  if (a.period <= 0) {
+    a.note = "No stage time traced, nothing to analyse.";
+    return a;
+  }
+  for (int idx = 0; idx < 3; ++idx) {
+    a.occupancy[idx] = 100 * p.stage[idx] / a.period;
+  }
+  a.occupancy[3] = 100 * launch / a.period;
+  a.wait         = std::max(0.0f, 100 * (1 - a.model_period / a.period));
+
+  const Bottleneck kOrder[4] = {Bottleneck::h2d, Bottleneck::compute, Bottleneck::d2h,
+                                Bottleneck::launch};
+  int top = std::max_element(a.occupancy.begin(), a.occupancy.end()) - a.occupancy.begin();
+  a.bound        = kOrder[top];
+  bool host_busy = p.host_util >= kHostBusy;
+  if (host_busy) {
+    a.bound = Bottleneck::host;
+  }
+
+  auto suggest = [&a](const std::string &arg, const std::string &reason, float gain) {
+    Suggestion s;
+    s.arg    = arg;
+    s.reason = reason;
+    s.gain   = gain;
+    a.suggestions.push_back(s);
+  };
+  if (!host_busy) {
+    // deeper pipelines, each judged by the same model so they compare with each other
+    if (p.stage[0] > 0) {
+      float gain = Gain(a.model_period,
+                        ModelPeriod(p.stage, launch, p.buffer_depth + 1, p.infer_depth));
+      if (gain >= kMinGain) {
+        suggest("--buffer_depth " + std::to_string(p.buffer_depth + 1),
+                "next H2D no longer waits for compute to release the only input slots", gain);
+      }
+    }
+    {
+      float gain = Gain(a.model_period,
+                        ModelPeriod(p.stage, launch, p.buffer_depth, p.infer_depth + 1));
+      if (gain >= kMinGain) {
+        suggest("--infer_depth " + std::to_string(p.infer_depth + 1),
+                "next compute no longer waits for D2H to release the only output slots", gain);
+      }
+    }
+    {
+      // with both depths at their limit, raising only one of them leaves the other serializing
+      float best = 0;
+      for (auto e_ : a.suggestions) {
+        best = std::max(best, e_.gain);
+      }
+      float gain = Gain(a.model_period,
+                        ModelPeriod(p.stage, launch, p.buffer_depth + 1, p.infer_depth + 1));
+      if (p.stage[0] > 0 && gain >= best + kMinGain) {
+        suggest("--buffer_depth " + std::to_string(p.buffer_depth + 1) + " --infer_depth " +
+                    std::to_string(p.infer_depth + 1),
+                "h2d, compute and d2h of neighbouring iterations overlap", gain);
+      }
+    }
+    if (!p.host_async && p.interface[0] + p.interface[2] > 0) {
+      float gain = Gain(a.model_period, ModelPeriod(p.stage, IssueTime(p.interface, true),
+                                                    p.buffer_depth, p.infer_depth));
+      if (gain >= kMinGain) {
+        suggest("--host_async 1", "copies are called from their own host threads instead of "
+                                  "the issuing thread", gain);
+      }
+    }
+    // another thread adds another pipeline, as long as neither pcie nor device is saturated
+    bool pcie_busy = (a.bound == Bottleneck::h2d || a.bound == Bottleneck::d2h) &&
+                     a.occupancy[top] >= kSaturated;
+    bool dev_busy = p.chip_util >= 0 ? p.chip_util >= kSaturated
+                                     : a.bound == Bottleneck::compute &&
+                                           a.occupancy[top] >= kSaturated;
+    if (!pcie_busy && !dev_busy) {
+      float scale = float(p.threads + 1) / p.threads;
+      if (p.chip_util > 0) {
+        scale = std::min(scale, 100 / p.chip_util);
+      }
+      if (p.host_util > 0) {
+        scale = std::min(scale, kHostBusy / p.host_util);
+      }
+      float gain = (scale - 1) * 100;
+      if (gain >= kMinGain) {
+        suggest("--threads " + std::to_string(p.threads + 1),
+                p.chip_util >= 0 ? "device cores are " + Percent(p.chip_util) + " busy"
+                                 : "upper bound, device utilization was not traced",
+                gain);
+      }
+    }
+  } else {
+    if (p.threads > 1) {
+      suggest("--threads " + std::to_string(p.threads - 1),
+              "fewer inference threads contend less for host cores", -1);
+    }
+    if (p.host_async) {
+      suggest("--host_async 0", "host async mode runs 3 more host threads per inference thread",
+              -1);
+    }
+  }
+  std::stable_sort(a.suggestions.begin(), a.suggestions.end(),
+                   [](const Suggestion &x, const Suggestion &y) { return x.gain > y.gain; });
+
+  switch (a.bound) {
+    case Bottleneck::h2d:
+    case Bottleneck::d2h:
+      if (a.occupancy[top] >= kSaturated) {
+        a.note = "Copies keep pcie busy, smaller or lower precision inputs/outputs help more "
+                 "than pipeline parameters. disable_data_copy shows the device only throughput.";
+      }
+      break;
+    case Bottleneck::compute:
+      if (a.occupancy[top] >= kSaturated && a.suggestions.empty()) {
+        a.note = "Device compute is saturated, try larger batch or model level optimization.";
+      }
+      break;
+    case Bottleneck::launch:
+      a.note = "Issuing thread spends " + Percent(a.occupancy[3]) +
+               " of each iteration inside interfaces.";
+      break;
+    case Bottleneck::host:
+      a.note = "Process occupies " + Percent(p.host_util) + " of " +
+               std::to_string(p.host_cores) + " host cores.";
+      break;
+  }
+  if (a.note.empty() && a.wait > 30) {
+    a.note = Percent(a.wait) + " of each iteration is spent waiting on notifiers/queues or "
+             "other threads, not in any stage.";
+  }
+  return a;
+}
+
+std::string Advice::ToString() const {
+  std::stringstream os;
+  os << std::setw(30) << std::left << "Bottleneck: " << BottleneckToString(bound) << std::endl;
+  os << std::setw(30) << std::left << "Occupancy(%): "
+     << "H2D: " << std::setw(12) << std::left << occupancy[0]
+     << "Compute: " << std::setw(12) << std::left << occupancy[1]
+     << "D2H: " << std::setw(12) << std::left << occupancy[2]
+     << "Launch: " << occupancy[3] << std::endl;
+  os << std::setw(30) << std::left << "Period per thread(ms): "
+     << "measured: " << std::setw(12) << std::left << period
+     << "modeled: " << std::setw(12) << std::left << model_period
+     << "waiting(%): " << wait << std::endl;
+  os << "Suggestions:";
+  if (suggestions.empty()) {
+    os << " none";
+  }
+  os << std::endl;
+  for (auto e_ : suggestions) {
+    os << "  " << e_.arg << ": ";
+    if (e_.gain >= 0) {
+      os << "expected throughput +" << Percent(e_.gain) << ", ";
+    }
+    os << e_.reason << std::endl;
+  }
+  if (!note.empty()) {
+    os << note << std::endl;
+  }
+  return os.str();
+}
+
+json11::Json Advice::ToJson() const {
+  std::map<std::string, json11::Json> objs;
+  objs["bound"] = json11::Json(BottleneckToString(bound));
+  std::map<std::string, json11::Json> occ;
+  occ["H2D"]                 = json11::Json(occupancy[0]);
+  occ["Compute"]             = json11::Json(occupancy[1]);
+  occ["D2H"]                 = json11::Json(occupancy[2]);
+  occ["Launch"]              = json11::Json(occupancy[3]);
+  objs["occupancy(%)"]       = json11::Json(occ);
+  objs["period(ms)"]         = json11::Json(period);
+  objs["modeled period(ms)"] = json11::Json(model_period);
+  objs["waiting(%)"]         = json11::Json(wait);
+  std::vector<json11::Json> suggests;
+  for (auto e_ : suggestions) {
+    std::map<std::string, json11::Json> s;
+    s["arg"]     = json11::Json(e_.arg);
+    s["reason"]  = json11::Json(e_.reason);
+    s["gain(%)"] = json11::Json(e_.gain);
+    suggests.push_back(json11::Json(s));
+  }
+  objs["suggestions"] = json11::Json(suggests);
+  objs["note"]        = json11::Json(note);
+  return json11::Json(objs);
+}
@@ -0,0 +1,78 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Bottleneck advisor for mm_run pipelines.
+ *************************************************************************/
+#ifndef ADVISOR_H_
+#define ADVISOR_H_
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "common/json_util.h"
+
+/*
+ * What one device's run looked like, times in millisecond. Stage times may come from host or
+ * dev clock, whichever was traced, so the advisor works with trace_time host alone.
+ */
+struct PipelineProfile {
+  // mean h2d/compute/d2h duration per iteration, 0 for skipped copies
+  std::array<float, 3> stage{{0, 0, 0}};
+  // mean time the issuing thread spent inside h2d/enqueue/d2h interfaces per iteration
+  std::array<float, 3> interface{{0, 0, 0}};
+  // measured wall time per iteration of one thread
+  float period     = 0;
+  int threads      = 1;
+  int buffer_depth = 1;
+  int infer_depth  = 1;
+  bool host_async  = false;
+  // mean chip core utilization(%), negative if not traced
+  float chip_util = -1;
+  // process cpu occupancy in % of all host cores, negative if not traced
+  float host_util = -1;
+  int host_cores  = 1;
+};
+
+enum class Bottleneck : uint8_t {
+  h2d     = 0,
+  launch  = 1,
+  compute = 2,
+  d2h     = 3,
+  host    = 4,
+};
+
+std::string BottleneckToString(Bottleneck b);
+
+struct Suggestion {
+  // mm_run argument to change, e.g. "--buffer_depth 2"
+  std::string arg;
+  std::string reason;
+  // expected throughput gain(%) by the pipeline model, negative if it can not be estimated
+  float gain = -1;
+};
+
+struct Advice {
+  Bottleneck bound = Bottleneck::compute;
+  // busy share of one iteration period(%) of h2d/compute/d2h/issuing thread
+  std::array<float, 4> occupancy{{0, 0, 0, 0}};
+  // share of measured period the stages do not explain(%), i.e. time lost waiting on
+  // notifiers/queues or other threads
+  float wait         = 0;
+  float period       = 0;
+  float model_period = 0;
+  std::vector<Suggestion> suggestions;
+  std::string note;
+  std::string ToString() const;
+  json11::Json ToJson() const;
+};
+
+/*
+ * Steady state period of one thread's pipeline: the issuing thread spends launch ms on each
+ * iteration, h2d/compute/d2h each run in order on their own queue, h2d waits for one of
+ * buffer_depth input slots freed by compute and compute waits for one of infer_depth output slots
+ * freed by d2h.
+ */
+float ModelPeriod(const std::array<float, 3> &stage, float launch, int buffer_depth, int infer_depth);
+
+Advice Advise(const PipelineProfile &p);
+
+#endif  // ADVISOR_H_
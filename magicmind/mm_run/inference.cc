@@ -6,6 +6,7 @@
 #include "common/macros.h"
 #include "common/data.h"
 #include "common/timer.h"
+#include "common/scope_profiler.h"
 #include "common/type.h"
 #include "mm_run/inference.h"
 
@@ -22,7 +23,7 @@ Infer::Infer(const SetUp &set) : set_(set) {
   CHECK_VALID(set_.trace);
   {
     // 记录创建上下文的时间
-    TimeCollapse time_context("CreateContext");
+    ScopedProfile scope_context("CreateContext");
     // 创建推理上下文
     context_ = set_.engine->CreateIContext();
   }
@@ -76,6 +77,10 @@ void Infer::InitBuffers() {
         SLOG(WARNING) << "Fill in real inputs with dynamic input shapes is currently unsupported.";
       }
     }
+    // 未给定输入文件时，可使用随机数据填充输入，每个缓冲区组使用不同的随机种子
+    if (set_.copy && set_.input_path.empty() && set_.random_range.size() == 2) {
+      in_bufs_[i]->FillRand(set_.random_range[0], set_.random_range[1], i);
+    }
   }
   // 初始化输出缓冲区组
   for (int i = 0; i < set_.infer_depth; ++i) {
@@ -24,6 +24,7 @@ class Infer {
     InferenceTrace *trace = nullptr;                       // 推理跟踪指针，用于记录推理过程
     ShapeGroups shapes;                                    // 形状组，用于存储输入形状组和输出形状组
     std::vector<std::string> input_path{};                 // 输入路径的向量
+    std::vector<float> random_range{};                     // 随机输入的[min, max]，为空则不填充
     std::string output_path{};                             // 输出路径的字符串
     std::string debug_path{};                              // 调试路径的字符串
   };
@@ -5,21 +5,34 @@
 #include <unistd.h>
 #include "mm_run/run.h"
 #include "mm_run/run_param.h"
+#include "common/scope_profiler.h"
 int main(int argc, char *argv[]) {
   auto args = ArrangeArgs(argc, argv);
   // arg parse
   auto param = new RunParam();
   param->ReadIn(args);
+  if (HasValue(param->log_level())) {
+    SetMinLogLevel(LogLevelFromName(Value(param->log_level())));
+  }
+  if (Value(param->log_async()) || HasValue(param->log_file())) {
+    StartAsyncLog(HasValue(param->log_file()) ? Value(param->log_file()) : "");
+  }
+  // calibrate before any worker thread reads the clock
+  FastClock::Calibrate();
+  ScopeProfiler::Enable(Value(param->scope_profile()));
+  ScopeProfiler::Get()->SetThreadName("main");
   SLOG(INFO) << "\n==================== Parameter Information\n"
              << param->DebugString() << "MagicMind: " << MM_VERSION_STR << std::endl
              << "CNRT: " << CNRT_VERSION << std::endl
              << "CNAPI: " << CN_VERSION << std::endl
-             << "PID: " << getpid();
+             << "PID: " << getpid() << std::endl
+             << "Host clock: " << FastClock::Source();
   // Init magicmind_run
   Run *run = new Run(param);
   // Start multi-thread inference
   run->RunInMultiDevices();
   delete run;
   delete param;
+  StopAsyncLog();
   return 0;
 }
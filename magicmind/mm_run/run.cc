@@ -13,6 +13,7 @@
 #include "common/data.h"
 #include "common/type.h"
 #include "common/timer.h"
+#include "common/scope_profiler.h"
 #include "mm_run/run.h"
 
 
@@ -25,15 +26,16 @@ void RunInSinglethread(const Infer::SetUp &setup,
                        float warmup,
                        const std::string &name,
                        AtomicEvent *start) {
+  // 以线程名作为该线程调用栈的根，便于在火焰图中区分各线程
+  ScopeProfiler::Get()->SetThreadName(name);
   // 创建Infer对象，用于推理
   Infer infer_obj(setup);
   // 等待启动信号，这里使用了AtomicEvent类来同步线程，保证所有线程在start->Wait(false)之前阻塞，等待start信号后同时开始推理。
   start->Wait(false);
   // 推理预热阶段
   {
-    // 创建TimeCollapse对象，用于测量时间
-    // std::string("warmup_" + name)是预热阶段的名称，用于在日志中标识预热阶段的耗时
-    TimeCollapse time_warm_up(std::string("warmup_" + name));
+    // 统计预热阶段耗时，各线程的warmup在报告中按路径合并
+    ScopedProfile scope_warm_up("warmup");
     float total_time = 0;
     for (; total_time < warmup;) {
       // 进行推理查询
@@ -49,17 +51,23 @@ void RunInSinglethread(const Infer::SetUp &setup,
   // 进行推理
   float total_time = 0;
   {
-    // 创建TimeCollapse对象，用于测量时间
-    // std::string("infer_" + name)是推理阶段的名称，用于在日志中标识推理阶段的耗时
-    TimeCollapse time_infer(std::string("infer_" + name));
+    // 统计推理阶段耗时，各线程的infer在报告中按路径合并
+    ScopedProfile scope_infer("infer");
     int iter;
     // 设置推理的开始时间，记录在setup.trace->host_start_中
-    setup.trace->host_start_ = EnvTime::NowMicros(CLOCK_MONOTONIC);
+    setup.trace->host_start_ = FastClock::NowMicros();
     for (iter = iterations; iter > 0 || total_time < duration;) {
-      // 进行推理查询
-      infer_obj.Query();
+      // 进行推理查询，在报告中为infer下的子阶段
+      {
+        ScopedProfile scope_query("Query");
+        infer_obj.Query();
+      }
       // 同步推理操作，返回当前推理的总时间
-      auto time = infer_obj.Sync();
+      float time = 0;
+      {
+        ScopedProfile scope_sync("Sync");
+        time = infer_obj.Sync();
+      }
       if (time != total_time) {
         --iter;
         total_time = time;
@@ -68,7 +76,7 @@ void RunInSinglethread(const Infer::SetUp &setup,
     // 等待所有推理操作完成
     infer_obj.SyncAll();
     // 设置推理的结束时间，记录在setup.trace->host_end_中
-    setup.trace->host_end_ = EnvTime::NowMicros(CLOCK_MONOTONIC);
+    setup.trace->host_end_ = FastClock::NowMicros();
   }
   // 输出推理结果和性能信息到日志
   SLOG(INFO) << "Run " << name << " finished with total duration: " << total_time
@@ -160,7 +168,7 @@ Run::Run(RunParam *param) : params_(param) {
   CHECK_CNRT(cnrtSetDevice(dev_ids_[0]));
   // 反序列化模型
   {
-    TimeCollapse time_create_model("DeserializeModel");
+    ScopedProfile scope_create_model("DeserializeModel");
 #ifdef NDEBUG
     KernelMemQuery mem_occ("CreateModel");
 #endif
@@ -302,7 +310,7 @@ void Run::InitEngines() {
     }
     {
       // 创建引擎并记录创建引擎所用的时间
-      TimeCollapse time_create_engine("CreateEngine " + std::to_string(i));
+      ScopedProfile scope_create_engine("CreateEngine");
 #ifdef NDEBUG
       KernelMemQuery mem_occ("CreateEngine " + std::to_string(i));
 #endif
@@ -370,6 +378,11 @@ void Run::RunInMultiDevices() {
   set.buffer_depth = Value(params_->buffer_depth()); // 设置buffer的深度
   set.infer_depth = Value(params_->infer_depth()); // 设置infer的深度
   set.input_path = Value(params_->input_files()); // 输入数据路径
+  if (HasValue(params_->random_input())) {
+    set.random_range = Value(params_->random_input()); // 随机输入数据范围
+    CHECK_EQ(set.random_range.size(), 2);
+    CHECK_LE(set.random_range[0], set.random_range[1]);
+  }
   set.output_path = Value(params_->output_path()); // 输出结果路径
   set.debug_path = Value(params_->debug_path()); // 调试信息路径
   // 同步信号
@@ -458,6 +471,14 @@ Run::~Run() {
       CHECK_VALID(WriteJsonToFile(Value(params_->trace_path()) + "/" + file, jsons[idx]));
     }
   }
+  // 如果开启了scope_profile，打印各线程合并后的调用树，并在trace_path下保存折叠栈用于生成火焰图。
+  if (ScopeProfiler::Enabled()) {
+    SLOG(INFO) << "\n==================== Scope Profile\n" << ScopeProfiler::Get()->Table();
+    if (HasValue(params_->trace_path())) {
+      std::string file = Value(params_->trace_path()) + "/scope_profile.folded";
+      CHECK_VALID(ScopeProfiler::Get()->WriteFolded(file));
+    }
+  }
   // Step 7: 如果开启了Profiler功能，则销毁Profiler对象。
 #ifdef USE_PROFILER
   if (profiler_) {
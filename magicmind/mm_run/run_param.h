@@ -26,6 +26,11 @@ class RunParam : public ArgListBase {
   DECLARE_ARG(input_files, (std::vector<std::string>))
       ->SetDescription("Real input files for one iteration of job.")
       ->SetDefault({});
+  DECLARE_ARG(random_input, (std::vector<float>))
+      ->SetDescription(
+          "Two numbers as min,max. To fill inputs with uniform random data in [min, max] when "
+          "input_files is not given. Data is reproducible across runs and thread settings.")
+      ->SetDefault({});
   DECLARE_ARG(output_path, (std::string))
       ->SetDescription(
           "Real output files for one iteration of job. Only works when real inputs are given.")
@@ -89,6 +94,25 @@ class RunParam : public ArgListBase {
           "num of runs/avg_run[0] > avg_run[1] ? print avg_run[1] : num of runs/avg_run[0] "
           "sets of average performance.")
       ->SetDefault({"100,10"});
+  DECLARE_ARG(log_level, (std::string))
+      ->SetDescription(
+          "Minimum severity to log, lower ones are skipped without formatting. Defaults to "
+          "environment SAMPLE_LOG_LEVEL or INFO.")
+      ->SetAlternative({"INFO", "WARNING", "ERROR"})
+      ->SetDefault({});
+  DECLARE_ARG(scope_profile, (bool))
+      ->SetDescription(
+          "Profile scopes (model/engine/context creation, warmup, infer) per thread and print "
+          "a merged call tree at last. Folded stacks are written to trace_path if given.")
+      ->SetDefault({"false"});
+  DECLARE_ARG(log_async, (bool))
+      ->SetDescription(
+          "Write logs from a background thread so inference threads do not block on stderr.")
+      ->SetDefault({"false"});
+  DECLARE_ARG(log_file, (std::string))
+      ->SetDescription(
+          "Also write logs to log_file, rotated every 64MB keeping 5 files. Implies log_async.")
+      ->SetDefault({});
 };
 
 #endif  // RUN_PARAM_H_
@@ -108,9 +108,9 @@ CpyIn::CpyIn(int buffer_depth,
   if (on_host_) {
     // 在主机上创建一个函数对象(host_cpy_)，用于主机到设备的拷贝操作
     host_cpy_ = [this](Buffers *buffer, int idx) {
-      current_tps_[idx].first = EnvTime::NowMicros(CLOCK_MONOTONIC);  // 记录拷贝开始时间
+      current_tps_[idx].first = FastClock::NowNanos();  // 记录拷贝开始时间
       buffer->H2D();                 // 主机到设备的数据拷贝操作
-      current_tps_[idx].second = EnvTime::NowMicros(CLOCK_MONOTONIC); // 记录拷贝结束时间
+      current_tps_[idx].second = FastClock::NowNanos(); // 记录拷贝结束时间
       // place host event
       events_[idx]->PlaceOn();      // 将事件放置在队列中，用于跟踪处理时间
     };
@@ -122,7 +122,7 @@ void CpyIn::CollectTime(int index) {
   // 收集时间信息
   if (!skip_) {
     float interface_duration_ =
-        float(current_tps_[index].second - current_tps_[index].first) / 1000; // 拷贝持续时间
+        float(current_tps_[index].second - current_tps_[index].first) / 1e6; // 拷贝持续时间
     if (on_host_) {
       // 如果在主机上执行，将时间信息添加到时间信息容器中
       total_time_container_->emplace_back(interface_duration_, interface_duration_,
@@ -163,9 +163,9 @@ void CpyIn::DoWork(const FifoUnit &unit) {
         // 如果指定了时间通知类型，将notifier置于队列中
         notifiers_[current_index_][0]->PlaceOn(queue_);
       }
-      current_tps_[current_index_].first = EnvTime::NowMicros(CLOCK_MONOTONIC); // 记录拷贝开始时间
+      current_tps_[current_index_].first = FastClock::NowNanos(); // 记录拷贝开始时间
       buffers->H2D(queue_);               // 设备到设备的数据拷贝操作
-      current_tps_[current_index_].second = EnvTime::NowMicros(CLOCK_MONOTONIC); // 记录拷贝结束时间
+      current_tps_[current_index_].second = FastClock::NowNanos(); // 记录拷贝结束时间
       notifiers_[current_index_][1]->PlaceOn(queue_);
       // cpy on queue, so enqueue should wait for mlu queue
       out.dev_ = notifiers_[current_index_][1];  // 将设备时间通知器添加到输出Fifo中
@@ -199,27 +199,27 @@ Enqueue::Enqueue(int enqueue_depth,
     dyn_outs_.resize(enqueue_depth);
     function_ = [this](Buffers *in, Buffers *out, int idx) {
       notifiers_[idx][0]->PlaceOn(queue_);
-      current_tps_[idx].first = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].first = FastClock::NowNanos();
       CHECK_STATUS(context_->Enqueue(in->OriTensors(), &dyn_outs_[idx], queue_->Get()));
-      current_tps_[idx].second = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].second = FastClock::NowNanos();
       notifiers_[idx][1]->PlaceOn(queue_);
       out->Init(dyn_outs_[idx]);
     };
   } else if (muta) {
     function_ = [this](Buffers *in, Buffers *out, int idx) {
       notifiers_[idx][0]->PlaceOn(queue_);
-      current_tps_[idx].first = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].first = FastClock::NowNanos();
       CHECK_STATUS(context_->Enqueue(in->OriTensors(), out->OriTensors(), queue_->Get()));
-      current_tps_[idx].second = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].second = FastClock::NowNanos();
       notifiers_[idx][1]->PlaceOn(queue_);
       out->ReInit();
     };
   } else {
     function_ = [this](Buffers *in, Buffers *out, int idx) {
       notifiers_[idx][0]->PlaceOn(queue_);
-      current_tps_[idx].first = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].first = FastClock::NowNanos();
       CHECK_STATUS(context_->Enqueue(in->OriTensors(), out->OriTensors(), queue_->Get()));
-      current_tps_[idx].second = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].second = FastClock::NowNanos();
       notifiers_[idx][1]->PlaceOn(queue_);
     };
   }
@@ -242,7 +242,7 @@ Enqueue::Enqueue(int enqueue_depth,
 void Enqueue::CollectTime(int index) {
   last_duration_ = RecordHost(t_) ? notifiers_[index][0]->HostTimeFrom(*begin_)
                                   : notifiers_[index][0]->DevTimeFrom(*begin_);
-  float interface_duration_ = float(current_tps_[index].second - current_tps_[index].first) / 1000;
+  float interface_duration_ = float(current_tps_[index].second - current_tps_[index].first) / 1e6;
   total_time_container_->emplace_back(
       RecordHost(t_) ? notifiers_[index][1]->HostTimeFrom(*notifiers_[index][0]) : 0,
       RecordDev(t_) ? notifiers_[index][1]->DevTimeFrom(*notifiers_[index][0]) : 0,
@@ -286,9 +286,9 @@ CpyOut::CpyOut(int enqueue_depth,
     host_cpy_ = [this](Buffers *buffer, AtomicEvent *env, Notifier *ntf, int idx) {
       env->Wait();
       ntf->Wait();
-      current_tps_[idx].first = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].first = FastClock::NowNanos();
       buffer->D2H();
-      current_tps_[idx].second = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[idx].second = FastClock::NowNanos();
       events_[idx]->PlaceOn();
     };
   }
@@ -298,7 +298,7 @@ void CpyOut::CollectTime(int index) {
   // collect time
   if (!skip_) {
     float interface_duration_ =
-        float(current_tps_[index].second - current_tps_[index].first) / 1000;
+        float(current_tps_[index].second - current_tps_[index].first) / 1e6;
     if (on_host_) {
       total_time_container_->emplace_back(interface_duration_, interface_duration_,
                                           interface_duration_);
@@ -325,9 +325,9 @@ void CpyOut::DoWork(const FifoUnit &unit) {
       if (t_ != NotifierType::none) {
         notifiers_[current_index_][0]->PlaceOn(queue_);
       }
-      current_tps_[current_index_].first = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[current_index_].first = FastClock::NowNanos();
       buffers->D2H(queue_);
-      current_tps_[current_index_].second = EnvTime::NowMicros(CLOCK_MONOTONIC);
+      current_tps_[current_index_].second = FastClock::NowNanos();
       notifiers_[current_index_][1]->PlaceOn(queue_);
       out.dev_ = notifiers_[current_index_][1];
       out.host_ = nullptr;
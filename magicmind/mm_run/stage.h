@@ -77,6 +77,7 @@ class Stage {
   BufferGroups *in_group_;
   BufferGroups *out_group_;
   TimeInfoContainer *total_time_container_;
+  // interface begin/end of each job in FastClock nanoseconds
   std::vector<std::pair<uint64_t, uint64_t>> current_tps_;
   std::vector<bool> active_;
   int current_index_ = 0;
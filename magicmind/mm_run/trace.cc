@@ -2,6 +2,7 @@
  * Copyright (C) [2020-2023] by Cambricon, Inc.
  * Description: Functions/Objects for trace inference time/power/etc.
  *************************************************************************/
+#include <unistd.h>
 #include <iomanip>
 #include "mm_run/trace.h"
 
@@ -143,6 +144,16 @@ Report::ReportPerDev::ReportPerDev(int id,
     total_compute_dev_ += t.dev_duration_;
     total_compute_host_ += t.host_duration_;
   }
+  if (total_iters_ > 0) {
+    for (int stage = 0; stage < 3; ++stage) {
+      for (auto &t : time_trace_gather[stage]) {
+        stage_mean_[stage] += RecordHost(t_) ? t.host_duration_ : t.dev_duration_;
+        interface_mean_[stage] += t.interface_duration_;
+      }
+      stage_mean_[stage] /= total_iters_;
+      interface_mean_[stage] /= total_iters_;
+    }
+  }
 
   time_trace_gather[3] = TimeInfoContainer(total_iters_);
   for (size_t idx = 0; idx < total_iters_; ++idx) {
@@ -397,6 +408,30 @@ void Report::ReportPerDev::PrintAnalysisData() const {
   SLOG(INFO) << os.str();
 }
 
+void Report::ReportPerDev::Advise(bool host_async,
+                                  int buf_depth,
+                                  int infer_depth,
+                                  float host_util) {
+  if (!DoRecord(t_) || total_iters_ == 0) {
+    return;
+  }
+  PipelineProfile p;
+  p.stage        = stage_mean_;
+  p.interface    = interface_mean_;
+  p.period       = wall_time_ * 1000 * thread_num_ / total_iters_;
+  p.threads      = thread_num_;
+  p.buffer_depth = buf_depth;
+  p.infer_depth  = infer_depth;
+  p.host_async   = host_async;
+  p.chip_util    = dev_util_.empty() ? -1 : dev_util_[0].mean;
+  p.host_util    = host_util;
+  p.host_cores   = sysconf(_SC_NPROCESSORS_ONLN);
+  advice_        = ::Advise(p);
+  advised_       = true;
+  SLOG(INFO) << "\n=================== Report Dev " << dev_id_ << " Bottleneck Analysis\n"
+             << advice_.ToString();
+}
+
 json11::Json Report::ReportPerDev::ToJson() const {
   std::map<std::string, json11::Json> objs;
   objs["iterations"] = json11::Json((int)total_iters_);
@@ -422,6 +457,9 @@ json11::Json Report::ReportPerDev::ToJson() const {
   if (analysised_) {
     objs["notifier ratio(%)"] = json11::Json(est_notifer_ratio_);
   }
+  if (advised_) {
+    objs["bottleneck"] = advice_.ToJson();
+  }
   std::vector<json11::Json> traces;
   for (size_t idx = 0; idx < shapes_.size(); idx++) {
     std::map<std::string, json11::Json> trace;
@@ -506,11 +544,22 @@ void Report::Analysis(bool host_async,
                       bool mutable_out,
                       int buf_depth,
                       int infer_depth) {
+  // process cpu occupancy over all host cores, shared by all devices
+  float host_util = -1;
+  if (!cpu_util_.empty()) {
+    host_util = cpu_util_[0].median + cpu_util_[1].median;
+  }
+  bool advised = false;
   for (auto &r : reports_) {
     if (r.t_ == NotifierType::both) {
       r.Analysis(host_async);
       r.PrintAnalysisData();
     }
+    r.Advise(host_async, buf_depth, infer_depth, host_util);
+    advised = advised || r.advised_;
+  }
+  if (!advised && !reports_.empty() && !DoRecord(reports_[0].t_)) {
+    SLOG(INFO) << "Bottleneck analysis needs stage time, set trace_time to host, dev or both.";
   }
 }
 
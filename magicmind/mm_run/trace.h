@@ -16,6 +16,7 @@
 #include "common/device.h"
 #include "common/json_util.h"
 #include "mm_run/shape_groups.h"
+#include "mm_run/advisor.h"
 
 /*
  * Enum and functions for notifier type.
@@ -68,7 +69,8 @@ inline bool RecordDev(NotifierType t) {
  * Struct for statistic time duration (millisecond) from three sources:
  * 1. host clock from queue/async threads
  * 2. device clock from mlu (if action is on queue)
- * 3. host clock for just call interface
+ * 3. host clock for just call interface, taken from FastClock nanosecond timestamps so short
+ *    calls are not quantized to whole microseconds
  * Now run uses three Containers for H2d/Compute/D2H
  */
 struct TimeInfo {
@@ -284,6 +286,7 @@ class Report {
     void Print() const;
     void PrintAnalysisData() const;
     void Analysis(bool host_async);
+    void Advise(bool host_async, int buf_depth, int infer_depth, float host_util);
     json11::Json ToJson() const;
     int dev_id_{0};
     int thread_num_{1};
@@ -323,6 +326,12 @@ class Report {
     float est_notifer_ratio_;
     float est_query_ratio_;
     std::vector<int> avg_runs_;
+    // bottleneck advisor, mean h2d/compute/d2h time (host clock if traced, else dev clock) and
+    // mean interface time of all iterations
+    std::array<float, 3> stage_mean_{{0, 0, 0}};
+    std::array<float, 3> interface_mean_{{0, 0, 0}};
+    Advice advice_;
+    bool advised_ = false;
   };
   // cpu perf
   std::vector<PerformanceResult> cpu_util_;
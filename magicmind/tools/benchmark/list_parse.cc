@@ -0,0 +1,154 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Benchmark for calibration list and label file parsing.
+ *************************************************************************/
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include "common/data.h"
+#include "common/param.h"
+#include "common/logger.h"
+#include "common/timer.h"
+
+class ListParseArg : public ArgListBase {
+  DECLARE_ARG(lines, (int))->SetDescription("Line num of generated files.")->SetDefault({"1000000"});
+  DECLARE_ARG(work_dir, (std::string))
+      ->SetDescription("Directory to write generated files.")
+      ->SetDefault({"./"});
+  DECLARE_ARG(repeat, (int))->SetDescription("Repeat times for each parser.")->SetDefault({"3"});
+};
+
+namespace {
+/*
+ * Stream based parsers kept as the baseline, one istringstream per line.
+ */
+bool StreamReadList(const std::string &file_path,
+                    std::vector<std::string> *lines,
+                    std::vector<std::vector<int>> *shapes) {
+  std::ifstream in_file(file_path, std::ios::in | std::ios::binary);
+  if (!in_file) {
+    return false;
+  }
+  lines->clear();
+  shapes->clear();
+  std::string line{};
+  std::vector<std::string> tokens;
+  while (getline(in_file, line)) {
+    tokens.clear();
+    std::istringstream iss(line);
+    std::copy(std::istream_iterator<std::string>(iss), std::istream_iterator<std::string>(),
+              std::back_inserter(tokens));
+    if (tokens.size() == 1) {
+      lines->push_back(tokens[0]);
+    } else if (tokens.size() == 2) {
+      lines->push_back(tokens[0]);
+      auto nums = tokens[1].substr(6, tokens[1].size() - 7);
+      std::vector<int> shape;
+      std::string num;
+      std::stringstream shape_ss(nums);
+      while (getline(shape_ss, num, ',')) {
+        shape.push_back(std::stoi(num));
+      }
+      shapes->push_back(shape);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StreamReadLabel(const std::string &file_path,
+                     std::vector<std::string> *images,
+                     std::vector<int> *labels) {
+  std::ifstream flabel(file_path, std::ios::in);
+  if (!flabel) {
+    return false;
+  }
+  images->clear();
+  labels->clear();
+  std::string line{};
+  std::vector<std::string> tokens;
+  while (getline(flabel, line)) {
+    tokens.clear();
+    std::istringstream iss(line);
+    std::copy(std::istream_iterator<std::string>(iss), std::istream_iterator<std::string>(),
+              std::back_inserter(tokens));
+    if (tokens.size() != 2) {
+      return false;
+    }
+    auto ext = tokens[0].substr(tokens[0].rfind('.'));
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::toupper);
+    images->push_back(tokens[0]);
+    labels->push_back(std::stoi(tokens[1]));
+  }
+  return true;
+}
+
+void GenerateFiles(const std::string &list_path,
+                   const std::string &shape_list_path,
+                   const std::string &label_path,
+                   int lines) {
+  std::ofstream list(list_path);
+  std::ofstream shape_list(shape_list_path);
+  std::ofstream label(label_path);
+  for (int i = 0; i < lines; ++i) {
+    std::string name = "calib_data/ILSVRC2012_val_" + std::to_string(i);
+    list << name << ".bin\n";
+    shape_list << name << ".bin shape[1," << (224 + i % 32) << "," << (224 + i % 17) << ",3]\n";
+    label << name << (i % 2 ? ".JPEG " : ".jpg ") << i % 1000 << "\n";
+  }
+}
+
+template <typename F, typename A, typename B>
+double Measure(F func, const std::string &path, A *a, B *b, int repeat) {
+  double best = 0;
+  for (int r = 0; r < repeat; ++r) {
+    auto start = EnvTime::NowMicros(CLOCK_MONOTONIC);
+    CHECK_VALID(func(path, a, b));
+    double ms = (EnvTime::NowMicros(CLOCK_MONOTONIC) - start) / 1000.0;
+    best      = (r == 0 || ms < best) ? ms : best;
+  }
+  return best;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  ListParseArg arg;
+  auto args = ArrangeArgs(argc, argv);
+  arg.ReadIn(args);
+  int lines                   = Value(arg.lines());
+  int repeat                  = Value(arg.repeat());
+  std::string dir             = Value(arg.work_dir()) + "/";
+  std::string list_path       = dir + "bench_file_list";
+  std::string shape_list_path = dir + "bench_file_list_with_shape";
+  std::string label_path      = dir + "bench_labels";
+  GenerateFiles(list_path, shape_list_path, label_path, lines);
+
+  std::vector<std::string> names_a, names_b;
+  std::vector<std::vector<int>> shapes_a, shapes_b;
+  std::vector<int> labels_a, labels_b;
+  struct Case {
+    std::string name;
+    double stream_ms;
+    double mmap_ms;
+  };
+  std::vector<Case> cases;
+  for (auto path : {list_path, shape_list_path}) {
+    double base = Measure(StreamReadList, path, &names_a, &shapes_a, repeat);
+    double fast = Measure(ReadListFromFile, path, &names_b, &shapes_b, repeat);
+    CHECK_VALID(names_a == names_b && shapes_a == shapes_b);
+    cases.push_back({path, base, fast});
+  }
+  double base = Measure(StreamReadLabel, label_path, &names_a, &labels_a, repeat);
+  double fast = Measure(ReadLabelFromFile, label_path, &names_b, &labels_b, repeat);
+  CHECK_VALID(names_a == names_b && labels_a == labels_b);
+  cases.push_back({label_path, base, fast});
+
+  SLOG(INFO) << "Lines: " << lines << ", best of " << repeat << " runs.";
+  for (auto e_ : cases) {
+    SLOG(INFO) << e_.name << ": stream " << e_.stream_ms << " ms, mmap " << e_.mmap_ms
+               << " ms, speedup " << e_.stream_ms / e_.mmap_ms << "x";
+  }
+  return 0;
+}
@@ -0,0 +1,99 @@
+/*************************************************************************
+ * Copyright (C) [2020-2023] by Cambricon, Inc.
+ * Description: Host only checks of common and mm_build/mm_run helpers with known answers.
+ *************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common/data.h"
+#include "common/logger.h"
+#include "common/statistics.h"
+#include "mm_run/advisor.h"
+
+namespace {
+/*
+ * 8 bins over [0, 1) holding 100, 90, 80, 70, 0, 0, 0, 1 values. With 2 levels KL is smallest
+ * keeping the first 4 bins, so the threshold is the upper edge of bin 3.
+ */
+bool CheckKLRange() {
+  const float kCenters[] = {-0.0625f, 0.1875f, 0.3125f, 0.4375f, 0.9375f};
+  const int kCounts[]    = {100, 90, 80, 70, 1};
+  std::vector<float> data;
+  for (int i = 0; i < 5; ++i) {
+    data.insert(data.end(), kCounts[i], kCenters[i]);
+  }
+  TensorStatistics stats(8);
+  stats.Update(data.data(), data.size());
+  auto range = stats.KLRange(2);
+  return range.first == -0.0625 && range.second == 0.5;
+}
+/*
+ * Advise on a known H2D-bound and a known compute-bound profile of mm_run pipelines.
+ */
+bool CheckAdvisor() {
+  auto near = [](float v, float expect) { return std::fabs(v - expect) <= 0.01f * expect; };
+  // h2d 8ms with one input slot: the next h2d waits for compute, so the period is
+  // launch + h2d + compute, and a second input slot brings it down to the h2d time
+  PipelineProfile h2d;
+  h2d.stage     = {{8, 2, 1}};
+  h2d.interface = {{0.1f, 0.1f, 0.1f}};
+  h2d.host_util = 10;
+  Advice a      = Advise(h2d);
+  bool deeper   = false;
+  for (auto e_ : a.suggestions) {
+    deeper = deeper || e_.arg == "--buffer_depth 2";
+  }
+  if (!near(a.model_period, 10.3f) || a.bound != Bottleneck::h2d ||
+      !near(ModelPeriod(h2d.stage, 0.3f, 2, 1), 8) || !deeper) {
+    return false;
+  }
+  // compute 8ms with deep pipelines on a busy device: nothing left to tune
+  PipelineProfile compute;
+  compute.stage        = {{1, 8, 1}};
+  compute.interface    = {{0.1f, 0.1f, 0.1f}};
+  compute.buffer_depth = 2;
+  compute.infer_depth  = 2;
+  compute.chip_util    = 95;
+  compute.host_util    = 10;
+  a                    = Advise(compute);
+  return near(a.model_period, 8) && a.bound == Bottleneck::compute && a.suggestions.empty() &&
+         !a.note.empty();
+}
+/*
+ * Random fills: float bounds outside uint8 are clamped to [0, 255] and both ends are drawn, the
+ * full uint32 range is accepted, and fills do not depend on the thread count.
+ */
+bool CheckRandom() {
+  const uint64_t kLen = 1 << 18;
+  std::vector<uint8_t> serial(kLen), parallel(kLen);
+  FillRand(serial.data(), kLen, ClampBound<uint8_t>(-5.f), ClampBound<uint8_t>(300.f), 1, 0, 1);
+  FillRand(parallel.data(), kLen, ClampBound<uint8_t>(-5.f), ClampBound<uint8_t>(300.f), 1, 0, 4);
+  auto minmax = std::minmax_element(serial.begin(), serial.end());
+  if (serial != parallel || *minmax.first != 0 || *minmax.second != 255) {
+    return false;
+  }
+  std::vector<uint32_t> wide(kLen), wide_parallel(kLen);
+  FillRand(wide.data(), kLen, ClampBound<uint32_t>(-1.f), ClampBound<uint32_t>(1e10f), 2, 0, 1);
+  FillRand(wide_parallel.data(), kLen, uint32_t(0), UINT32_MAX, 2, 0, 4);
+  auto wide_max = *std::max_element(wide.begin(), wide.end());
+  return wide == wide_parallel && wide_max > (UINT32_MAX / 4) * 3;
+}
+}  // namespace
+
+int main() {
+  const std::vector<std::pair<std::string, std::function<bool()>>> checks = {
+      {"KLRange", CheckKLRange},
+      {"Advisor", CheckAdvisor},
+      {"Random", CheckRandom},
+  };
+  int failed = 0;
+  for (auto e_ : checks) {
+    bool ret = e_.second();
+    SLOG(INFO) << "Check " << e_.first << (ret ? " passed." : " FAILED.");
+    failed += !ret;
+  }
+  return failed ? -1 : 0;
+}